@@ -748,6 +748,16 @@ static int check_vcpu_requests(struct kvm_vcpu *vcpu)
 			return kvm_vcpu_suspend(vcpu);
 	}
 
+	/*
+	 * Stop dirtying pages once the dirty ring is soft full, until
+	 * userspace has harvested and reset it.
+	 */
+	if (unlikely(vcpu->kvm->dirty_ring_size &&
+		     kvm_dirty_ring_soft_full(&vcpu->dirty_ring))) {
+		vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+		return 0;
+	}
+
 	return 1;
 }
 
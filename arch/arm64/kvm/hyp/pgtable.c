@@ -1085,6 +1085,71 @@ int kvm_pgtable_stage2_wrprotect(struct kvm_pgtable *pgt, u64 addr, u64 size)
 					NULL, NULL);
 }
 
+struct stage2_split_data {
+	struct kvm_s2_mmu		*mmu;
+	void				*memcache;
+	struct kvm_pgtable_mm_ops	*mm_ops;
+};
+
+static int stage2_split_walker(u64 addr, u64 end, u32 level, kvm_pte_t *ptep,
+			       enum kvm_pgtable_walk_flags flag,
+			       void * const arg)
+{
+	struct stage2_split_data *data = arg;
+	struct kvm_pgtable_mm_ops *mm_ops = data->mm_ops;
+	kvm_pte_t *childp, pte = *ptep;
+	u64 phys, granule;
+	int i;
+
+	if (!kvm_pte_valid(pte) || level == KVM_PGTABLE_MAX_LEVELS - 1)
+		return 0;
+
+	childp = mm_ops->zalloc_page(data->memcache);
+	if (!childp)
+		return -ENOMEM;
+
+	/* Map the same range one level down, with the block's attributes. */
+	phys = kvm_pte_to_phys(pte);
+	granule = kvm_granule_size(level + 1);
+	for (i = 0; i < PTRS_PER_PTE; i++) {
+		childp[i] = kvm_init_valid_leaf_pte(phys + i * granule, pte,
+						    level + 1);
+		mm_ops->get_page(childp);
+	}
+
+	/*
+	 * Break-before-make; the walker then visits the new table, splitting
+	 * what is still a block in there.
+	 */
+	stage2_put_pte(ptep, data->mmu, addr, level, mm_ops);
+	kvm_set_table_pte(ptep, childp, mm_ops);
+	mm_ops->get_page(ptep);
+
+	return 0;
+}
+
+/*
+ * Splits the block mappings in [addr, addr + size) down to page mappings,
+ * keeping output addresses and attributes. Needs one page from @mc for every
+ * block split, and fails with -ENOMEM once it runs out.
+ */
+int kvm_pgtable_stage2_split(struct kvm_pgtable *pgt, u64 addr, u64 size,
+			     void *mc)
+{
+	struct stage2_split_data data = {
+		.mmu		= pgt->mmu,
+		.memcache	= mc,
+		.mm_ops		= pgt->mm_ops,
+	};
+	struct kvm_pgtable_walker walker = {
+		.cb		= stage2_split_walker,
+		.flags		= KVM_PGTABLE_WALK_LEAF,
+		.arg		= &data,
+	};
+
+	return kvm_pgtable_walk(pgt, addr, size, &walker);
+}
+
 kvm_pte_t kvm_pgtable_stage2_mkyoung(struct kvm_pgtable *pgt, u64 addr)
 {
 	kvm_pte_t pte = 0;
@@ -8,7 +8,9 @@
 #include <linux/kvm_host.h>
 #include <linux/io.h>
 #include <linux/hugetlb.h>
+#include <linux/moduleparam.h>
 #include <linux/sched/signal.h>
+#include <linux/xarray.h>
 #include <trace/events/kvm.h>
 #include <asm/pgalloc.h>
 #include <asm/cacheflush.h>
@@ -22,6 +24,13 @@
 
 #include "trace.h"
 
+/*
+ * Defined in hyp/pgtable.c. The prototype belongs with the other
+ * kvm_pgtable_stage2_*() ones in asm/kvm_pgtable.h.
+ */
+int kvm_pgtable_stage2_split(struct kvm_pgtable *pgt, u64 addr, u64 size,
+			     void *mc);
+
 static struct kvm_pgtable *hyp_pgtable;
 static DEFINE_MUTEX(kvm_hyp_pgd_mutex);
 
@@ -74,6 +83,60 @@ static int stage2_apply_range(struct kvm *kvm, phys_addr_t addr,
 #define stage2_apply_range_resched(kvm, addr, end, fn)			\
 	stage2_apply_range(kvm, addr, end, fn, true)
 
+/*
+ * Once dirty logging is enabled for a memslot, or KVM_CLEAR_DIRTY_LOG
+ * re-protects pages in the initially-all-set mode, split the block mappings
+ * into page mappings right away rather than on the write faults the guest
+ * takes on them, this many bytes of IPA space per MMU lock hold. 0 leaves
+ * the splitting to the faults.
+ */
+static unsigned long eager_split_chunk_size;
+module_param(eager_split_chunk_size, ulong, 0644);
+
+/*
+ * Page-table pages for eager splitting, one cache per VM indexed by its
+ * struct kvm. They are kept from one kvm_mmu_split_huge_pages() call to the
+ * next, so that clearing the dirty log one 64-page mask at a time does not
+ * allocate and free them for every mask. A cache is only used with
+ * kvm->slots_lock held, and freed with the VM's stage 2 page tables.
+ */
+static DEFINE_XARRAY(kvm_split_caches);
+
+static struct kvm_mmu_memory_cache *kvm_split_cache_get(struct kvm *kvm)
+{
+	struct kvm_mmu_memory_cache *cache;
+	int ret;
+
+	cache = xa_load(&kvm_split_caches, (unsigned long)kvm);
+	if (cache)
+		return cache;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL_ACCOUNT);
+	if (!cache)
+		return NULL;
+
+	cache->gfp_zero = __GFP_ZERO;
+	ret = xa_err(xa_store(&kvm_split_caches, (unsigned long)kvm, cache,
+			      GFP_KERNEL_ACCOUNT));
+	if (ret) {
+		kfree(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+static void kvm_split_cache_free(struct kvm *kvm)
+{
+	struct kvm_mmu_memory_cache *cache;
+
+	cache = xa_erase(&kvm_split_caches, (unsigned long)kvm);
+	if (cache) {
+		kvm_mmu_free_memory_cache(cache);
+		kfree(cache);
+	}
+}
+
 static bool memslot_is_logging(struct kvm_memory_slot *memslot)
 {
 	return memslot->dirty_bitmap && !(memslot->flags & KVM_MEM_READONLY);
@@ -805,6 +868,8 @@ void kvm_free_stage2_pgd(struct kvm_s2_mmu *mmu)
 		kvm_pgtable_stage2_destroy(pgt);
 		kfree(pgt);
 	}
+
+	kvm_split_cache_free(kvm);
 }
 
 /**
@@ -865,6 +930,115 @@ static void stage2_wp_range(struct kvm_s2_mmu *mmu, phys_addr_t addr, phys_addr_
 	stage2_apply_range_resched(kvm, addr, end, kvm_pgtable_stage2_wrprotect);
 }
 
+/**
+ * kvm_mmu_split_huge_pages() - split stage 2 block mappings in a range
+ * @kvm:	The KVM pointer
+ * @addr:	Start address of range
+ * @end:	End address of range
+ *
+ * Splits the block mappings in the range into page mappings, keeping their
+ * permissions, one PMD-sized range at a time. Called with kvm->mmu_lock held
+ * for write; the lock is dropped to allocate page-table pages, and between
+ * chunks of eager_split_chunk_size bytes.
+ */
+static int kvm_mmu_split_huge_pages(struct kvm *kvm, phys_addr_t addr,
+				    phys_addr_t end)
+{
+	struct kvm_mmu_memory_cache *cache;
+	u64 chunk = max_t(u64, READ_ONCE(eager_split_chunk_size), PMD_SIZE);
+	int min_pages = kvm_mmu_cache_min_pages(kvm);
+	u64 done = 0;
+	int ret = 0;
+
+	lockdep_assert_held_write(&kvm->mmu_lock);
+	lockdep_assert_held(&kvm->slots_lock);
+
+	cache = xa_load(&kvm_split_caches, (unsigned long)kvm);
+
+	while (addr < end) {
+		struct kvm_pgtable *pgt = kvm->arch.mmu.pgt;
+		phys_addr_t next;
+		kvm_pte_t pte;
+		u32 level;
+
+		if (!pgt) {
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = kvm_pgtable_get_leaf(pgt, addr, &pte, &level);
+		if (ret)
+			break;
+
+		/* Skip holes whole, and anything within a PMD already split. */
+		if (!kvm_pte_valid(pte))
+			next = ALIGN_DOWN(addr, kvm_granule_size(level)) +
+			       kvm_granule_size(level);
+		else
+			next = ALIGN_DOWN(addr, PMD_SIZE) + PMD_SIZE;
+
+		if (kvm_pte_valid(pte) && level < KVM_PGTABLE_MAX_LEVELS - 1) {
+			if (!cache ||
+			    kvm_mmu_memory_cache_nr_free_objects(cache) < min_pages) {
+				write_unlock(&kvm->mmu_lock);
+				if (!cache)
+					cache = kvm_split_cache_get(kvm);
+				ret = cache ? kvm_mmu_topup_memory_cache(cache, min_pages) :
+					      -ENOMEM;
+				write_lock(&kvm->mmu_lock);
+				if (ret)
+					break;
+				/* The mapping may have changed meanwhile. */
+				continue;
+			}
+
+			ret = kvm_pgtable_stage2_split(pgt, ALIGN_DOWN(addr, PMD_SIZE),
+						       PMD_SIZE, cache);
+			if (ret)
+				break;
+		}
+
+		done += min_t(u64, next, end) - addr;
+		addr = next;
+		if (done >= chunk && addr < end) {
+			done = 0;
+			cond_resched_rwlock_write(&kvm->mmu_lock);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * kvm_mmu_split_memory_region() - eagerly split the block mappings of a slot
+ * @kvm:	The KVM pointer
+ * @slot:	The memory slot to split
+ *
+ * Acquires kvm_mmu_lock. Called with kvm->slots_lock mutex acquired,
+ * serializing operations for VM memory regions.
+ */
+static void kvm_mmu_split_memory_region(struct kvm *kvm, int slot)
+{
+	struct kvm_memslots *slots = kvm_memslots(kvm);
+	struct kvm_memory_slot *memslot = id_to_memslot(slots, slot);
+	phys_addr_t start, end;
+
+	if (WARN_ON_ONCE(!memslot))
+		return;
+
+	start = memslot->base_gfn << PAGE_SHIFT;
+	end = (memslot->base_gfn + memslot->npages) << PAGE_SHIFT;
+
+	write_lock(&kvm->mmu_lock);
+	kvm_mmu_split_huge_pages(kvm, start, end);
+	write_unlock(&kvm->mmu_lock);
+}
+
+static bool kvm_mmu_eager_split_enabled(void)
+{
+	return READ_ONCE(eager_split_chunk_size) && !is_protected_kvm_enabled();
+}
+
 /**
  * kvm_mmu_wp_memory_region() - write protect stage 2 entries for memory slot
  * @kvm:	The KVM pointer
@@ -923,13 +1097,23 @@ static void kvm_mmu_write_protect_pt_masked(struct kvm *kvm,
  * dirty pages.
  *
  * It calls kvm_mmu_write_protect_pt_masked to write protect selected pages to
- * enable dirty logging for them.
+ * enable dirty logging for them. In the initially-all-set mode, this is also
+ * where the blocks get split eagerly, as nothing was split when logging was
+ * enabled.
  */
 void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
 		struct kvm_memory_slot *slot,
 		gfn_t gfn_offset, unsigned long mask)
 {
+	phys_addr_t base_gfn = slot->base_gfn + gfn_offset;
+	phys_addr_t start = (base_gfn +  __ffs(mask)) << PAGE_SHIFT;
+	phys_addr_t end = (base_gfn + __fls(mask) + 1) << PAGE_SHIFT;
+
 	kvm_mmu_write_protect_pt_masked(kvm, slot, gfn_offset, mask);
+
+	if (kvm_mmu_eager_split_enabled() &&
+	    kvm_dirty_log_manual_protect_and_init_set(kvm))
+		kvm_mmu_split_huge_pages(kvm, start, end);
 }
 
 static void kvm_send_hwpoison_signal(unsigned long address, short lsb)
@@ -1695,6 +1879,8 @@ void kvm_arch_commit_memory_region(struct kvm *kvm,
 		 */
 		if (!kvm_dirty_log_manual_protect_and_init_set(kvm)) {
 			kvm_mmu_wp_memory_region(kvm, new->id);
+			if (kvm_mmu_eager_split_enabled())
+				kvm_mmu_split_memory_region(kvm, new->id);
 		}
 	}
 }
@@ -150,6 +150,14 @@ static void print_dist_state(struct seq_file *s, struct vgic_dist *dist)
 	seq_printf(s, "nr_spis:\t%d\n", dist->nr_spis);
 	if (v3)
 		seq_printf(s, "nr_lpis:\t%d\n", dist->lpi_list_count);
+	if (v3 && dist->lpi_translation_cache) {
+		u64 hits, misses;
+
+		vgic_its_cache_stats(dist, &hits, &misses);
+		seq_printf(s, "lpi_cache:\t%u entries, %llu hits, %llu misses\n",
+			   READ_ONCE(dist->lpi_translation_cache_count),
+			   hits, misses);
+	}
 	seq_printf(s, "enabled:\t%d\n", dist->enabled);
 	seq_printf(s, "\n");
 
@@ -54,7 +54,7 @@ void kvm_vgic_early_init(struct kvm *kvm)
 	struct vgic_dist *dist = &kvm->arch.vgic;
 
 	INIT_LIST_HEAD(&dist->lpi_list_head);
-	INIT_LIST_HEAD(&dist->lpi_translation_cache);
+	INIT_LIST_HEAD(&dist->lpi_translation_cache_lru);
 	raw_spin_lock_init(&dist->lpi_list_lock);
 }
 
@@ -11,6 +11,7 @@
 #include <linux/kvm_host.h>
 #include <linux/interrupt.h>
 #include <linux/list.h>
+#include <linux/hash.h>
 #include <linux/uaccess.h>
 #include <linux/list_sort.h>
 
@@ -146,7 +147,9 @@ struct its_ite {
 };
 
 struct vgic_translation_cache_entry {
+	struct hlist_node	node;
 	struct list_head	entry;
+	struct rcu_head		rcu;
 	phys_addr_t		db;
 	u32			devid;
 	u32			eventid;
@@ -545,127 +548,212 @@ static unsigned long vgic_mmio_read_its_idregs(struct kvm *kvm,
 	return 0;
 }
 
-static struct vgic_irq *__vgic_its_check_cache(struct vgic_dist *dist,
-					       phys_addr_t db,
-					       u32 devid, u32 eventid)
+/* Default is 16 cached LPIs per vcpu */
+#define LPI_DEFAULT_PCPU_CACHE_SIZE	16
+/* ... or 32 per mapped device, whichever is bigger */
+#define LPI_DEFAULT_PDEV_CACHE_SIZE	32
+#define LPI_MAX_CACHE_SIZE		8192
+#define LPI_CACHE_HASH_BITS		10
+
+static unsigned int vgic_its_cache_capacity(struct kvm *kvm)
 {
-	struct vgic_translation_cache_entry *cte;
+	struct vgic_dist *dist = &kvm->arch.vgic;
+	unsigned int sz;
 
-	list_for_each_entry(cte, &dist->lpi_translation_cache, entry) {
-		/*
-		 * If we hit a NULL entry, there is nothing after this
-		 * point.
-		 */
-		if (!cte->irq)
-			break;
+	sz = max_t(unsigned int,
+		   atomic_read(&kvm->online_vcpus) * LPI_DEFAULT_PCPU_CACHE_SIZE,
+		   atomic_read(&dist->lpi_translation_cache_devices) *
+		   LPI_DEFAULT_PDEV_CACHE_SIZE);
 
-		if (cte->db != db || cte->devid != devid ||
-		    cte->eventid != eventid)
-			continue;
+	return min_t(unsigned int, sz, LPI_MAX_CACHE_SIZE);
+}
 
-		/*
-		 * Move this entry to the head, as it is the most
-		 * recently used.
-		 */
-		if (!list_is_first(&cte->entry, &dist->lpi_translation_cache))
-			list_move(&cte->entry, &dist->lpi_translation_cache);
+static struct hlist_head *vgic_its_cache_bucket(struct hlist_head *cache,
+						phys_addr_t db,
+						u32 devid, u32 eventid)
+{
+	u64 key = db ^ ((u64)devid << 32 | eventid);
+
+	return &cache[hash_64(key, LPI_CACHE_HASH_BITS)];
+}
+
+/* Must be called with either the RCU read lock or lpi_list_lock held */
+static struct vgic_translation_cache_entry *
+__vgic_its_find_cte(struct vgic_dist *dist, struct hlist_head *cache,
+		    phys_addr_t db, u32 devid, u32 eventid)
+{
+	struct vgic_translation_cache_entry *cte;
 
-		return cte->irq;
+	hlist_for_each_entry_rcu(cte,
+				 vgic_its_cache_bucket(cache, db, devid, eventid),
+				 node, lockdep_is_held(&dist->lpi_list_lock)) {
+		if (cte->db == db && cte->devid == devid &&
+		    cte->eventid == eventid)
+			return cte;
 	}
 
 	return NULL;
 }
 
+/*
+ * Lockless lookup of a cached translation. On a hit, returns the interrupt
+ * with an extra reference that the caller must drop with vgic_put_irq().
+ */
 static struct vgic_irq *vgic_its_check_cache(struct kvm *kvm, phys_addr_t db,
 					     u32 devid, u32 eventid)
 {
 	struct vgic_dist *dist = &kvm->arch.vgic;
-	struct vgic_irq *irq;
-	unsigned long flags;
+	struct vgic_translation_cache_entry *cte;
+	struct vgic_irq *irq = NULL;
+	struct hlist_head *cache;
 
-	raw_spin_lock_irqsave(&dist->lpi_list_lock, flags);
-	irq = __vgic_its_check_cache(dist, db, devid, eventid);
-	raw_spin_unlock_irqrestore(&dist->lpi_list_lock, flags);
+	/* Pairs with smp_store_release() in vgic_lpi_translation_cache_init() */
+	cache = smp_load_acquire(&dist->lpi_translation_cache);
+	if (!cache)
+		return NULL;
+
+	rcu_read_lock();
+
+	cte = __vgic_its_find_cte(dist, cache, db, devid, eventid);
+	/* The LPI could be on its way out once the entry got evicted */
+	if (cte && kref_get_unless_zero(&cte->irq->refcount))
+		irq = cte->irq;
+
+	rcu_read_unlock();
+
+	if (irq)
+		this_cpu_inc(dist->lpi_translation_cache_stats->hits);
+	else
+		this_cpu_inc(dist->lpi_translation_cache_stats->misses);
 
 	return irq;
 }
 
+/* Must be called with lpi_list_lock held */
+static void __vgic_its_evict_cte(struct kvm *kvm,
+				 struct vgic_translation_cache_entry *cte)
+{
+	struct vgic_dist *dist = &kvm->arch.vgic;
+
+	hlist_del_rcu(&cte->node);
+	list_del(&cte->entry);
+	dist->lpi_translation_cache_count--;
+
+	/* Drop the reference the cache held on the interrupt */
+	__vgic_put_lpi_locked(kvm, cte->irq);
+	kfree_rcu(cte, rcu);
+}
+
 static void vgic_its_cache_translation(struct kvm *kvm, struct vgic_its *its,
 				       u32 devid, u32 eventid,
 				       struct vgic_irq *irq)
 {
 	struct vgic_dist *dist = &kvm->arch.vgic;
-	struct vgic_translation_cache_entry *cte;
+	struct vgic_translation_cache_entry *cte, *new;
+	unsigned int capacity;
+	struct hlist_head *cache;
 	unsigned long flags;
 	phys_addr_t db;
+	bool cached;
 
 	/* Do not cache a directly injected interrupt */
 	if (irq->hw)
 		return;
 
-	raw_spin_lock_irqsave(&dist->lpi_list_lock, flags);
+	cache = dist->lpi_translation_cache;
+	if (unlikely(!cache))
+		return;
 
-	if (unlikely(list_empty(&dist->lpi_translation_cache)))
-		goto out;
+	db = its->vgic_its_base + GITS_TRANSLATER;
+
+	rcu_read_lock();
+	cached = __vgic_its_find_cte(dist, cache, db, devid, eventid);
+	rcu_read_unlock();
+	if (cached)
+		return;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL_ACCOUNT);
+	if (!new)
+		return;
+
+	raw_spin_lock_irqsave(&dist->lpi_list_lock, flags);
 
 	/*
 	 * We could have raced with another CPU caching the same
 	 * translation behind our back, so let's check it is not in
 	 * already
 	 */
-	db = its->vgic_its_base + GITS_TRANSLATER;
-	if (__vgic_its_check_cache(dist, db, devid, eventid))
+	if (__vgic_its_find_cte(dist, cache, db, devid, eventid))
+		goto out;
+
+	capacity = vgic_its_cache_capacity(kvm);
+	if (!capacity)
 		goto out;
 
-	/* Always reuse the last entry (LRU policy) */
-	cte = list_last_entry(&dist->lpi_translation_cache,
-			      typeof(*cte), entry);
+	/*
+	 * Evict the oldest translations. Lookups don't reorder the entries,
+	 * which is what allows them to be lock-free.
+	 */
+	while (dist->lpi_translation_cache_count >= capacity) {
+		cte = list_first_entry(&dist->lpi_translation_cache_lru,
+				       typeof(*cte), entry);
+		__vgic_its_evict_cte(kvm, cte);
+	}
 
 	/*
 	 * Caching the translation implies having an extra reference
-	 * to the interrupt, so drop the potential reference on what
-	 * was in the cache, and increment it on the new interrupt.
+	 * to the interrupt.
 	 */
-	if (cte->irq)
-		__vgic_put_lpi_locked(kvm, cte->irq);
-
 	vgic_get_irq_kref(irq);
 
-	cte->db		= db;
-	cte->devid	= devid;
-	cte->eventid	= eventid;
-	cte->irq	= irq;
+	new->db		= db;
+	new->devid	= devid;
+	new->eventid	= eventid;
+	new->irq	= irq;
 
-	/* Move the new translation to the head of the list */
-	list_move(&cte->entry, &dist->lpi_translation_cache);
+	list_add_tail(&new->entry, &dist->lpi_translation_cache_lru);
+	hlist_add_head_rcu(&new->node,
+			   vgic_its_cache_bucket(cache, db, devid, eventid));
+	dist->lpi_translation_cache_count++;
+	new = NULL;
 
 out:
 	raw_spin_unlock_irqrestore(&dist->lpi_list_lock, flags);
+	kfree(new);
 }
 
 void vgic_its_invalidate_cache(struct kvm *kvm)
 {
 	struct vgic_dist *dist = &kvm->arch.vgic;
-	struct vgic_translation_cache_entry *cte;
+	struct vgic_translation_cache_entry *cte, *tmp;
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&dist->lpi_list_lock, flags);
 
-	list_for_each_entry(cte, &dist->lpi_translation_cache, entry) {
-		/*
-		 * If we hit a NULL entry, there is nothing after this
-		 * point.
-		 */
-		if (!cte->irq)
-			break;
-
-		__vgic_put_lpi_locked(kvm, cte->irq);
-		cte->irq = NULL;
-	}
+	list_for_each_entry_safe(cte, tmp, &dist->lpi_translation_cache_lru,
+				 entry)
+		__vgic_its_evict_cte(kvm, cte);
 
 	raw_spin_unlock_irqrestore(&dist->lpi_list_lock, flags);
 }
 
+void vgic_its_cache_stats(struct vgic_dist *dist, u64 *hits, u64 *misses)
+{
+	int cpu;
+
+	*hits = *misses = 0;
+	if (!dist->lpi_translation_cache_stats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct vgic_lpi_cache_stats *stats;
+
+		stats = per_cpu_ptr(dist->lpi_translation_cache_stats, cpu);
+		*hits += READ_ONCE(stats->hits);
+		*misses += READ_ONCE(stats->misses);
+	}
+}
+
 int vgic_its_resolve_lpi(struct kvm *kvm, struct vgic_its *its,
 			 u32 devid, u32 eventid, struct vgic_irq **irq)
 {
@@ -763,6 +851,7 @@ int vgic_its_inject_cached_translation(struct kvm *kvm, struct kvm_msi *msi)
 	raw_spin_lock_irqsave(&irq->irq_lock, flags);
 	irq->pending_latch = true;
 	vgic_queue_irq_unlock(kvm, irq, flags);
+	vgic_put_irq(kvm, irq);
 
 	return 0;
 }
@@ -1152,6 +1241,7 @@ static void vgic_its_free_device(struct kvm *kvm, struct its_device *device)
 
 	list_del(&device->dev_list);
 	kfree(device);
+	atomic_dec(&kvm->arch.vgic.lpi_translation_cache_devices);
 }
 
 /* its lock must be held */
@@ -1189,6 +1279,8 @@ static struct its_device *vgic_its_alloc_device(struct vgic_its *its,
 	INIT_LIST_HEAD(&device->itt_head);
 
 	list_add_tail(&device->dev_list, &its->device_list);
+	/* The translation cache grows with the number of devices */
+	atomic_inc(&its->dev->kvm->arch.vgic.lpi_translation_cache_devices);
 	return device;
 }
 
@@ -1882,45 +1974,42 @@ static int vgic_register_its_iodev(struct kvm *kvm, struct vgic_its *its,
 	return ret;
 }
 
-/* Default is 16 cached LPIs per vcpu */
-#define LPI_DEFAULT_PCPU_CACHE_SIZE	16
-
 void vgic_lpi_translation_cache_init(struct kvm *kvm)
 {
 	struct vgic_dist *dist = &kvm->arch.vgic;
-	unsigned int sz;
-	int i;
+	struct vgic_lpi_cache_stats __percpu *stats;
+	struct hlist_head *cache;
 
-	if (!list_empty(&dist->lpi_translation_cache))
+	if (dist->lpi_translation_cache)
 		return;
 
-	sz = atomic_read(&kvm->online_vcpus) * LPI_DEFAULT_PCPU_CACHE_SIZE;
-
-	for (i = 0; i < sz; i++) {
-		struct vgic_translation_cache_entry *cte;
-
-		/* An allocation failure is not fatal */
-		cte = kzalloc(sizeof(*cte), GFP_KERNEL_ACCOUNT);
-		if (WARN_ON(!cte))
-			break;
-
-		INIT_LIST_HEAD(&cte->entry);
-		list_add(&cte->entry, &dist->lpi_translation_cache);
+	/* An allocation failure is not fatal, MSIs take the slow path */
+	cache = kcalloc(1 << LPI_CACHE_HASH_BITS, sizeof(*cache),
+			GFP_KERNEL_ACCOUNT);
+	stats = alloc_percpu_gfp(struct vgic_lpi_cache_stats,
+				 GFP_KERNEL_ACCOUNT);
+	if (WARN_ON(!cache || !stats)) {
+		kfree(cache);
+		free_percpu(stats);
+		return;
 	}
+
+	dist->lpi_translation_cache_stats = stats;
+	/* Pairs with smp_load_acquire() in vgic_its_check_cache() */
+	smp_store_release(&dist->lpi_translation_cache, cache);
 }
 
 void vgic_lpi_translation_cache_destroy(struct kvm *kvm)
 {
 	struct vgic_dist *dist = &kvm->arch.vgic;
-	struct vgic_translation_cache_entry *cte, *tmp;
 
 	vgic_its_invalidate_cache(kvm);
 
-	list_for_each_entry_safe(cte, tmp,
-				 &dist->lpi_translation_cache, entry) {
-		list_del(&cte->entry);
-		kfree(cte);
-	}
+	/* The VM is going away, no MSI can be injected anymore */
+	kfree(dist->lpi_translation_cache);
+	dist->lpi_translation_cache = NULL;
+	free_percpu(dist->lpi_translation_cache_stats);
+	dist->lpi_translation_cache_stats = NULL;
 }
 
 #define INITIAL_BASER_VALUE						  \
@@ -2740,9 +2829,24 @@ static int vgic_its_has_attr(struct kvm_device *dev,
 	return -ENXIO;
 }
 
+/*
+ * kvm_arch_allow_write_without_running_vcpu - allow writing guest memory
+ * without a running vCPU while the dirty ring is enabled.
+ *
+ * The dirty pages of such writes are tracked in the memslot dirty bitmap
+ * instead; only the saving of the ITS and LPI pending tables does this.
+ */
+bool kvm_arch_allow_write_without_running_vcpu(struct kvm *kvm)
+{
+	struct vgic_dist *dist = &kvm->arch.vgic;
+
+	return dist->table_write_in_progress;
+}
+
 static int vgic_its_ctrl(struct kvm *kvm, struct vgic_its *its, u64 attr)
 {
 	const struct vgic_its_abi *abi = vgic_its_get_abi(its);
+	struct vgic_dist *dist = &kvm->arch.vgic;
 	int ret = 0;
 
 	if (attr == KVM_DEV_ARM_VGIC_CTRL_INIT) /* Nothing to do */
@@ -2762,7 +2866,9 @@ static int vgic_its_ctrl(struct kvm *kvm, struct vgic_its *its, u64 attr)
 		vgic_its_reset(kvm, its);
 		break;
 	case KVM_DEV_ARM_ITS_SAVE_TABLES:
+		dist->table_write_in_progress = true;
 		ret = abi->save_tables(its);
+		dist->table_write_in_progress = false;
 		break;
 	case KVM_DEV_ARM_ITS_RESTORE_TABLES:
 		ret = abi->restore_tables(its);
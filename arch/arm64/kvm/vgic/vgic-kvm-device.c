@@ -260,7 +260,9 @@ static int vgic_set_common_attr(struct kvm_device *dev,
 				mutex_unlock(&dev->kvm->lock);
 				return -EBUSY;
 			}
+			dev->kvm->arch.vgic.table_write_in_progress = true;
 			r = vgic_v3_save_pending_tables(dev->kvm);
+			dev->kvm->arch.vgic.table_write_in_progress = false;
 			unlock_all_vcpus(dev->kvm);
 			mutex_unlock(&dev->kvm->lock);
 			return r;
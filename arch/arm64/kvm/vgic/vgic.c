@@ -131,7 +131,8 @@ void __vgic_put_lpi_locked(struct kvm *kvm, struct vgic_irq *irq)
 	list_del(&irq->lpi_list);
 	dist->lpi_list_count--;
 
-	kfree(irq);
+	/* The translation cache may still be looking at it */
+	kfree_rcu(irq, rcu);
 }
 
 void vgic_put_irq(struct kvm *kvm, struct vgic_irq *irq)
@@ -142,6 +143,14 @@ void vgic_put_irq(struct kvm *kvm, struct vgic_irq *irq)
 	if (irq->intid < VGIC_MIN_LPI)
 		return;
 
+	/*
+	 * Only the final put needs lpi_list_lock, to unlink the LPI. Every
+	 * MSI injected through the translation cache ends up here, so don't
+	 * serialise them all on the lock for the common case.
+	 */
+	if (refcount_dec_not_one(&irq->refcount.refcount))
+		return;
+
 	raw_spin_lock_irqsave(&dist->lpi_list_lock, flags);
 	__vgic_put_lpi_locked(kvm, irq);
 	raw_spin_unlock_irqrestore(&dist->lpi_list_lock, flags);
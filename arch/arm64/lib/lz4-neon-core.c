@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * arch/arm64/lib/lz4-neon-core.c
+ *
+ * NEON instantiation of the generic LZ4 block decoder. The decoder itself is
+ * shared with lib/lz4; only the wild copy used for long literal runs and
+ * long matches is replaced by one moving 16 bytes per step through the SIMD
+ * registers. Everything in this file must run between kernel_neon_begin()
+ * and kernel_neon_end(), see lz4-neon-glue.c.
+ */
+
+#include <asm/neon-intrinsics.h>
+
+#define LZ4_DECOMPRESS_GENERIC_ONLY
+#define LZ4_wildCopy LZ4_wildCopy_neon
+#include "lz4defs.h"
+
+/*
+ * Same contract as the generic LZ4_wildCopy(): may overwrite up to 7 bytes
+ * beyond dstEnd, and the source may trail the destination by as little as
+ * 8 bytes. A step loads all of its source before storing, so it may only
+ * be as wide as the distance between the regions: 32-byte steps need them
+ * at least 32 bytes apart, 16-byte steps 16. Short-offset matches then keep
+ * replicating correctly.
+ */
+static FORCE_INLINE void LZ4_wildCopy_neon(void *dstPtr,
+	const void *srcPtr, void *dstEnd)
+{
+	BYTE *d = (BYTE *)dstPtr;
+	const BYTE *s = (const BYTE *)srcPtr;
+	BYTE *const e = (BYTE *)dstEnd;
+
+	if ((uptrval)(d - s) >= 32) {
+		while (e - d >= 32) {
+			uint8x16_t v0 = vld1q_u8(s);
+			uint8x16_t v1 = vld1q_u8(s + 16);
+
+			vst1q_u8(d, v0);
+			vst1q_u8(d + 16, v1);
+			d += 32;
+			s += 32;
+		}
+	}
+	if ((uptrval)(d - s) >= 16) {
+		while (e - d >= 16) {
+			vst1q_u8(d, vld1q_u8(s));
+			d += 16;
+			s += 16;
+		}
+		if (d >= e)
+			return;
+	}
+
+	do {
+		LZ4_copy8(d, s);
+		d += 8;
+		s += 8;
+	} while (d < e);
+}
+
+#include "lz4_decompress.c"
+
+int lz4_decompress_safe_neon_core(const char *source, char *dest,
+				  int compressedSize, int maxDecompressedSize)
+{
+	return LZ4_decompress_generic(source, dest,
+				      compressedSize, maxDecompressedSize,
+				      endOnInputSize, decode_full_block,
+				      noDict, (BYTE *)dest, NULL, 0);
+}
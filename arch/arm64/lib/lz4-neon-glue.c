@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * arch/arm64/lib/lz4-neon-glue.c
+ *
+ * Runtime selection of the NEON LZ4 decoder. At boot the NEON decoder is
+ * checked against a reference stream and timed against the generic one,
+ * and only installed for LZ4_decompress_safe() if it is both correct and
+ * faster on the CPU doing the measurement.
+ */
+
+#define pr_fmt(fmt) "lz4-neon: " fmt
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <asm/cpufeature.h>
+#include <asm/neon.h>
+#include <asm/unaligned.h>
+
+#include "lz4defs.h"
+
+int lz4_decompress_safe_neon_core(const char *source, char *dest,
+				  int compressedSize, int maxDecompressedSize);
+
+static int lz4_decompress_safe_neon(const char *source, char *dest,
+				    int compressedSize, int maxDecompressedSize)
+{
+	int ret;
+
+	kernel_neon_begin();
+	ret = lz4_decompress_safe_neon_core(source, dest, compressedSize,
+					    maxDecompressedSize);
+	kernel_neon_end();
+
+	return ret;
+}
+
+/*
+ * Test stream builder: emits LZ4 sequences and, alongside, the output they
+ * must decode to. The sequence mix is chosen to hit every copy path of the
+ * decoder: short and long literal runs, overlapping matches with offsets
+ * below 8, below 16 and below 32, and long matches needing the wild copy.
+ */
+#define LZ4_TEST_OUT_SIZE	(64 * 1024)
+#define LZ4_TEST_SRC_SIZE	(2 * LZ4_TEST_OUT_SIZE)
+#define LZ4_TEST_LAST_LITERALS	16
+
+struct lz4_test_stream {
+	u8 *src;
+	size_t slen;
+	u8 *ref;
+	size_t rlen;
+	u32 seed;
+};
+
+static u32 lz4_test_rand(struct lz4_test_stream *ts)
+{
+	ts->seed = ts->seed * 1103515245 + 12345;
+	return ts->seed >> 8;
+}
+
+static void lz4_test_put_len(struct lz4_test_stream *ts, size_t len)
+{
+	while (len >= 255) {
+		ts->src[ts->slen++] = 255;
+		len -= 255;
+	}
+	ts->src[ts->slen++] = len;
+}
+
+static void lz4_test_emit(struct lz4_test_stream *ts, size_t llen,
+			  size_t offset, size_t mlen)
+{
+	size_t i;
+
+	ts->src[ts->slen++] = (min_t(size_t, llen, RUN_MASK) << ML_BITS) |
+			      (mlen ? min_t(size_t, mlen - MINMATCH, ML_MASK) : 0);
+	if (llen >= RUN_MASK)
+		lz4_test_put_len(ts, llen - RUN_MASK);
+
+	for (i = 0; i < llen; i++) {
+		u8 c = 'a' + lz4_test_rand(ts) % 26;
+
+		ts->src[ts->slen++] = c;
+		ts->ref[ts->rlen++] = c;
+	}
+
+	if (!mlen)
+		return;
+
+	put_unaligned_le16(offset, ts->src + ts->slen);
+	ts->slen += 2;
+	if (mlen - MINMATCH >= ML_MASK)
+		lz4_test_put_len(ts, mlen - MINMATCH - ML_MASK);
+
+	/* Byte by byte, so overlapping matches replicate as LZ4 defines. */
+	for (i = 0; i < mlen; i++, ts->rlen++)
+		ts->ref[ts->rlen] = ts->ref[ts->rlen - offset];
+}
+
+static void lz4_test_build(struct lz4_test_stream *ts)
+{
+	/* Worst case for one sequence below, plus the trailing literals. */
+	const size_t room = 2 * 300 + 2 + 3 + 2 * LZ4_TEST_LAST_LITERALS;
+	size_t offset;
+
+	ts->slen = 0;
+	ts->rlen = 0;
+	ts->seed = 0x4c5a34;
+
+	lz4_test_emit(ts, 16, 8, MINMATCH);
+
+	/*
+	 * Long matches at every offset a 32-byte step would overrun but a
+	 * 16-byte one need not.
+	 */
+	for (offset = 16; offset < 32; offset++)
+		lz4_test_emit(ts, 32, offset, 96);
+
+	while (ts->rlen + room < LZ4_TEST_OUT_SIZE) {
+		u32 r = lz4_test_rand(ts);
+		size_t llen = r % 4 ? r % 12 : r % 300;
+		size_t mlen = MINMATCH + (r % 3 ? (r >> 4) % 16 : (r >> 4) % 280);
+
+		switch ((r >> 12) % 3) {
+		case 0:
+			offset = 1 + (r >> 16) % 8;
+			break;
+		case 1:
+			offset = 1 + (r >> 16) % 32;
+			break;
+		default:
+			offset = 1 + (r >> 16) % 65535;
+			break;
+		}
+		offset = min(offset, ts->rlen + llen);
+		lz4_test_emit(ts, llen, offset, mlen);
+	}
+	lz4_test_emit(ts, LZ4_TEST_LAST_LITERALS, 0, 0);
+}
+
+static bool __init lz4_neon_selftest(struct lz4_test_stream *ts, u8 *dst)
+{
+	int ret;
+
+	ret = lz4_decompress_safe_neon((char *)ts->src, (char *)dst,
+				       ts->slen, ts->rlen);
+	if (ret != ts->rlen || memcmp(dst, ts->ref, ts->rlen)) {
+		pr_err("self-test failed: decoded %d of %zu bytes\n",
+		       ret, ts->rlen);
+		return false;
+	}
+
+	/* Must refuse to overrun a too short output buffer. */
+	ret = lz4_decompress_safe_neon((char *)ts->src, (char *)dst,
+				       ts->slen, ts->rlen - 1);
+	if (ret >= 0) {
+		pr_err("self-test failed: no error on short output buffer\n");
+		return false;
+	}
+
+	return true;
+}
+
+#define LZ4_BENCH_REPS		64
+
+static unsigned long __init lz4_bench(int (*fn)(const char *, char *, int, int),
+				      struct lz4_test_stream *ts, u8 *dst)
+{
+	ktime_t best = KTIME_MAX;
+	int i;
+
+	for (i = 0; i < LZ4_BENCH_REPS; i++) {
+		ktime_t start = ktime_get();
+
+		fn((char *)ts->src, (char *)dst, ts->slen, ts->rlen);
+		best = min(best, ktime_sub(ktime_get(), start));
+	}
+
+	/* MB/s of decompressed output for the fastest run */
+	return div64_u64((u64)ts->rlen * NSEC_PER_SEC,
+			 max_t(u64, ktime_to_ns(best), 1)) >> 20;
+}
+
+static int __init lz4_neon_init(void)
+{
+	struct lz4_test_stream ts;
+	unsigned long generic, neon;
+	u8 *dst;
+	int ret = -ENOMEM;
+
+	if (!cpu_have_named_feature(ASIMD))
+		return 0;
+
+	ts.src = kmalloc(LZ4_TEST_SRC_SIZE, GFP_KERNEL);
+	ts.ref = kmalloc(LZ4_TEST_OUT_SIZE, GFP_KERNEL);
+	dst = kmalloc(LZ4_TEST_OUT_SIZE, GFP_KERNEL);
+	if (!ts.src || !ts.ref || !dst)
+		goto out;
+
+	lz4_test_build(&ts);
+
+	ret = 0;
+	if (!lz4_neon_selftest(&ts, dst))
+		goto out;
+
+	/* The arch decoder isn't installed yet, so this times the generic one. */
+	generic = lz4_bench(LZ4_decompress_safe, &ts, dst);
+	neon = lz4_bench(lz4_decompress_safe_neon, &ts, dst);
+
+	if (neon > generic) {
+		LZ4_set_arch_decompress_safe(lz4_decompress_safe_neon);
+		pr_info("using NEON decoder (%lu MB/s, generic %lu MB/s)\n",
+			neon, generic);
+	} else {
+		pr_info("keeping generic decoder (%lu MB/s, NEON %lu MB/s)\n",
+			generic, neon);
+	}
+out:
+	kfree(dst);
+	kfree(ts.ref);
+	kfree(ts.src);
+	return ret;
+}
+
+/* No module_exit(): LZ4_set_arch_decompress_safe() users cannot be drained. */
+subsys_initcall(lz4_neon_init);
+
+MODULE_DESCRIPTION("LZ4 decompression (NEON accelerated)");
+MODULE_LICENSE("GPL v2");
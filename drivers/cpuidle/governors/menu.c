@@ -14,7 +14,10 @@
 #include <linux/ktime.h>
 #include <linux/hrtimer.h>
 #include <linux/tick.h>
+#include <linux/interrupt.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/sched/loadavg.h>
 #include <linux/sched/stat.h>
 #include <linux/math64.h>
@@ -104,6 +107,15 @@
  * The iowait factor may look low, but realize that this is also already
  * represented in the system load average.
  *
+ * Interrupt timings
+ * -----------------
+ * With CONFIG_CPU_IDLE_GOV_MENU_IRQ_TIMINGS the arrival of every device
+ * interrupt is recorded and the period of each source is detected
+ * (kernel/irq/timings.c). When that yields a prediction, the earlier of
+ * the next expected interrupt and the next timer is used as the expected
+ * idle duration in place of the corrected timer and the repeating
+ * interval, which only see the wakeups of this CPU as a whole.
+ *
  */
 
 struct menu_device {
@@ -117,6 +129,66 @@ struct menu_device {
 	int		interval_ptr;
 };
 
+#ifdef CONFIG_CPU_IDLE_GOV_MENU_IRQ_TIMINGS
+static bool irq_timings = true;
+static bool menu_irq_timings_ready;
+
+static int menu_set_irq_timings(const char *val, const struct kernel_param *kp)
+{
+	bool was = irq_timings;
+	int ret;
+
+	ret = param_set_bool(val, kp);
+	if (ret || !menu_irq_timings_ready || was == irq_timings)
+		return ret;
+
+	if (irq_timings)
+		irq_timings_enable();
+	else
+		irq_timings_disable();
+	return 0;
+}
+
+static const struct kernel_param_ops menu_irq_timings_ops = {
+	.set = menu_set_irq_timings,
+	.get = param_get_bool,
+};
+module_param_cb(irq_timings, &menu_irq_timings_ops, &irq_timings, 0644);
+MODULE_PARM_DESC(irq_timings, "Predict idle durations from interrupt timings");
+
+static u64 menu_irq_timings_predict(struct menu_device *data, u64 predicted_ns)
+{
+	u64 now, next;
+
+	if (!READ_ONCE(irq_timings))
+		return predicted_ns;
+
+	now = local_clock();
+	next = irq_timings_next_event(now);
+	if (next == U64_MAX)
+		return predicted_ns;
+
+	return min(next - now, data->next_timer_ns);
+}
+
+static void __init menu_irq_timings_init(void)
+{
+	if (irq_timings)
+		irq_timings_enable();
+	menu_irq_timings_ready = true;
+}
+#else
+static inline u64 menu_irq_timings_predict(struct menu_device *data,
+					   u64 predicted_ns)
+{
+	return predicted_ns;
+}
+
+static inline void menu_irq_timings_init(void)
+{
+}
+#endif
+
 static inline int which_bucket(u64 duration_ns, unsigned int nr_iowaiters)
 {
 	int bucket = 0;
@@ -312,6 +384,7 @@ static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
 	predicted_ns = (u64)min(predicted_us,
 				get_typical_interval(data, predicted_us)) *
 				NSEC_PER_USEC;
+	predicted_ns = menu_irq_timings_predict(data, predicted_ns);
 
 	if (tick_nohz_tick_stopped()) {
 		/*
@@ -573,6 +646,7 @@ static struct cpuidle_governor menu_governor = {
  */
 static int __init init_menu(void)
 {
+	menu_irq_timings_init();
 	return cpuidle_register_governor(&menu_governor);
 }
 
@@ -45,6 +45,14 @@ MODULE_DEVICE_TABLE(pci, vmxnet3_pciid_table);
 
 static int enable_mq = 1;
 
+/* Longest wait for the next rx packet to poll for instead of taking the
+ * intr, 0 disables. Needs CONFIG_IRQ_TIMINGS to predict the packets.
+ */
+static unsigned int rx_intr_defer_us;
+module_param(rx_intr_defer_us, uint, 0444);
+MODULE_PARM_DESC(rx_intr_defer_us,
+		 "Poll for rx packets expected within this many us instead of enabling the intr (0 = off)");
+
 static void
 vmxnet3_write_mac_addr(struct vmxnet3_adapter *adapter, const u8 *mac);
 
@@ -2094,12 +2102,54 @@ vmxnet3_poll_rx_only(struct napi_struct *napi, int budget)
 	rxd_done = vmxnet3_rq_rx_complete(rq, adapter, budget);
 
 	if (rxd_done < budget) {
-		napi_complete_done(napi, rxd_done);
-		vmxnet3_enable_intr(adapter, rq->comp_ring.intr_idx);
+		u64 defer_ns = 0;
+
+		/* If the next packet is due shortly, as predicted from the
+		 * intr history, keep the intr off and poll again when it is
+		 * expected. An empty poll means the prediction failed.
+		 */
+#ifdef CONFIG_PCI_MSI
+		if (rx_intr_defer_us && rxd_done) {
+			struct msix_entry *entry =
+				&adapter->intr.msix_entries[rq->comp_ring.intr_idx];
+
+			defer_ns = irq_timings_predict_ns(entry->vector,
+					(u64)rx_intr_defer_us * NSEC_PER_USEC);
+		}
+#endif
+
+		if (napi_complete_done(napi, rxd_done) && defer_ns) {
+			rq->stats.intr_deferred++;
+			hrtimer_start(&rq->defer_timer, ns_to_ktime(defer_ns),
+				      HRTIMER_MODE_REL_PINNED);
+		} else {
+			vmxnet3_enable_intr(adapter, rq->comp_ring.intr_idx);
+		}
 	}
 	return rxd_done;
 }
 
+static enum hrtimer_restart
+vmxnet3_rq_defer_timer(struct hrtimer *timer)
+{
+	struct vmxnet3_rx_queue *rq = container_of(timer,
+					struct vmxnet3_rx_queue, defer_timer);
+
+	napi_schedule(&rq->napi);
+	return HRTIMER_NORESTART;
+}
+
+static void
+vmxnet3_napi_disable_all(struct vmxnet3_adapter *adapter)
+{
+	int i;
+
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		napi_disable(&adapter->rx_queue[i].napi);
+		hrtimer_cancel(&adapter->rx_queue[i].defer_timer);
+	}
+}
+
 
 #ifdef CONFIG_PCI_MSI
 
@@ -2928,7 +2978,6 @@ vmxnet3_reset_dev(struct vmxnet3_adapter *adapter)
 int
 vmxnet3_quiesce_dev(struct vmxnet3_adapter *adapter)
 {
-	int i;
 	unsigned long flags;
 	if (test_and_set_bit(VMXNET3_STATE_BIT_QUIESCED, &adapter->state))
 		return 0;
@@ -2940,8 +2989,7 @@ vmxnet3_quiesce_dev(struct vmxnet3_adapter *adapter)
 	spin_unlock_irqrestore(&adapter->cmd_lock, flags);
 	vmxnet3_disable_all_intrs(adapter);
 
-	for (i = 0; i < adapter->num_rx_queues; i++)
-		napi_disable(&adapter->rx_queue[i].napi);
+	vmxnet3_napi_disable_all(adapter);
 	netif_tx_disable(adapter->netdev);
 	adapter->link_speed = 0;
 	netif_carrier_off(adapter->netdev);
@@ -3615,6 +3663,7 @@ vmxnet3_probe_device(struct pci_dev *pdev,
 	int num_rx_queues;
 	int queues;
 	unsigned long flags;
+	int i;
 
 	if (!pci_msi_enabled())
 		enable_mq = 0;
@@ -3896,8 +3945,14 @@ vmxnet3_probe_device(struct pci_dev *pdev,
 	INIT_WORK(&adapter->work, vmxnet3_reset_work);
 	set_bit(VMXNET3_STATE_BIT_QUIESCED, &adapter->state);
 
+	for (i = 0; i < VMXNET3_DEVICE_MAX_RX_QUEUES; i++) {
+		hrtimer_init(&adapter->rx_queue[i].defer_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL_PINNED);
+		adapter->rx_queue[i].defer_timer.function =
+			vmxnet3_rq_defer_timer;
+	}
+
 	if (adapter->intr.type == VMXNET3_IT_MSIX) {
-		int i;
 		for (i = 0; i < adapter->num_rx_queues; i++) {
 			netif_napi_add(adapter->netdev,
 				       &adapter->rx_queue[i].napi,
@@ -4067,8 +4122,7 @@ vmxnet3_suspend(struct device *device)
 	if (!netif_running(netdev))
 		return 0;
 
-	for (i = 0; i < adapter->num_rx_queues; i++)
-		napi_disable(&adapter->rx_queue[i].napi);
+	vmxnet3_napi_disable_all(adapter);
 
 	vmxnet3_disable_all_intrs(adapter);
 	vmxnet3_free_irqs(adapter);
@@ -4238,9 +4292,17 @@ static struct pci_driver vmxnet3_driver = {
 static int __init
 vmxnet3_init_module(void)
 {
+	int err;
+
 	pr_info("%s - version %s\n", VMXNET3_DRIVER_DESC,
 		VMXNET3_DRIVER_VERSION_REPORT);
-	return pci_register_driver(&vmxnet3_driver);
+
+	if (rx_intr_defer_us)
+		irq_timings_enable();
+	err = pci_register_driver(&vmxnet3_driver);
+	if (err && rx_intr_defer_us)
+		irq_timings_disable();
+	return err;
 }
 
 module_init(vmxnet3_init_module);
@@ -4250,6 +4312,8 @@ static void
 vmxnet3_exit_module(void)
 {
 	pci_unregister_driver(&vmxnet3_driver);
+	if (rx_intr_defer_us)
+		irq_timings_disable();
 }
 
 module_exit(vmxnet3_exit_module);
@@ -106,6 +106,8 @@ vmxnet3_rq_driver_stats[] = {
 					 drop_fcs) },
 	{ "  rx buf alloc fail", offsetof(struct vmxnet3_rq_driver_stats,
 					  rx_buf_alloc_failure) },
+	{ "  rx intr deferred", offsetof(struct vmxnet3_rq_driver_stats,
+					 intr_deferred) },
 };
 
 /* global stats maintained by the driver */
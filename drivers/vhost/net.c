@@ -98,6 +98,22 @@ struct vhost_net_ubuf_ref {
 };
 
 #define VHOST_NET_BATCH 64
+/* Bounded by the packets handle_rx() may handle in one go. */
+#define VHOST_NET_RX_BATCH_MAX VHOST_NET_PKT_WEIGHT
+
+/* RX batch size: packets taken off the tap ring at once, and used heads
+ * published to the guest with one used index update and signal.
+ */
+static int rx_batch = VHOST_NET_BATCH;
+module_param(rx_batch, int, 0644);
+MODULE_PARM_DESC(rx_batch, "Number of packets received as a batch from a tap"
+			   " device, 1-256 (default: 64)");
+
+static int vhost_net_rx_batch(void)
+{
+	return clamp(READ_ONCE(rx_batch), 1, VHOST_NET_RX_BATCH_MAX);
+}
+
 struct vhost_net_buf {
 	void **queue;
 	int tail;
@@ -179,7 +195,7 @@ static int vhost_net_buf_produce(struct vhost_net_virtqueue *nvq)
 
 	rxq->head = 0;
 	rxq->tail = ptr_ring_consume_batched(nvq->rx_ring, rxq->queue,
-					      VHOST_NET_BATCH);
+					      vhost_net_rx_batch());
 	return rxq->tail;
 }
 
@@ -527,6 +543,8 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	unsigned long endtime;
 	struct socket *sock;
 	struct vhost_virtqueue *vq = poll_rx ? tvq : rvq;
+	/* The virtqueue being handled; its mutex is held. */
+	struct vhost_virtqueue *hvq = poll_rx ? rvq : tvq;
 
 	/* Try to hold the vq mutex of the paired virtqueue. We can't
 	 * use mutex_lock() here since we could not guarantee a
@@ -545,15 +563,17 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	endtime = busy_clock() + busyloop_timeout;
 
 	while (vhost_can_busy_poll(endtime)) {
-		if (vhost_has_work(&net->dev)) {
+		if (vhost_vq_has_work(hvq)) {
 			*busyloop_intr = true;
 			break;
 		}
 
 		if ((sock_has_rx_data(sock) &&
 		     !vhost_vq_avail_empty(&net->dev, rvq)) ||
-		    !vhost_vq_avail_empty(&net->dev, tvq))
+		    !vhost_vq_avail_empty(&net->dev, tvq)) {
+			hvq->stats.busypoll_hits++;
 			break;
+		}
 
 		cpu_relax();
 	}
@@ -1133,6 +1153,7 @@ static void handle_rx(struct vhost_net *net)
 	struct iov_iter fixup;
 	__virtio16 num_buffers;
 	int recv_pkts = 0;
+	int batch = vhost_net_rx_batch();
 
 	mutex_lock_nested(&vq->mutex, VHOST_NET_VQ_RX);
 	sock = vhost_vq_get_backend(vq);
@@ -1235,7 +1256,8 @@ static void handle_rx(struct vhost_net *net)
 			goto out;
 		}
 		nvq->done_idx += headcount;
-		if (nvq->done_idx > VHOST_NET_BATCH)
+		/* Leaves room in vq->heads for UIO_MAXIOV more. */
+		if (nvq->done_idx >= batch)
 			vhost_net_signal_used(nvq);
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len,
@@ -1302,7 +1324,7 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		return -ENOMEM;
 	}
 
-	queue = kmalloc_array(VHOST_NET_BATCH, sizeof(void *),
+	queue = kmalloc_array(VHOST_NET_RX_BATCH_MAX, sizeof(void *),
 			      GFP_KERNEL);
 	if (!queue) {
 		kfree(vqs);
@@ -1337,12 +1359,14 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX,
-		       UIO_MAXIOV + VHOST_NET_BATCH,
-		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true,
+		       UIO_MAXIOV + VHOST_NET_RX_BATCH_MAX,
+		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true, true,
 		       NULL);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 	n->page_frag.page = NULL;
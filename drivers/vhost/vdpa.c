@@ -1202,7 +1202,7 @@ static int vhost_vdpa_open(struct inode *inode, struct file *filep)
 		vqs[i] = &v->vqs[i];
 		vqs[i]->handle_kick = handle_vq_kick;
 	}
-	vhost_dev_init(dev, vqs, nvqs, 0, 0, 0, false,
+	vhost_dev_init(dev, vqs, nvqs, 0, 0, 0, false, false,
 		       vhost_vdpa_process_iotlb_msg);
 
 	r = vhost_vdpa_alloc_domain(v);
@@ -30,6 +30,8 @@
 #include <linux/interval_tree_generic.h>
 #include <linux/nospec.h>
 #include <linux/kcov.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "vhost.h"
 
@@ -41,6 +43,13 @@ static int max_iotlb_entries = 2048;
 module_param(max_iotlb_entries, int, 0444);
 MODULE_PARM_DESC(max_iotlb_entries,
 	"Maximum number of iotlb entries. (default: 2048)");
+static bool worker_per_vq;
+module_param(worker_per_vq, bool, 0644);
+MODULE_PARM_DESC(worker_per_vq,
+	"Give each virtqueue of a new device its own worker thread, up to one per CPU, for drivers that support it (vhost-net). (default: N)");
+
+static struct dentry *vhost_debugfs_root;
+static atomic_t vhost_dev_seq = ATOMIC_INIT(0);
 
 enum {
 	VHOST_MEMORY_F_LOG = 0x1,
@@ -170,6 +179,10 @@ static int vhost_poll_wakeup(wait_queue_entry_t *wait, unsigned mode, int sync,
 	if (!(key_to_poll(key) & poll->mask))
 		return 0;
 
+	/* Kicks are serialized by the eventfd's wait queue lock. */
+	if (poll->vq && poll == &poll->vq->poll)
+		poll->vq->stats.kicks++;
+
 	if (!poll->dev->use_worker)
 		work->fn(work);
 	else
@@ -187,12 +200,14 @@ EXPORT_SYMBOL_GPL(vhost_work_init);
 
 /* Init poll structure */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     __poll_t mask, struct vhost_dev *dev)
+		     __poll_t mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -231,17 +246,36 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-void vhost_dev_flush(struct vhost_dev *dev)
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
+		/* We can only add the work to the list after we're
+		 * sure it was not in the list.
+		 * test_and_set_bit() implies a memory barrier.
+		 */
+		llist_add(&work->node, &worker->work_list);
+		wake_up_process(worker->task);
+	}
+}
+
+static void vhost_worker_flush(struct vhost_worker *worker)
 {
 	struct vhost_flush_struct flush;
 
-	if (dev->worker) {
-		init_completion(&flush.wait_event);
-		vhost_work_init(&flush.work, vhost_flush_work);
+	init_completion(&flush.wait_event);
+	vhost_work_init(&flush.work, vhost_flush_work);
 
-		vhost_work_queue(dev, &flush.work);
-		wait_for_completion(&flush.wait_event);
-	}
+	vhost_worker_queue(worker, &flush.work);
+	wait_for_completion(&flush.wait_event);
+}
+
+void vhost_dev_flush(struct vhost_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->nworkers; i++)
+		vhost_worker_flush(dev->workers[i]);
 }
 EXPORT_SYMBOL_GPL(vhost_dev_flush);
 
@@ -250,27 +284,46 @@ void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 	if (!dev->worker)
 		return;
 
-	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
-		/* We can only add the work to the list after we're
-		 * sure it was not in the list.
-		 * test_and_set_bit() implies a memory barrier.
-		 */
-		llist_add(&work->node, &dev->work_list);
-		wake_up_process(dev->worker);
-	}
+	vhost_worker_queue(dev->worker, work);
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+/* Queue work on the worker of @vq, which may be the device's worker. */
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	if (!vq->worker)
+		return;
+
+	vhost_worker_queue(vq->worker, work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
 /* A lockless hint for busy polling code to exit the loop */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	int i;
+
+	for (i = 0; i < dev->nworkers; i++)
+		if (!llist_empty(&dev->workers[i]->work_list))
+			return true;
+
+	return false;
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
+/* Same, for busy polling in the worker of @vq: only its own works count. */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	return vq->worker && !llist_empty(&vq->worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_vq_work_queue(poll->vq, &poll->work);
+	else
+		vhost_work_queue(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -331,11 +384,13 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->iotlb = NULL;
 	vhost_vring_call_reset(&vq->call_ctx);
 	__vhost_vq_meta_reset(vq);
+	memset(&vq->stats, 0, sizeof(vq->stats));
 }
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work, *work_next;
 	struct llist_node *node;
 
@@ -350,7 +405,7 @@ static int vhost_worker(void *data)
 			break;
 		}
 
-		node = llist_del_all(&dev->work_list);
+		node = llist_del_all(&worker->work_list);
 		if (!node)
 			schedule();
 
@@ -459,7 +514,7 @@ static size_t vhost_get_desc_size(struct vhost_virtqueue *vq,
 void vhost_dev_init(struct vhost_dev *dev,
 		    struct vhost_virtqueue **vqs, int nvqs,
 		    int iov_limit, int weight, int byte_weight,
-		    bool use_worker,
+		    bool use_worker, bool vq_workers,
 		    int (*msg_handler)(struct vhost_dev *dev, u32 asid,
 				       struct vhost_iotlb_msg *msg))
 {
@@ -474,12 +529,15 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->iotlb = NULL;
 	dev->mm = NULL;
 	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 0;
+	dev->debugfs = NULL;
 	dev->iov_limit = iov_limit;
 	dev->weight = weight;
 	dev->byte_weight = byte_weight;
 	dev->use_worker = use_worker;
+	dev->vq_workers = vq_workers;
 	dev->msg_handler = msg_handler;
-	init_llist_head(&dev->work_list);
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
 	INIT_LIST_HEAD(&dev->pending_list);
@@ -492,11 +550,12 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->indirect = NULL;
 		vq->heads = NULL;
 		vq->dev = dev;
+		vq->worker = NULL;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					EPOLLIN, dev);
+					EPOLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -523,17 +582,152 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_dev_flush(dev);
+	vhost_worker_queue(worker, &attach.work);
+	vhost_worker_flush(worker);
 	return attach.ret;
 }
 
+/* Caller should have device mutex */
+static int vhost_worker_create(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int id = dev->nworkers;
+	int err;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL_ACCOUNT);
+	if (!worker)
+		return -ENOMEM;
+
+	worker->dev = dev;
+	init_llist_head(&worker->work_list);
+
+	if (id)
+		task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+				      current->pid, id);
+	else
+		task = kthread_create(vhost_worker, worker, "vhost-%d",
+				      current->pid);
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto err_free;
+	}
+
+	worker->task = task;
+	wake_up_process(task); /* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_stop;
+
+	dev->workers[dev->nworkers++] = worker;
+	return 0;
+
+err_stop:
+	kthread_stop(task);
+err_free:
+	kfree(worker);
+	return err;
+}
+
+/* Caller should have device mutex, and no work may be queued any more. */
+static void vhost_workers_free(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	int i;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = NULL;
+
+	for (i = 0; i < dev->nworkers; i++) {
+		worker = dev->workers[i];
+		WARN_ON(!llist_empty(&worker->work_list));
+		kthread_stop(worker->task);
+		kfree(worker);
+	}
+
+	kfree(dev->workers);
+	dev->workers = NULL;
+	dev->nworkers = 0;
+	dev->worker = NULL;
+}
+
+/*
+ * With worker_per_vq, virtqueue i is run by worker i modulo the number of
+ * workers, and worker 0 also runs the device-wide works. Otherwise the
+ * device's one worker runs everything. Only drivers that passed vq_workers
+ * to vhost_dev_init() get more than one: others, like vhost-scsi, update
+ * the used ring of one virtqueue from works that may run on any worker
+ * without holding vq->mutex, and rely on all of them being serialised.
+ */
+static int vhost_workers_create(struct vhost_dev *dev)
+{
+	int nworkers = 1;
+	int i, err;
+
+	if (dev->vq_workers && READ_ONCE(worker_per_vq))
+		nworkers = clamp_t(int, dev->nvqs, 1, num_online_cpus());
+
+	dev->workers = kcalloc(nworkers, sizeof(*dev->workers),
+			       GFP_KERNEL_ACCOUNT);
+	if (!dev->workers)
+		return -ENOMEM;
+
+	for (i = 0; i < nworkers; i++) {
+		err = vhost_worker_create(dev);
+		if (err)
+			goto err_free;
+	}
+
+	dev->worker = dev->workers[0];
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = dev->workers[i % nworkers];
+
+	return 0;
+
+err_free:
+	vhost_workers_free(dev);
+	return err;
+}
+
+static int vhost_vqs_show(struct seq_file *m, void *v)
+{
+	struct vhost_dev *dev = m->private;
+	struct vhost_virtqueue *vq;
+	int i;
+
+	seq_puts(m, "vq worker kicks batches used busypoll_hits\n");
+	for (i = 0; i < dev->nvqs; ++i) {
+		vq = dev->vqs[i];
+		seq_printf(m, "%d %d %llu %llu %llu %llu\n", i,
+			   vq->worker ? task_pid_nr(vq->worker->task) : -1,
+			   READ_ONCE(vq->stats.kicks),
+			   READ_ONCE(vq->stats.batches),
+			   READ_ONCE(vq->stats.used),
+			   READ_ONCE(vq->stats.busypoll_hits));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(vhost_vqs);
+
+/* One directory per owned device: vhost/<owner pid>-<sequence number> */
+static void vhost_dev_debugfs_init(struct vhost_dev *dev)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "%d-%d", current->pid,
+		 atomic_inc_return(&vhost_dev_seq));
+	dev->debugfs = debugfs_create_dir(name, vhost_debugfs_root);
+	debugfs_create_file("vqs", 0444, dev->debugfs, dev, &vhost_vqs_fops);
+}
+
 /* Caller should have device mutex */
 bool vhost_dev_has_owner(struct vhost_dev *dev)
 {
@@ -574,7 +768,6 @@ static void vhost_detach_mm(struct vhost_dev *dev)
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -587,31 +780,20 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	dev->kcov_handle = kcov_common_handle();
 	if (dev->use_worker) {
-		worker = kthread_create(vhost_worker, dev,
-					"vhost-%d", current->pid);
-		if (IS_ERR(worker)) {
-			err = PTR_ERR(worker);
-			goto err_worker;
-		}
-
-		dev->worker = worker;
-		wake_up_process(worker); /* avoid contributing to loadavg */
-
-		err = vhost_attach_cgroups(dev);
+		err = vhost_workers_create(dev);
 		if (err)
-			goto err_cgroup;
+			goto err_worker;
 	}
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_iovecs;
+
+	vhost_dev_debugfs_init(dev);
 
 	return 0;
-err_cgroup:
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+err_iovecs:
+	vhost_workers_free(dev);
 err_worker:
 	vhost_detach_mm(dev);
 	dev->kcov_handle = 0;
@@ -704,10 +886,10 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	dev->iotlb = NULL;
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
-	WARN_ON(!llist_empty(&dev->work_list));
+	debugfs_remove_recursive(dev->debugfs);
+	dev->debugfs = NULL;
 	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
+		vhost_workers_free(dev);
 		dev->kcov_handle = 0;
 	}
 	vhost_detach_mm(dev);
@@ -2406,6 +2588,7 @@ static int __vhost_add_used_n(struct vhost_virtqueue *vq,
 int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 		     unsigned count)
 {
+	unsigned int total = count;
 	int start, n, r;
 
 	start = vq->last_used_idx & (vq->num - 1);
@@ -2425,6 +2608,8 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 		vq_err(vq, "Failed to increment used idx");
 		return -EFAULT;
 	}
+	vq->stats.batches++;
+	vq->stats.used += total;
 	if (unlikely(vq->log_used)) {
 		/* Make sure used idx is seen before log. */
 		smp_wmb();
@@ -2639,11 +2824,13 @@ EXPORT_SYMBOL_GPL(vhost_set_backend_features);
 
 static int __init vhost_init(void)
 {
+	vhost_debugfs_root = debugfs_create_dir("vhost", NULL);
 	return 0;
 }
 
 static void __exit vhost_exit(void)
 {
+	debugfs_remove_recursive(vhost_debugfs_root);
 }
 
 module_init(vhost_init);
@@ -25,6 +25,13 @@ struct vhost_work {
 	unsigned long		flags;
 };
 
+/* A kernel thread running the works queued to it, in queueing order. */
+struct vhost_worker {
+	struct task_struct	*task;
+	struct llist_head	work_list;
+	struct vhost_dev	*dev;
+};
+
 /* Poll a file (eventfd or socket) */
 /* Note: there's nothing vhost specific about this structure. */
 struct vhost_poll {
@@ -34,14 +41,19 @@ struct vhost_poll {
 	struct vhost_work	work;
 	__poll_t		mask;
 	struct vhost_dev	*dev;
+	/* Virtqueue whose worker runs the work, or NULL for the device's. */
+	struct vhost_virtqueue	*vq;
 };
 
 void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn);
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work);
 bool vhost_has_work(struct vhost_dev *dev);
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work);
+bool vhost_vq_has_work(struct vhost_virtqueue *vq);
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     __poll_t mask, struct vhost_dev *dev);
+		     __poll_t mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq);
 int vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_queue(struct vhost_poll *poll);
@@ -64,6 +76,17 @@ struct vhost_vring_call {
 	struct irq_bypass_producer producer;
 };
 
+/* Per-virtqueue counters, exported through debugfs. */
+struct vhost_vq_stats {
+	/* Notifications from the guest. */
+	u64 kicks;
+	/* Updates of the used ring, and the buffers they returned. */
+	u64 batches;
+	u64 used;
+	/* Busy-poll loops that ended with new work found. */
+	u64 busypoll_hits;
+};
+
 /* The virtqueue structure describes a queue attached to a device. */
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
@@ -81,6 +104,8 @@ struct vhost_virtqueue {
 	struct eventfd_ctx *log_ctx;
 
 	struct vhost_poll poll;
+	/* Runs poll and the other works of this virtqueue. */
+	struct vhost_worker *worker;
 
 	/* The routine to call when the Guest pings us, or timeout. */
 	vhost_work_fn_t handle_kick;
@@ -130,6 +155,7 @@ struct vhost_virtqueue {
 	bool user_be;
 #endif
 	u32 busyloop_timeout;
+	struct vhost_vq_stats stats;
 };
 
 struct vhost_msg_node {
@@ -147,8 +173,11 @@ struct vhost_dev {
 	struct vhost_virtqueue **vqs;
 	int nvqs;
 	struct eventfd_ctx *log_ctx;
-	struct llist_head work_list;
-	struct task_struct *worker;
+	/* workers[0], which also runs the device-wide works. */
+	struct vhost_worker *worker;
+	struct vhost_worker **workers;
+	int nworkers;
+	struct dentry *debugfs;
 	struct vhost_iotlb *umem;
 	struct vhost_iotlb *iotlb;
 	spinlock_t iotlb_lock;
@@ -160,6 +189,8 @@ struct vhost_dev {
 	int byte_weight;
 	u64 kcov_handle;
 	bool use_worker;
+	/* Virtqueues may run on workers of their own, see worker_per_vq. */
+	bool vq_workers;
 	int (*msg_handler)(struct vhost_dev *dev, u32 asid,
 			   struct vhost_iotlb_msg *msg);
 };
@@ -167,7 +198,7 @@ struct vhost_dev {
 bool vhost_exceeds_weight(struct vhost_virtqueue *vq, int pkts, int total_len);
 void vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue **vqs,
 		    int nvqs, int iov_limit, int weight, int byte_weight,
-		    bool use_worker,
+		    bool use_worker, bool vq_workers,
 		    int (*msg_handler)(struct vhost_dev *dev, u32 asid,
 				       struct vhost_iotlb_msg *msg));
 long vhost_dev_set_owner(struct vhost_dev *dev);
@@ -28,6 +28,12 @@
  * small pkts.
  */
 #define VHOST_VSOCK_PKT_WEIGHT 256
+/* Max number of guest packets delivered to sockets at once. The replies
+ * they trigger are only counted once they are delivered, so this bounds
+ * how far queued_replies can exceed the limit vhost_vsock_more_replies()
+ * checks for.
+ */
+#define VHOST_VSOCK_RX_BATCH 32
 
 enum {
 	VHOST_VSOCK_FEATURES = VHOST_FEATURES |
@@ -497,9 +503,10 @@ static void vhost_vsock_handle_tx_kick(struct vhost_work *work)
 	struct vhost_vsock *vsock = container_of(vq->dev, struct vhost_vsock,
 						 dev);
 	struct virtio_vsock_pkt *pkt;
-	int head, pkts = 0, total_len = 0;
+	int head, pkts = 0, total_len = 0, nr_rx = 0;
 	unsigned int out, in;
 	bool added = false;
+	LIST_HEAD(rx_pkts);
 
 	mutex_lock(&vq->mutex);
 
@@ -546,16 +553,27 @@ static void vhost_vsock_handle_tx_kick(struct vhost_work *work)
 		/* Only accept correctly addressed packets */
 		if (le64_to_cpu(pkt->hdr.src_cid) == vsock->guest_cid &&
 		    le64_to_cpu(pkt->hdr.dst_cid) ==
-		    vhost_transport_get_local_cid())
-			virtio_transport_recv_pkt(&vhost_transport, pkt);
-		else
+		    vhost_transport_get_local_cid()) {
+			list_add_tail(&pkt->list, &rx_pkts);
+			nr_rx++;
+		} else {
 			virtio_transport_free_pkt(pkt);
+		}
 
 		vhost_add_used(vq, head, 0);
 		added = true;
+
+		/* Let the reply check above see what this batch queued */
+		if (nr_rx == VHOST_VSOCK_RX_BATCH) {
+			virtio_transport_recv_pkts(&vhost_transport, &rx_pkts);
+			nr_rx = 0;
+		}
 	} while(likely(!vhost_exceeds_weight(vq, ++pkts, total_len)));
 
 no_more_replies:
+	/* Deliver what is left of the last batch */
+	virtio_transport_recv_pkts(&vhost_transport, &rx_pkts);
+
 	if (added)
 		vhost_signal(&vsock->dev, vq);
 
@@ -690,7 +708,7 @@ static int vhost_vsock_dev_open(struct inode *inode, struct file *file)
 
 	vhost_dev_init(&vsock->dev, vqs, ARRAY_SIZE(vsock->vqs),
 		       UIO_MAXIOV, VHOST_VSOCK_PKT_WEIGHT,
-		       VHOST_VSOCK_WEIGHT, true, NULL);
+		       VHOST_VSOCK_WEIGHT, true, false, NULL);
 
 	file->private_data = vsock;
 	spin_lock_init(&vsock->send_pkt_list_lock);
@@ -247,6 +247,17 @@ struct virtio_mem {
 #define VIRTIO_MEM_RETRY_TIMER_MIN_MS		50000
 #define VIRTIO_MEM_RETRY_TIMER_MAX_MS		300000
 
+	/*
+	 * Progress of the current resize request and some statistics,
+	 * exposed via sysfs. Only updated from the workqueue.
+	 */
+	bool resizing;
+	ktime_t resize_start;
+	s64 last_resize_ms;
+	int last_rc;
+	unsigned long plug_requests;
+	unsigned long unplug_requests;
+
 	/* Memory notifier (online/offline events). */
 	struct notifier_block memory_notifier;
 
@@ -1365,9 +1376,10 @@ static int virtio_mem_send_plug_request(struct virtio_mem *vm, uint64_t addr,
 	dev_dbg(&vm->vdev->dev, "plugging memory: 0x%llx - 0x%llx\n", addr,
 		addr + size - 1);
 
+	WRITE_ONCE(vm->plug_requests, vm->plug_requests + 1);
 	switch (virtio_mem_send_request(vm, &req)) {
 	case VIRTIO_MEM_RESP_ACK:
-		vm->plugged_size += size;
+		WRITE_ONCE(vm->plugged_size, vm->plugged_size + size);
 		return 0;
 	case VIRTIO_MEM_RESP_NACK:
 		rc = -EAGAIN;
@@ -1403,9 +1415,10 @@ static int virtio_mem_send_unplug_request(struct virtio_mem *vm, uint64_t addr,
 	dev_dbg(&vm->vdev->dev, "unplugging memory: 0x%llx - 0x%llx\n", addr,
 		addr + size - 1);
 
+	WRITE_ONCE(vm->unplug_requests, vm->unplug_requests + 1);
 	switch (virtio_mem_send_request(vm, &req)) {
 	case VIRTIO_MEM_RESP_ACK:
-		vm->plugged_size -= size;
+		WRITE_ONCE(vm->plugged_size, vm->plugged_size - size);
 		return 0;
 	case VIRTIO_MEM_RESP_BUSY:
 		rc = -ETXTBSY;
@@ -1640,6 +1653,93 @@ static int virtio_mem_sbm_plug_and_add_mb(struct virtio_mem *vm,
 	return 0;
 }
 
+/*
+ * Number of blocks of the given size we can plug using a single request and
+ * add to Linux right away, at most @max. The device accepts at most U16_MAX
+ * device blocks per request and we don't want to exceed the offline threshold.
+ */
+static uint64_t virtio_mem_plug_batch_size(struct virtio_mem *vm,
+					   uint64_t block_size, uint64_t max)
+{
+	const uint64_t offline_size = atomic64_read(&vm->offline_size);
+	uint64_t count;
+
+	count = div64_u64(U16_MAX * vm->device_block_size, block_size);
+	count = min(count, max);
+	if (offline_size >= vm->offline_threshold)
+		return 0;
+	return min(count, div64_u64(vm->offline_threshold - offline_size,
+				    block_size));
+}
+
+/*
+ * Prepare up to @count new memory blocks, plug all of them completely using
+ * a single request and add them to Linux one by one. New memory blocks are
+ * prepared in ascending order, so they are physically contiguous.
+ *
+ * Will modify the state of the memory blocks.
+ */
+static int virtio_mem_sbm_plug_and_add_new_mbs(struct virtio_mem *vm,
+					       uint64_t count, uint64_t *nb_sb)
+{
+	const uint64_t size = memory_block_size_bytes();
+	unsigned long first_mb_id, mb_id;
+	uint64_t i;
+	int rc = 0;
+
+	for (i = 0; i < count; i++) {
+		rc = virtio_mem_sbm_prepare_next_mb(vm, &mb_id);
+		if (rc)
+			break;
+		if (!i)
+			first_mb_id = mb_id;
+	}
+	if (!i)
+		return rc;
+	count = i;
+
+	rc = virtio_mem_send_plug_request(vm,
+					  virtio_mem_mb_id_to_phys(first_mb_id),
+					  count * size);
+	if (rc)
+		return rc;
+	for (i = 0; i < count; i++) {
+		virtio_mem_sbm_set_sb_plugged(vm, first_mb_id + i, 0,
+					      vm->sbm.sbs_per_mb);
+		virtio_mem_sbm_set_mb_state(vm, first_mb_id + i,
+					    VIRTIO_MEM_SBM_MB_PLUGGED);
+	}
+
+	for (i = 0; i < count; i++) {
+		mb_id = first_mb_id + i;
+		virtio_mem_sbm_set_mb_state(vm, mb_id,
+					    VIRTIO_MEM_SBM_MB_OFFLINE);
+		rc = virtio_mem_sbm_add_mb(vm, mb_id);
+		if (rc)
+			break;
+		*nb_sb -= vm->sbm.sbs_per_mb;
+	}
+	if (!rc)
+		return 0;
+
+	/* Unplug what we could not add using a single request. */
+	if (!virtio_mem_send_unplug_request(vm, virtio_mem_mb_id_to_phys(mb_id),
+					    (count - i) * size)) {
+		for (; i < count; i++) {
+			virtio_mem_sbm_set_sb_unplugged(vm, first_mb_id + i, 0,
+							vm->sbm.sbs_per_mb);
+			virtio_mem_sbm_set_mb_state(vm, first_mb_id + i,
+						    VIRTIO_MEM_SBM_MB_UNUSED);
+		}
+	} else {
+		/* Retry from the main loop. */
+		for (; i < count; i++)
+			virtio_mem_sbm_set_mb_state(vm, first_mb_id + i,
+						    VIRTIO_MEM_SBM_MB_PLUGGED);
+	}
+	return rc;
+}
+
 /*
  * Try to plug the desired number of subblocks of a memory block that
  * is already added to Linux.
@@ -1698,6 +1798,7 @@ static int virtio_mem_sbm_plug_request(struct virtio_mem *vm, uint64_t diff)
 	};
 	uint64_t nb_sb = diff / vm->sbm.sb_size;
 	unsigned long mb_id;
+	uint64_t batch;
 	int rc, i;
 
 	if (!nb_sb)
@@ -1737,6 +1838,17 @@ static int virtio_mem_sbm_plug_request(struct virtio_mem *vm, uint64_t diff)
 		if (!virtio_mem_could_add_memory(vm, memory_block_size_bytes()))
 			return -ENOSPC;
 
+		/* Plug multiple completely plugged blocks at once if possible. */
+		batch = virtio_mem_plug_batch_size(vm, memory_block_size_bytes(),
+						   div_u64(nb_sb, vm->sbm.sbs_per_mb));
+		if (batch > 1) {
+			rc = virtio_mem_sbm_plug_and_add_new_mbs(vm, batch, &nb_sb);
+			if (rc)
+				return rc;
+			cond_resched();
+			continue;
+		}
+
 		rc = virtio_mem_sbm_prepare_next_mb(vm, &mb_id);
 		if (rc)
 			return rc;
@@ -1807,10 +1919,72 @@ static int virtio_mem_bbm_prepare_next_bb(struct virtio_mem *vm,
 	return 0;
 }
 
+/*
+ * Prepare up to @count new big blocks, plug them using a single request and
+ * add them to Linux one by one. New big blocks are prepared in ascending
+ * order, so they are physically contiguous.
+ *
+ * Will modify the state of the big blocks.
+ */
+static int virtio_mem_bbm_plug_and_add_new_bbs(struct virtio_mem *vm,
+					       uint64_t count, uint64_t *nb_bb)
+{
+	unsigned long first_bb_id, bb_id;
+	uint64_t i;
+	int rc = 0;
+
+	for (i = 0; i < count; i++) {
+		rc = virtio_mem_bbm_prepare_next_bb(vm, &bb_id);
+		if (rc)
+			break;
+		if (!i)
+			first_bb_id = bb_id;
+	}
+	if (!i)
+		return rc;
+	count = i;
+
+	rc = virtio_mem_send_plug_request(vm,
+					  virtio_mem_bb_id_to_phys(vm, first_bb_id),
+					  count * vm->bbm.bb_size);
+	if (rc)
+		return rc;
+	for (i = 0; i < count; i++)
+		virtio_mem_bbm_set_bb_state(vm, first_bb_id + i,
+					    VIRTIO_MEM_BBM_BB_PLUGGED);
+
+	for (i = 0; i < count; i++) {
+		bb_id = first_bb_id + i;
+		virtio_mem_bbm_set_bb_state(vm, bb_id, VIRTIO_MEM_BBM_BB_ADDED);
+		rc = virtio_mem_bbm_add_bb(vm, bb_id);
+		if (rc)
+			break;
+		(*nb_bb)--;
+	}
+	if (!rc)
+		return 0;
+
+	/* Unplug what we could not add using a single request. */
+	if (!virtio_mem_send_unplug_request(vm,
+					    virtio_mem_bb_id_to_phys(vm, bb_id),
+					    (count - i) * vm->bbm.bb_size)) {
+		for (; i < count; i++)
+			virtio_mem_bbm_set_bb_state(vm, first_bb_id + i,
+						    VIRTIO_MEM_BBM_BB_UNUSED);
+	} else {
+		/* Retry from the main loop. */
+		for (; i < count; i++)
+			virtio_mem_bbm_set_bb_state(vm, first_bb_id + i,
+						    VIRTIO_MEM_BBM_BB_PLUGGED);
+	}
+	return rc;
+}
+
 static int virtio_mem_bbm_plug_request(struct virtio_mem *vm, uint64_t diff)
 {
 	uint64_t nb_bb = diff / vm->bbm.bb_size;
 	unsigned long bb_id;
+	uint64_t batch;
 	int rc;
 
 	if (!nb_bb)
@@ -1834,6 +2008,15 @@ static int virtio_mem_bbm_plug_request(struct virtio_mem *vm, uint64_t diff)
 		if (!virtio_mem_could_add_memory(vm, vm->bbm.bb_size))
 			return -ENOSPC;
 
+		batch = virtio_mem_plug_batch_size(vm, vm->bbm.bb_size, nb_bb);
+		if (batch > 1) {
+			rc = virtio_mem_bbm_plug_and_add_new_bbs(vm, batch, &nb_bb);
+			if (rc)
+				return rc;
+			cond_resched();
+			continue;
+		}
+
 		rc = virtio_mem_bbm_prepare_next_bb(vm, &bb_id);
 		if (rc)
 			return rc;
@@ -2296,13 +2479,14 @@ static int virtio_mem_unplug_pending_mb(struct virtio_mem *vm)
 static void virtio_mem_refresh_config(struct virtio_mem *vm)
 {
 	const struct range pluggable_range = mhp_get_pluggable_range(true);
-	uint64_t new_plugged_size, usable_region_size, end_addr;
+	uint64_t new_plugged_size, new_requested_size, usable_region_size;
+	uint64_t end_addr;
 
 	/* the plugged_size is just a reflection of what _we_ did previously */
 	virtio_cread_le(vm->vdev, struct virtio_mem_config, plugged_size,
 			&new_plugged_size);
 	if (WARN_ON_ONCE(new_plugged_size != vm->plugged_size))
-		vm->plugged_size = new_plugged_size;
+		WRITE_ONCE(vm->plugged_size, new_plugged_size);
 
 	/* calculate the last usable memory block id */
 	virtio_cread_le(vm->vdev, struct virtio_mem_config,
@@ -2329,7 +2513,14 @@ static void virtio_mem_refresh_config(struct virtio_mem *vm)
 
 	/* see if there is a request to change the size */
 	virtio_cread_le(vm->vdev, struct virtio_mem_config, requested_size,
-			&vm->requested_size);
+			&new_requested_size);
+	if (new_requested_size != vm->requested_size ||
+	    new_requested_size != vm->plugged_size) {
+		if (!vm->resizing)
+			vm->resize_start = ktime_get();
+		WRITE_ONCE(vm->resizing, true);
+	}
+	WRITE_ONCE(vm->requested_size, new_requested_size);
 
 	dev_info(&vm->vdev->dev, "plugged size: 0x%llx", vm->plugged_size);
 	dev_info(&vm->vdev->dev, "requested size: 0x%llx", vm->requested_size);
@@ -2382,9 +2573,15 @@ static void virtio_mem_run_wq(struct work_struct *work)
 		}
 	}
 
+	WRITE_ONCE(vm->last_rc, rc);
 	switch (rc) {
 	case 0:
 		vm->retry_timer_ms = VIRTIO_MEM_RETRY_TIMER_MIN_MS;
+		if (vm->resizing) {
+			WRITE_ONCE(vm->last_resize_ms,
+				   ktime_ms_delta(ktime_get(), vm->resize_start));
+			WRITE_ONCE(vm->resizing, false);
+		}
 		break;
 	case -ENOSPC:
 		/*
@@ -2918,6 +3115,81 @@ static int virtio_mem_restore(struct virtio_device *vdev)
 }
 #endif
 
+static ssize_t plugged_size_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%llu\n", READ_ONCE(vm->plugged_size));
+}
+static DEVICE_ATTR_RO(plugged_size);
+
+static ssize_t requested_size_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%llu\n", READ_ONCE(vm->requested_size));
+}
+static DEVICE_ATTR_RO(requested_size);
+
+static ssize_t resizing_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(vm->resizing));
+}
+static DEVICE_ATTR_RO(resizing);
+
+static ssize_t last_resize_ms_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%lld\n", READ_ONCE(vm->last_resize_ms));
+}
+static DEVICE_ATTR_RO(last_resize_ms);
+
+static ssize_t last_error_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(vm->last_rc));
+}
+static DEVICE_ATTR_RO(last_error);
+
+static ssize_t plug_requests_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%lu\n", READ_ONCE(vm->plug_requests));
+}
+static DEVICE_ATTR_RO(plug_requests);
+
+static ssize_t unplug_requests_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct virtio_mem *vm = dev_to_virtio(dev)->priv;
+
+	return sysfs_emit(buf, "%lu\n", READ_ONCE(vm->unplug_requests));
+}
+static DEVICE_ATTR_RO(unplug_requests);
+
+static struct attribute *virtio_mem_attrs[] = {
+	&dev_attr_plugged_size.attr,
+	&dev_attr_requested_size.attr,
+	&dev_attr_resizing.attr,
+	&dev_attr_last_resize_ms.attr,
+	&dev_attr_last_error.attr,
+	&dev_attr_plug_requests.attr,
+	&dev_attr_unplug_requests.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(virtio_mem);
+
 static unsigned int virtio_mem_features[] = {
 #if defined(CONFIG_NUMA) && defined(CONFIG_ACPI_NUMA)
 	VIRTIO_MEM_F_ACPI_PXM,
@@ -2935,6 +3207,7 @@ static struct virtio_driver virtio_mem_driver = {
 	.feature_table_size = ARRAY_SIZE(virtio_mem_features),
 	.driver.name = KBUILD_MODNAME,
 	.driver.owner = THIS_MODULE,
+	.driver.dev_groups = virtio_mem_groups,
 	.id_table = virtio_mem_id_table,
 	.probe = virtio_mem_probe,
 	.remove = virtio_mem_remove,
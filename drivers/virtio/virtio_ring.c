@@ -70,6 +70,7 @@
 struct vring_desc_state_split {
 	void *data;			/* Data for callback. */
 	struct vring_desc *indir_desc;	/* Indirect descriptor, if any. */
+	u32 total_in_len;		/* Device-writable length. */
 };
 
 struct vring_desc_state_packed {
@@ -103,6 +104,15 @@ struct vring_virtqueue_split {
 	struct vring_desc_state_split *desc_state;
 	struct vring_desc_extra *desc_extra;
 
+	/*
+	 * In order only: head of the oldest buffer not used yet, and the
+	 * used ring entry being consumed, which covers every buffer up to
+	 * the one with id batch_last_id (UINT_MAX if none is pending).
+	 */
+	u16 inorder_head;
+	u32 batch_last_id;
+	u32 batch_last_len;
+
 	/* DMA address and size information */
 	dma_addr_t queue_dma_addr;
 	size_t queue_size_in_bytes;
@@ -172,6 +182,9 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
+	/* Device uses buffers in the order they were made available */
+	bool in_order;
+
 	/* Head of free buffer list. */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
@@ -527,6 +540,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 	struct scatterlist *sg;
 	struct vring_desc *desc;
 	unsigned int i, n, avail, descs_used, prev, err_idx;
+	u32 total_in_len = 0;
 	int head;
 	bool indirect;
 
@@ -601,6 +615,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 			if (vring_mapping_error(vq, addr))
 				goto unmap_release;
 
+			total_in_len += sg->length;
 			prev = i;
 			/* Note that we trust indirect descriptor
 			 * table since it use stream DMA mapping.
@@ -648,6 +663,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 		vq->split.desc_state[head].indir_desc = desc;
 	else
 		vq->split.desc_state[head].indir_desc = ctx;
+	vq->split.desc_state[head].total_in_len = total_in_len;
 
 	/* Put entry in available array (but don't update avail->idx until they
 	 * do sync). */
@@ -747,8 +763,17 @@ static void detach_buf_split(struct vring_virtqueue *vq, unsigned int head,
 	}
 
 	vring_unmap_one_split(vq, i);
-	vq->split.desc_extra[i].next = vq->free_head;
-	vq->free_head = head;
+	if (vq->in_order) {
+		/*
+		 * Buffers come back in the order they were added, and the free
+		 * descriptors stay in ring order: they follow the last free one
+		 * already, and the next buffer starts right after them.
+		 */
+		vq->split.inorder_head = vq->split.desc_extra[i].next;
+	} else {
+		vq->split.desc_extra[i].next = vq->free_head;
+		vq->free_head = head;
+	}
 
 	/* Plus final descriptor */
 	vq->vq.num_free++;
@@ -810,10 +835,37 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	virtio_rmb(vq->weak_barriers);
 
 	last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
-	i = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].id);
-	*len = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].len);
+	if (vq->in_order) {
+		/*
+		 * The device may write one used entry for a batch of buffers,
+		 * with the id of the last one, and skip the ring entries of
+		 * the others: those have been filled up completely.
+		 */
+		if (vq->split.batch_last_id == UINT_MAX) {
+			vq->split.batch_last_id = virtio32_to_cpu(_vq->vdev,
+					vq->split.vring.used->ring[last_used].id);
+			vq->split.batch_last_len = virtio32_to_cpu(_vq->vdev,
+					vq->split.vring.used->ring[last_used].len);
+			if (unlikely(vq->split.batch_last_id >= vq->split.vring.num)) {
+				BAD_RING(vq, "id %u out of range\n",
+					 vq->split.batch_last_id);
+				return NULL;
+			}
+		}
+
+		i = vq->split.inorder_head;
+		if (i == vq->split.batch_last_id) {
+			*len = vq->split.batch_last_len;
+			vq->split.batch_last_id = UINT_MAX;
+		} else {
+			*len = vq->split.desc_state[i].total_in_len;
+		}
+	} else {
+		i = virtio32_to_cpu(_vq->vdev,
+				vq->split.vring.used->ring[last_used].id);
+		*len = virtio32_to_cpu(_vq->vdev,
+				vq->split.vring.used->ring[last_used].len);
+	}
 
 	if (unlikely(i >= vq->split.vring.num)) {
 		BAD_RING(vq, "id %u out of range\n", i);
@@ -994,6 +1046,12 @@ static void virtqueue_reinit_split(struct vring_virtqueue *vq)
 	virtqueue_init(vq, num);
 
 	virtqueue_vring_init_split(&vq->split, vq);
+
+	/* All descriptors are free again: restart from the table's start. */
+	if (vq->in_order)
+		vq->free_head = 0;
+	vq->split.inorder_head = vq->free_head;
+	vq->split.batch_last_id = UINT_MAX;
 }
 
 static void virtqueue_vring_attach_split(struct vring_virtqueue *vq,
@@ -1003,6 +1061,8 @@ static void virtqueue_vring_attach_split(struct vring_virtqueue *vq,
 
 	/* Put everything in free lists. */
 	vq->free_head = 0;
+	vq->split.inorder_head = 0;
+	vq->split.batch_last_id = UINT_MAX;
 }
 
 static int vring_alloc_state_extra_split(struct vring_virtqueue_split *vring_split)
@@ -2015,6 +2075,7 @@ static struct virtqueue *vring_create_virtqueue_packed(
 #endif
 	vq->packed_ring = true;
 	vq->use_dma_api = vring_use_dma_api(vdev);
+	vq->in_order = false;
 
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
@@ -2512,6 +2573,7 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -2718,6 +2780,15 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_ORDER_PLATFORM:
 			break;
+		case VIRTIO_F_IN_ORDER:
+			/*
+			 * Only implemented for split rings. Packed rings
+			 * already return a whole chain to the free list at
+			 * once, so in-order would buy them nothing there.
+			 */
+			if (__virtio_test_bit(vdev, VIRTIO_F_RING_PACKED))
+				__virtio_clear_bit(vdev, i);
+			break;
 		default:
 			/* We don't understand this bit. */
 			__virtio_clear_bit(vdev, i);
@@ -14,6 +14,7 @@
 #include <linux/slab.h>
 #include <linux/security.h>
 #include <linux/hash.h>
+#include <asm/sections.h>
 
 #include "kernfs-internal.h"
 
@@ -522,6 +523,24 @@ void kernfs_get(struct kernfs_node *kn)
 }
 EXPORT_SYMBOL_GPL(kernfs_get);
 
+/*
+ * RCU-walk path lookups and permission checks look at kernfs_nodes without
+ * holding a reference, so the node, its name and its iattrs are only freed
+ * after a grace period.
+ */
+static void kernfs_free_rcu(struct rcu_head *rcu)
+{
+	struct kernfs_node *kn = container_of(rcu, struct kernfs_node, rcu);
+
+	kfree_const(kn->name);
+
+	if (kn->iattr) {
+		simple_xattrs_free(&kn->iattr->xattrs);
+		kmem_cache_free(kernfs_iattrs_cache, kn->iattr);
+	}
+	kmem_cache_free(kernfs_node_cache, kn);
+}
+
 /**
  * kernfs_put - put a reference count on a kernfs_node
  * @kn: the target kernfs_node
@@ -550,16 +569,10 @@ void kernfs_put(struct kernfs_node *kn)
 	if (kernfs_type(kn) == KERNFS_LINK)
 		kernfs_put(kn->symlink.target_kn);
 
-	kfree_const(kn->name);
-
-	if (kn->iattr) {
-		simple_xattrs_free(&kn->iattr->xattrs);
-		kmem_cache_free(kernfs_iattrs_cache, kn->iattr);
-	}
 	spin_lock(&kernfs_idr_lock);
 	idr_remove(&root->ino_idr, (u32)kernfs_ino(kn));
 	spin_unlock(&kernfs_idr_lock);
-	kmem_cache_free(kernfs_node_cache, kn);
+	call_rcu(&kn->rcu, kernfs_free_rcu);
 
 	kn = parent;
 	if (kn) {
@@ -1069,13 +1082,46 @@ struct kernfs_node *kernfs_create_empty_dir(struct kernfs_node *parent,
 	return ERR_PTR(rc);
 }
 
+/*
+ * RCU-walk variant of kernfs_dop_revalidate().  Only positive dentries whose
+ * node is still active, parented and named as the dentry says are accepted;
+ * anything else drops to ref-walk, which rechecks under kernfs_rwsem.  Any
+ * concurrent rename or removal is caught by the VFS d_seq validation.
+ */
+static int kernfs_dop_revalidate_rcu(struct dentry *dentry)
+{
+	struct kernfs_node *kn;
+	struct inode *inode, *dir;
+
+	inode = d_inode_rcu(dentry);
+	if (!inode)
+		return -ECHILD;
+	kn = inode->i_private;
+
+	dir = d_inode_rcu(READ_ONCE(dentry->d_parent));
+	if (!dir || dir->i_private != READ_ONCE(kn->parent))
+		return -ECHILD;
+
+	if (!__kernfs_active(kn))
+		return -ECHILD;
+
+	if (strcmp(dentry->d_name.name, READ_ONCE(kn->name)) != 0)
+		return -ECHILD;
+
+	if (kernfs_ns_enabled(dir->i_private) &&
+	    kernfs_info(dentry->d_sb)->ns != READ_ONCE(kn->ns))
+		return -ECHILD;
+
+	return 1;
+}
+
 static int kernfs_dop_revalidate(struct dentry *dentry, unsigned int flags)
 {
 	struct kernfs_node *kn;
 	struct kernfs_root *root;
 
 	if (flags & LOOKUP_RCU)
-		return -ECHILD;
+		return kernfs_dop_revalidate_rcu(dentry);
 
 	/* Negative hashed dentry? */
 	if (d_really_is_negative(dentry)) {
@@ -1715,7 +1761,9 @@ int kernfs_rename_ns(struct kernfs_node *kn, struct kernfs_node *new_parent,
 	kernfs_link_sibling(kn);
 
 	kernfs_put(old_parent);
-	kfree_const(old_name);
+	/* RCU-walk in kernfs_dop_revalidate_rcu() may still be looking at it */
+	if (old_name && !is_kernel_rodata((unsigned long)old_name))
+		kvfree_rcu((void *)old_name);
 
 	error = 0;
  out:
@@ -274,6 +274,26 @@ void kernfs_evict_inode(struct inode *inode)
 	kernfs_put(kn);
 }
 
+/*
+ * Whether @inode already carries the permission relevant attributes of @kn,
+ * i.e. kernfs_refresh_inode() would not change the outcome of
+ * generic_permission().  Called under RCU without kernfs_rwsem.
+ */
+static bool kernfs_inode_perm_current(struct kernfs_node *kn,
+				      struct inode *inode)
+{
+	struct kernfs_iattrs *attrs = READ_ONCE(kn->iattr);
+
+	if (inode->i_mode != READ_ONCE(kn->mode))
+		return false;
+
+	if (attrs && (!uid_eq(inode->i_uid, attrs->ia_uid) ||
+		      !gid_eq(inode->i_gid, attrs->ia_gid)))
+		return false;
+
+	return true;
+}
+
 int kernfs_iop_permission(struct user_namespace *mnt_userns,
 			  struct inode *inode, int mask)
 {
@@ -281,10 +301,19 @@ int kernfs_iop_permission(struct user_namespace *mnt_userns,
 	struct kernfs_root *root;
 	int ret;
 
-	if (mask & MAY_NOT_BLOCK)
-		return -ECHILD;
-
 	kn = inode->i_private;
+
+	/*
+	 * Stay in RCU-walk as long as the inode is up to date, so that
+	 * walking deep sysfs paths doesn't bounce kernfs_rwsem for every
+	 * component.
+	 */
+	if (mask & MAY_NOT_BLOCK) {
+		if (!kernfs_inode_perm_current(kn, inode))
+			return -ECHILD;
+		return generic_permission(&init_user_ns, inode, mask);
+	}
+
 	root = kernfs_root(kn);
 
 	down_read(&root->kernfs_rwsem);
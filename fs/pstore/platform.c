@@ -202,10 +202,20 @@ static int zbufsize_lzo(size_t size)
 }
 #endif
 
+/*
+ * The compression buffer holds the uncompressed kmsg text that must then
+ * fit into the backend record once compressed, so it is sized by the ratio
+ * the algorithm typically achieves on kernel log text. The fast algorithms
+ * used to size it by their worst-case output bound, which left the dump
+ * with barely more history than an uncompressed one. If the text turns out
+ * to compress worse than expected, pstore_dump() falls back to storing the
+ * most recent uncompressed part.
+ */
 #if IS_ENABLED(CONFIG_PSTORE_LZ4_COMPRESS) || IS_ENABLED(CONFIG_PSTORE_LZ4HC_COMPRESS)
 static int zbufsize_lz4(size_t size)
 {
-	return LZ4_compressBound(size);
+	/* LZ4 typically gets kernel log text down to about half. */
+	return max_t(size_t, LZ4_compressBound(size), (size * 100) / 50);
 }
 #endif
 
@@ -219,7 +229,8 @@ static int zbufsize_842(size_t size)
 #if IS_ENABLED(CONFIG_PSTORE_ZSTD_COMPRESS)
 static int zbufsize_zstd(size_t size)
 {
-	return zstd_compress_bound(size);
+	/* zstd typically gets kernel log text down to about a third. */
+	return max_t(size_t, zstd_compress_bound(size), (size * 100) / 35);
 }
 #endif
 
@@ -49,50 +49,89 @@ static inline size_t buffer_start(struct persistent_ram_zone *prz)
 	return atomic_read(&prz->buffer->start);
 }
 
+/*
+ * Space in the buffer is reserved against the shadow counters in @prz, which
+ * live in normal kernel memory, so that concurrent writers can use atomic
+ * read-modify-write operations even when @prz->buffer is mapped as I/O or
+ * write-combined memory where such operations are not allowed. The header
+ * only ever gets plain stores of the *current* shadow value. A writer that
+ * raced with another may have stored a stale value, so after its store it
+ * reads the shadow again and repeats the store until the two agree. The
+ * last update of a shadow counter is therefore always the one left in the
+ * header, without any lock. Zones flagged PRZ_FLAG_NO_LOCK only ever have
+ * a single writer and skip both the cmpxchg loop and the re-check.
+ */
+
+static void notrace buffer_publish(struct persistent_ram_zone *prz,
+				   atomic_t *shadow, atomic_t *header)
+{
+	int val = atomic_read(shadow);
+
+	if (prz->flags & PRZ_FLAG_NO_LOCK) {
+		atomic_set(header, val);
+		return;
+	}
+
+	for (;;) {
+		int cur;
+
+		atomic_set(header, val);
+		/*
+		 * Pairs with the full barrier of the shadow cmpxchg: if a
+		 * newer value was stored before ours, its shadow update is
+		 * visible here and we store it again.
+		 */
+		smp_mb();
+		cur = atomic_read(shadow);
+		if (likely(cur == val))
+			break;
+		val = cur;
+	}
+}
+
 /* increase and wrap the start pointer, returning the old value */
-static size_t buffer_start_add(struct persistent_ram_zone *prz, size_t a)
+static size_t notrace buffer_start_add(struct persistent_ram_zone *prz, size_t a)
 {
 	int old;
 	int new;
-	unsigned long flags = 0;
-
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
 
-	old = atomic_read(&prz->buffer->start);
-	new = old + a;
-	while (unlikely(new >= prz->buffer_size))
-		new -= prz->buffer_size;
-	atomic_set(&prz->buffer->start, new);
+	old = atomic_read(&prz->shadow_start);
+	do {
+		new = old + a;
+		while (unlikely(new >= prz->buffer_size))
+			new -= prz->buffer_size;
+		if (prz->flags & PRZ_FLAG_NO_LOCK) {
+			atomic_set(&prz->shadow_start, new);
+			break;
+		}
+	} while (!atomic_try_cmpxchg(&prz->shadow_start, &old, new));
 
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+	buffer_publish(prz, &prz->shadow_start, &prz->buffer->start);
 
 	return old;
 }
 
 /* increase the size counter until it hits the max size */
-static void buffer_size_add(struct persistent_ram_zone *prz, size_t a)
+static void notrace buffer_size_add(struct persistent_ram_zone *prz, size_t a)
 {
-	size_t old;
-	size_t new;
-	unsigned long flags = 0;
-
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
-
-	old = atomic_read(&prz->buffer->size);
-	if (old == prz->buffer_size)
-		goto exit;
+	int old;
+	int new;
 
-	new = old + a;
-	if (new > prz->buffer_size)
-		new = prz->buffer_size;
-	atomic_set(&prz->buffer->size, new);
+	old = atomic_read(&prz->shadow_size);
+	do {
+		if (old == prz->buffer_size)
+			return;
+
+		new = old + a;
+		if (new > prz->buffer_size)
+			new = prz->buffer_size;
+		if (prz->flags & PRZ_FLAG_NO_LOCK) {
+			atomic_set(&prz->shadow_size, new);
+			break;
+		}
+	} while (!atomic_try_cmpxchg(&prz->shadow_size, &old, new));
 
-exit:
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+	buffer_publish(prz, &prz->shadow_size, &prz->buffer->size);
 }
 
 static void notrace persistent_ram_encode_rs8(struct persistent_ram_zone *prz,
@@ -391,6 +430,8 @@ void persistent_ram_free_old(struct persistent_ram_zone *prz)
 
 void persistent_ram_zap(struct persistent_ram_zone *prz)
 {
+	atomic_set(&prz->shadow_start, 0);
+	atomic_set(&prz->shadow_size, 0);
 	atomic_set(&prz->buffer->start, 0);
 	atomic_set(&prz->buffer->size, 0);
 	persistent_ram_update_header_ecc(prz);
@@ -528,6 +569,9 @@ static int persistent_ram_post_init(struct persistent_ram_zone *prz, u32 sig,
 			pr_debug("found existing buffer, size %zu, start %zu\n",
 				 buffer_size(prz), buffer_start(prz));
 			persistent_ram_save_old(prz);
+			/* Keep appending after the recovered contents. */
+			atomic_set(&prz->shadow_start, buffer_start(prz));
+			atomic_set(&prz->shadow_size, buffer_size(prz));
 		}
 	} else {
 		pr_debug("no valid data in buffer (sig = 0x%08x)\n",
@@ -584,7 +628,6 @@ struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
 	}
 
 	/* Initialize general buffer state. */
-	raw_spin_lock_init(&prz->buffer_lock);
 	prz->flags = flags;
 	prz->label = kstrdup(label, GFP_KERNEL);
 
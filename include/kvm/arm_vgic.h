@@ -130,6 +130,8 @@ struct vgic_irq {
 					 * affinity reg (v3).
 					 */
 
+	struct rcu_head rcu;		/* LPIs are freed after a grace period */
+
 	u32 intid;			/* Guest visible INTID */
 	bool line_level;		/* Level only */
 	bool pending_latch;		/* The pending latch state used to calculate
@@ -221,6 +223,11 @@ struct vgic_redist_region {
 	struct list_head list;
 };
 
+struct vgic_lpi_cache_stats {
+	u64			hits;
+	u64			misses;
+};
+
 struct vgic_dist {
 	bool			in_kernel;
 	bool			ready;
@@ -241,6 +248,12 @@ struct vgic_dist {
 	/* Do injected MSIs require an additional device ID? */
 	bool			msis_require_devid;
 
+	/*
+	 * The ITS or pending tables are being saved to guest memory, with no
+	 * vCPU running to take the dirty pages on its dirty ring.
+	 */
+	bool			table_write_in_progress;
+
 	int			nr_spis;
 
 	/* base addresses in guest physical address space: */
@@ -277,8 +290,16 @@ struct vgic_dist {
 	struct list_head	lpi_list_head;
 	int			lpi_list_count;
 
-	/* LPI translation cache */
-	struct list_head	lpi_translation_cache;
+	/*
+	 * LPI translation cache: hash table walked under RCU by the MSI
+	 * injection path, modified with lpi_list_lock held. The LRU list
+	 * keeps the entries in insertion order for eviction.
+	 */
+	struct hlist_head	*lpi_translation_cache;
+	struct list_head	lpi_translation_cache_lru;
+	unsigned int		lpi_translation_cache_count;
+	atomic_t		lpi_translation_cache_devices;
+	struct vgic_lpi_cache_stats __percpu *lpi_translation_cache_stats;
 
 	/* used by vgic-debug */
 	struct vgic_state_iter *iter;
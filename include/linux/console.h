@@ -15,6 +15,7 @@
 #define _LINUX_CONSOLE_H_ 1
 
 #include <linux/atomic.h>
+#include <linux/mutex.h>
 #include <linux/types.h>
 
 struct vc_data;
@@ -23,6 +24,7 @@ struct console_font;
 struct module;
 struct tty_struct;
 struct notifier_block;
+struct task_struct;
 
 enum con_scroll {
 	SM_UP,
@@ -153,6 +155,11 @@ struct console {
 	uint	ospeed;
 	u64	seq;
 	unsigned long dropped;
+	unsigned long dropped_total;	/* records lost before printing */
+	struct task_struct *thread;	/* printing kthread, if any */
+	bool	blocked;		/* kthread held off by console_lock() */
+	/* Serializes the printing kthread with console_lock() */
+	struct mutex lock;
 	void	*data;
 	struct	 console *next;
 };
@@ -8,7 +8,9 @@
 #ifndef _DAMON_H_
 #define _DAMON_H_
 
+#include <linux/cpumask.h>
 #include <linux/mutex.h>
+#include <linux/numa.h>
 #include <linux/time64.h>
 #include <linux/types.h>
 #include <linux/random.h>
@@ -88,6 +90,8 @@ struct damon_target {
  * @DAMOS_NOHUGEPAGE:	Call ``madvise()`` for the region with MADV_NOHUGEPAGE.
  * @DAMOS_LRU_PRIO:	Prioritize the region on its LRU lists.
  * @DAMOS_LRU_DEPRIO:	Deprioritize the region on its LRU lists.
+ * @DAMOS_MIGRATE_HOT:	Migrate the region to &damos->target_nid.
+ * @DAMOS_MIGRATE_COLD:	Migrate the region to &damos->target_nid.
  * @DAMOS_STAT:		Do nothing but count the stat.
  * @NR_DAMOS_ACTIONS:	Total number of DAMOS actions
  */
@@ -99,6 +103,8 @@ enum damos_action {
 	DAMOS_NOHUGEPAGE,
 	DAMOS_LRU_PRIO,
 	DAMOS_LRU_DEPRIO,
+	DAMOS_MIGRATE_HOT,
+	DAMOS_MIGRATE_COLD,
 	DAMOS_STAT,		/* Do nothing but only record the stat */
 	NR_DAMOS_ACTIONS,
 };
@@ -239,6 +245,7 @@ struct damos_access_pattern {
  * @action:		&damo_action to be applied to the target regions.
  * @quota:		Control the aggressiveness of this scheme.
  * @wmarks:		Watermarks for automated (in)activation of this scheme.
+ * @target_nid:		Destination node of the migrate actions.
  * @stat:		Statistics of this scheme.
  * @list:		List head for siblings.
  *
@@ -257,12 +264,20 @@ struct damos_access_pattern {
  * After applying the &action to each region, &stat_count and &stat_sz is
  * updated to reflect the number of regions and total size of regions that the
  * &action is applied.
+ *
+ * &DAMOS_MIGRATE_HOT and &DAMOS_MIGRATE_COLD move the pages of the regions to
+ * &target_nid.  They differ only in how regions are prioritized under the
+ * &quota: hot regions first for the former, cold ones first for the latter.
+ * Pages that are already on &target_nid are left alone, and only the bytes
+ * that were actually migrated are accounted in &stat.sz_applied.  The actions
+ * do nothing while &target_nid is %NUMA_NO_NODE.
  */
 struct damos {
 	struct damos_access_pattern pattern;
 	enum damos_action action;
 	struct damos_quota quota;
 	struct damos_watermarks wmarks;
+	int target_nid;
 	struct damos_stat stat;
 	struct list_head list;
 };
@@ -284,6 +299,7 @@ enum damon_ops_id {
 };
 
 struct damon_ctx;
+struct damon_worker;
 
 /**
  * struct damon_operations - Monitoring operations for given use cases.
@@ -293,6 +309,8 @@ struct damon_ctx;
  * @update:			Update operations-related data structures.
  * @prepare_access_checks:	Prepare next access check of target regions.
  * @check_accesses:		Check the accesses to target regions.
+ * @prepare_target_access_checks: Prepare next access check of a target.
+ * @check_target_accesses:	Check the accesses to the regions of a target.
  * @reset_aggregated:		Reset aggregated accesses monitoring results.
  * @get_scheme_score:		Get the score of a region for a scheme.
  * @apply_scheme:		Apply a DAMON-based operation scheme.
@@ -321,6 +339,11 @@ struct damon_ctx;
  * last preparation and update the number of observed accesses of each region.
  * It should also return max number of observed accesses that made as a result
  * of its update.  The value will be used for regions adjustment threshold.
+ * @prepare_target_access_checks and @check_target_accesses are optional and do
+ * the same for a single target.  If both are set, they are used instead of
+ * @prepare_access_checks and @check_accesses when the targets of a context are
+ * spread over worker threads (&damon_ctx.worker_cpus).  They can be called for
+ * different targets of the same context concurrently.
  * @reset_aggregated should reset the access monitoring results that aggregated
  * by @check_accesses.
  * @get_scheme_score should return the priority score of a region for a scheme
@@ -339,6 +362,10 @@ struct damon_operations {
 	void (*update)(struct damon_ctx *context);
 	void (*prepare_access_checks)(struct damon_ctx *context);
 	unsigned int (*check_accesses)(struct damon_ctx *context);
+	void (*prepare_target_access_checks)(struct damon_ctx *context,
+			struct damon_target *t);
+	unsigned int (*check_target_accesses)(struct damon_ctx *context,
+			struct damon_target *t);
 	void (*reset_aggregated)(struct damon_ctx *context);
 	int (*get_scheme_score)(struct damon_ctx *context,
 			struct damon_target *t, struct damon_region *r,
@@ -445,6 +472,18 @@ struct damon_attrs {
  *
  * @adaptive_targets:	Head of monitoring targets (&damon_target) list.
  * @schemes:		Head of schemes (&damos) list.
+ *
+ * @worker_cpus:	CPUs to check the accesses of the targets on.
+ * @aggr_cpu_ns:	CPU time the monitoring took in the last aggregation
+ *			interval, in nanoseconds.
+ * @total_cpu_ns:	CPU time the monitoring took since it started.
+ *
+ * If @worker_cpus is not empty when the monitoring starts and @ops supports
+ * per-target access checks, @kdamond spreads the targets over one work item
+ * per CPU of @worker_cpus, queued on that CPU, and waits for them in every
+ * sampling interval.  Otherwise @kdamond checks all targets itself.
+ * @aggr_cpu_ns and @total_cpu_ns account @kdamond and the workers together
+ * and are updated by @kdamond after each aggregation.
  */
 struct damon_ctx {
 	struct damon_attrs attrs;
@@ -452,6 +491,10 @@ struct damon_ctx {
 /* private: internal use only */
 	struct timespec64 last_aggregation;
 	struct timespec64 last_ops_update;
+	struct damon_worker *workers;
+	unsigned int nr_workers;
+	struct workqueue_struct *workers_wq;
+	u64 last_cpu_ns;
 
 /* public: */
 	struct task_struct *kdamond;
@@ -462,6 +505,10 @@ struct damon_ctx {
 
 	struct list_head adaptive_targets;
 	struct list_head schemes;
+
+	cpumask_var_t worker_cpus;
+	u64 aggr_cpu_ns;
+	u64 total_cpu_ns;
 };
 
 static inline struct damon_region *damon_next_region(struct damon_region *r)
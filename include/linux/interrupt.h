@@ -812,6 +812,15 @@ static inline void init_irq_proc(void)
 void irq_timings_enable(void);
 void irq_timings_disable(void);
 u64 irq_timings_next_event(u64 now);
+u64 irq_timings_next_irq_event(unsigned int irq, u64 now);
+u64 irq_timings_predict_ns(unsigned int irq, u64 max_ns);
+#else
+static inline void irq_timings_enable(void) { }
+static inline void irq_timings_disable(void) { }
+static inline u64 irq_timings_predict_ns(unsigned int irq, u64 max_ns)
+{
+	return 0;
+}
 #endif
 
 struct seq_file;
@@ -51,6 +51,10 @@ struct pt_regs;
  * @dir:		/proc/irq/ procfs entry
  * @debugfs_file:	dentry for the debugfs file
  * @name:		flow handler name for /proc/interrupts output
+ * @balance_last_count: interrupt count at the last balancer sample
+ * @balance_rate:	interrupts per second seen by the last balancer sample
+ * @balance_moved:	jiffies of the last balancer move, 0 if never moved
+ * @balance_cpu:	CPU the balancer moved the interrupt to, -1 if none
  */
 struct irq_desc {
 	struct irq_common_data	irq_common_data;
@@ -94,6 +98,12 @@ struct irq_desc {
 	struct dentry		*debugfs_file;
 	const char		*dev_name;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_last_count;
+	unsigned int		balance_rate;
+	unsigned long		balance_moved;
+	int			balance_cpu;
+#endif
 #ifdef CONFIG_SPARSE_IRQ
 	struct rcu_head		rcu;
 	struct kobject		kobj;
@@ -15,6 +15,7 @@
 #ifdef CONFIG_KFENCE
 
 #include <linux/atomic.h>
+#include <linux/percpu.h>
 #include <linux/static_key.h>
 
 extern unsigned long kfence_sample_interval;
@@ -29,6 +30,8 @@ extern char *__kfence_pool;
 
 DECLARE_STATIC_KEY_FALSE(kfence_allocation_key);
 extern atomic_t kfence_allocation_gate;
+DECLARE_STATIC_KEY_FALSE(kfence_percpu_key);
+DECLARE_PER_CPU(int, kfence_cpu_gate);
 
 /**
  * is_kfence_address() - check if an address belongs to KFENCE pool
@@ -112,7 +115,8 @@ void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags);
  * kfence_alloc() should be inserted into the heap allocation fast path,
  * allowing it to transparently return KFENCE-allocated objects with a low
  * probability using a static branch (the probability is controlled by the
- * kfence.sample_interval boot parameter).
+ * kfence.sample_interval boot parameter). With kfence.percpu, the gate checked
+ * is the current CPU's, which avoids reading a shared cache line here.
  */
 static __always_inline void *kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 {
@@ -123,8 +127,12 @@ static __always_inline void *kfence_alloc(struct kmem_cache *s, size_t size, gfp
 	if (!static_branch_likely(&kfence_allocation_key))
 		return NULL;
 #endif
-	if (likely(atomic_read(&kfence_allocation_gate)))
+	if (static_branch_unlikely(&kfence_percpu_key)) {
+		if (likely(raw_cpu_read(kfence_cpu_gate)))
+			return NULL;
+	} else if (likely(atomic_read(&kfence_allocation_gate))) {
 		return NULL;
+	}
 	return __kfence_alloc(s, size, flags);
 }
 
@@ -747,7 +747,12 @@ struct kvm {
 	refcount_t users_count;
 #ifdef CONFIG_KVM_MMIO
 	struct kvm_coalesced_mmio_ring *coalesced_mmio_ring;
-	spinlock_t ring_lock;
+	/*
+	 * Producer side of the ring, kept out of the shared page: the next
+	 * slot to hand out and the next slot to become visible to userspace.
+	 */
+	atomic_t coalesced_mmio_reserved;
+	atomic_t coalesced_mmio_published;
 	struct list_head coalesced_zones;
 #endif
 
@@ -869,6 +874,26 @@ static inline bool kvm_dirty_log_manual_protect_and_init_set(struct kvm *kvm)
 	return !!(kvm->manual_dirty_log_protect & KVM_DIRTY_LOG_INITIALLY_SET);
 }
 
+/*
+ * Whether memslots track dirty pages in a bitmap. With the dirty ring, only
+ * the writes KVM makes without a running vCPU end up there, and userspace
+ * collects them with KVM_GET_DIRTY_LOG after harvesting the rings.
+ */
+static inline bool kvm_use_dirty_bitmap(struct kvm *kvm)
+{
+	return !kvm->dirty_ring_size ||
+	       IS_ENABLED(CONFIG_NEED_KVM_DIRTY_RING_WITH_BITMAP);
+}
+
+#ifdef CONFIG_NEED_KVM_DIRTY_RING_WITH_BITMAP
+bool kvm_arch_allow_write_without_running_vcpu(struct kvm *kvm);
+#else
+static inline bool kvm_arch_allow_write_without_running_vcpu(struct kvm *kvm)
+{
+	return false;
+}
+#endif
+
 static inline struct kvm_io_bus *kvm_get_bus(struct kvm *kvm, enum kvm_bus idx)
 {
 	return srcu_dereference_check(kvm->buses[idx], &kvm->srcu,
@@ -292,6 +292,18 @@ int LZ4_decompress_fast(const char *source, char *dest, int originalSize);
 int LZ4_decompress_safe(const char *source, char *dest, int compressedSize,
 	int maxDecompressedSize);
 
+/**
+ * LZ4_set_arch_decompress_safe() - Install an architecture optimised decoder
+ * @fn: replacement for the generic LZ4_decompress_safe() decoder, or NULL
+ *	to go back to the generic one
+ *
+ * @fn must have the exact semantics of LZ4_decompress_safe(). It is only
+ * called when may_use_simd() is true, so it is free to use the SIMD unit.
+ * The caller must make sure @fn stays valid for the lifetime of the kernel.
+ */
+void LZ4_set_arch_decompress_safe(int (*fn)(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize));
+
 /**
  * LZ4_decompress_safe_partial() - Decompress a block of size 'compressedSize'
  *	at position 'source' into buffer 'dest'
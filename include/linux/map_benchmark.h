@@ -10,11 +10,19 @@
 #define DMA_MAP_MAX_THREADS     1024
 #define DMA_MAP_MAX_SECONDS     300
 #define DMA_MAP_MAX_TRANS_DELAY (10 * NSEC_PER_MSEC)
+#define DMA_MAP_MAX_NENTS       1024
+#define DMA_MAP_MAX_DEFER       1024
+#define DMA_MAP_MAX_PAGES       65536 /* per thread: granule * nents * defer */
 
 #define DMA_MAP_BIDIRECTIONAL   0
 #define DMA_MAP_TO_DEVICE       1
 #define DMA_MAP_FROM_DEVICE     2
 
+#define DMA_MAP_MODE_SINGLE     0 /* dma_map_single / dma_unmap_single */
+#define DMA_MAP_MODE_SG         1 /* dma_map_sg / dma_unmap_sg */
+#define DMA_MAP_MODE_ALLOC      2 /* dma_alloc_coherent / dma_free_coherent */
+#define DMA_MAP_MODE_SYNC       3 /* dma_sync_single_for_device / _for_cpu */
+
 struct map_benchmark {
 	__u64 avg_map_100ns; /* average map latency in 100ns */
 	__u64 map_stddev; /* standard deviation of map latency */
@@ -27,5 +35,18 @@ struct map_benchmark {
 	__u32 dma_dir; /* DMA data direction */
 	__u32 dma_trans_ns; /* time for DMA transmission in ns */
 	__u32 granule;  /* how many PAGE_SIZE will do map/unmap once a time */
+	__u32 pad0; /* trailing padding of the original struct, ignored */
+	/* fields below are zero when called with the original struct size */
+	__u32 mode; /* which DMA API calls to time, DMA_MAP_MODE_* */
+	__u32 nents; /* scatterlist entries of granule pages in SG mode */
+	__u32 defer_unmap; /* unmap in batches of this many mappings */
+	__u32 pad1; /* must be zero */
+	__u64 loops; /* number of map (and unmap) operations timed */
+	__u64 map_p50_ns; /* map latency percentiles in ns */
+	__u64 map_p99_ns;
+	__u64 map_p999_ns;
+	__u64 unmap_p50_ns; /* as above */
+	__u64 unmap_p99_ns;
+	__u64 unmap_p999_ns;
 };
 #endif /* _KERNEL_DMA_BENCHMARK_H */
@@ -404,6 +404,11 @@ struct module {
 	const s32 *gpl_crcs;
 	bool using_gplonly_symbols;
 
+#ifdef CONFIG_MODULE_SYMBOL_HASH
+	/* Entries of syms and gpl_syms in the exported symbol hash */
+	struct mod_symhash *symhash;
+#endif
+
 #ifdef CONFIG_MODULE_SIG
 	/* Signature was verified. */
 	bool sig_ok;
@@ -17,9 +17,10 @@
 #include <linux/types.h>
 
 /*
- * Choose whether access to the RAM zone requires locking or not.  If a zone
- * can be written to from different CPUs like with ftrace for example, then
- * PRZ_FLAG_NO_LOCK is used. For all other cases, locking is required.
+ * Choose whether space in the RAM zone must be reserved atomically or not.
+ * If a zone is only ever written to from a single CPU, like the per-CPU
+ * ftrace zones, then PRZ_FLAG_NO_LOCK is used. For all other cases, writers
+ * reserve space with a cmpxchg loop on the zone's start and size counters.
  */
 #define PRZ_FLAG_NO_LOCK	BIT(0)
 /*
@@ -49,8 +50,10 @@ struct persistent_ram_ecc_info {
  * @type:	frontend type for this PRZ
  * @flags:	holds PRZ_FLAGS_* bits
  *
- * @buffer_lock:
- *	locks access to @buffer "size" bytes and "start" offset
+ * @shadow_start:
+ *	copy of @buffer "start" offset kept in normal memory for atomic updates
+ * @shadow_size:
+ *	copy of @buffer "size" bytes kept in normal memory for atomic updates
  * @buffer:
  *	pointer to actual RAM area managed by this PRZ
  * @buffer_size:
@@ -84,7 +87,8 @@ struct persistent_ram_zone {
 	enum pstore_type_id type;
 	u32 flags;
 
-	raw_spinlock_t buffer_lock;
+	atomic_t shadow_start;
+	atomic_t shadow_size;
 	struct persistent_ram_buffer *buffer;
 	size_t buffer_size;
 
@@ -10,6 +10,9 @@
 #define VIRTIO_VSOCK_DEFAULT_RX_BUF_SIZE	(1024 * 4)
 #define VIRTIO_VSOCK_MAX_BUF_SIZE		0xFFFFFFFFUL
 #define VIRTIO_VSOCK_MAX_PKT_BUF_SIZE		(1024 * 64)
+/* Pages a MSG_ZEROCOPY packet payload may span */
+#define VIRTIO_VSOCK_MAX_PKT_PAGES \
+	(VIRTIO_VSOCK_MAX_PKT_BUF_SIZE / PAGE_SIZE + 1)
 
 enum {
 	VSOCK_VQ_RX     = 0, /* for host to guest data */
@@ -50,6 +53,10 @@ struct virtio_vsock_pkt {
 	u32 off;
 	bool reply;
 	bool tap_delivered;
+	/* MSG_ZEROCOPY: payload in pinned user pages instead of buf */
+	struct bio_vec *bvec;
+	u32 nr_bvec;
+	struct ubuf_info *uarg;
 };
 
 struct virtio_vsock_pkt_info {
@@ -61,6 +68,7 @@ struct virtio_vsock_pkt_info {
 	u16 op;
 	u32 flags;
 	bool reply;
+	struct ubuf_info *uarg;
 };
 
 struct virtio_transport {
@@ -69,6 +77,9 @@ struct virtio_transport {
 
 	/* Takes ownership of the packet */
 	int (*send_pkt)(struct virtio_vsock_pkt *pkt);
+
+	/* Can send packets whose payload is made of @bufs_num pages (pkt->bvec) */
+	bool (*can_msgzerocopy)(int bufs_num);
 };
 
 ssize_t
@@ -126,6 +137,7 @@ void virtio_transport_notify_buffer_size(struct vsock_sock *vsk, u64 *val);
 u64 virtio_transport_stream_rcvhiwat(struct vsock_sock *vsk);
 bool virtio_transport_stream_is_active(struct vsock_sock *vsk);
 bool virtio_transport_stream_allow(u32 cid, u32 port);
+bool virtio_transport_msgzerocopy_allow(const struct vsock_transport *t);
 int virtio_transport_dgram_bind(struct vsock_sock *vsk,
 				struct sockaddr_vm *addr);
 bool virtio_transport_dgram_allow(u32 cid, u32 port);
@@ -150,6 +162,8 @@ void virtio_transport_destruct(struct vsock_sock *vsk);
 
 void virtio_transport_recv_pkt(struct virtio_transport *t,
 			       struct virtio_vsock_pkt *pkt);
+void virtio_transport_recv_pkts(struct virtio_transport *t,
+				struct list_head *pkts);
 void virtio_transport_free_pkt(struct virtio_vsock_pkt *pkt);
 void virtio_transport_inc_tx_pkt(struct virtio_vsock_sock *vvs, struct virtio_vsock_pkt *pkt);
 u32 virtio_transport_get_credit(struct virtio_vsock_sock *vvs, u32 wanted);
@@ -444,4 +444,97 @@ typedef ZSTD_frameHeader zstd_frame_header;
 size_t zstd_get_frame_header(zstd_frame_header *params, const void *src,
 	size_t src_size);
 
+/* ======   Parallel Compression and Decompression   ====== */
+
+typedef struct zstd_parallel_cctx_s zstd_parallel_cctx;
+
+/**
+ * zstd_alloc_parallel_cctx() - allocate a parallel compression context
+ * @level:      The compression level, see zstd_get_params().
+ * @chunk_size: The input is cut into independent frames of this many bytes.
+ *              Larger chunks compress better, smaller ones spread over more
+ *              CPUs.
+ * @nr_workers: The maximum number of chunks compressed concurrently, or 0 for
+ *              the number of online CPUs.
+ *
+ * Unlike the single-pass API the context allocates its own workspaces, one
+ * per worker, sized for @chunk_size at @level. The context may not be used
+ * by several callers at once.
+ *
+ * Return:      The context or NULL on allocation failure.
+ */
+zstd_parallel_cctx *zstd_alloc_parallel_cctx(int level, size_t chunk_size,
+	unsigned int nr_workers);
+
+/**
+ * zstd_free_parallel_cctx() - free a parallel compression context
+ * @pctx: The context to free, may be NULL.
+ */
+void zstd_free_parallel_cctx(zstd_parallel_cctx *pctx);
+
+/**
+ * zstd_parallel_compress_bound() - maximum output of zstd_parallel_compress()
+ * @pctx:     The parallel compression context.
+ * @src_size: The size of the data to compress.
+ *
+ * Return:    The maximum compressed size in the worst case scenario.
+ */
+size_t zstd_parallel_compress_bound(const zstd_parallel_cctx *pctx,
+	size_t src_size);
+
+/**
+ * zstd_parallel_compress() - compress src into dst using several CPUs
+ * @pctx:         The parallel compression context.
+ * @dst:          The buffer to compress src into.
+ * @dst_capacity: The size of the destination buffer. May be any size, but
+ *                zstd_parallel_compress_bound() is guaranteed to be large
+ *                enough.
+ * @src:          The data to compress.
+ * @src_size:     The size of the data to compress.
+ *
+ * The output is a sequence of concatenated frames that record their content
+ * size, decodable by zstd_decompress_dctx() or zstd_parallel_decompress().
+ * The call sleeps until all frames are written.
+ *
+ * Return:        The compressed size or an error, which can be checked using
+ *                zstd_is_error().
+ */
+size_t zstd_parallel_compress(zstd_parallel_cctx *pctx, void *dst,
+	size_t dst_capacity, const void *src, size_t src_size);
+
+typedef struct zstd_parallel_dctx_s zstd_parallel_dctx;
+
+/**
+ * zstd_alloc_parallel_dctx() - allocate a parallel decompression context
+ * @nr_workers: The maximum number of frames decoded concurrently, or 0 for
+ *              the number of online CPUs.
+ *
+ * Return:      The context or NULL on allocation failure.
+ */
+zstd_parallel_dctx *zstd_alloc_parallel_dctx(unsigned int nr_workers);
+
+/**
+ * zstd_free_parallel_dctx() - free a parallel decompression context
+ * @pdctx: The context to free, may be NULL.
+ */
+void zstd_free_parallel_dctx(zstd_parallel_dctx *pdctx);
+
+/**
+ * zstd_parallel_decompress() - decompress concatenated frames using several CPUs
+ * @pdctx:        The parallel decompression context.
+ * @dst:          The buffer to decompress src into. It must be large enough
+ *                for the whole decompressed output.
+ * @dst_capacity: The size of the destination buffer.
+ * @src:          The compressed data, one or more concatenated frames.
+ * @src_size:     The exact size of the compressed data.
+ *
+ * Frames recording their content size are decoded concurrently straight into
+ * dst. Decoding continues serially from the first frame without one.
+ *
+ * Return:        The decompressed size or an error, which can be checked using
+ *                zstd_is_error().
+ */
+size_t zstd_parallel_decompress(zstd_parallel_dctx *pdctx, void *dst,
+	size_t dst_capacity, const void *src, size_t src_size);
+
 #endif  /* LINUX_ZSTD_H */
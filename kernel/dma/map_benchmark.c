@@ -16,9 +16,25 @@
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/platform_device.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/timekeeping.h>
 
+/*
+ * Latency histogram: values below 2^HIST_SUB_BITS ns get a bucket each,
+ * every power of two above that is split into 2^HIST_SUB_BITS buckets, so
+ * percentiles are exact to within about 3%.
+ */
+#define HIST_SUB_BITS		5
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_MAX_SHIFT		36	/* ~40 minutes */
+#define HIST_BUCKETS		((HIST_MAX_SHIFT + 1) * HIST_SUB_BUCKETS)
+
+struct map_benchmark_hist {
+	u64 map[HIST_BUCKETS];
+	u64 unmap[HIST_BUCKETS];
+};
+
 struct map_benchmark_data {
 	struct map_benchmark bparam;
 	struct device *dev;
@@ -31,94 +47,525 @@ struct map_benchmark_data {
 	atomic64_t loops;
 };
 
-static int map_benchmark_thread(void *data)
+struct map_benchmark_thread {
+	struct map_benchmark_data *map;
+	struct map_benchmark_hist *hist;
+};
+
+/*
+ * One instance of prepare() per thread sets up defer_unmap (at least one)
+ * slots; do_map() and do_unmap() are the timed operations on a slot.
+ */
+struct map_benchmark_ops {
+	void *(*prepare)(struct map_benchmark_data *map, unsigned int depth);
+	void (*unprepare)(void *mparam);
+	void (*initialize_data)(void *mparam, unsigned int slot);
+	int (*do_map)(void *mparam, unsigned int slot);
+	void (*do_unmap)(void *mparam, unsigned int slot);
+};
+
+static unsigned int hist_bucket(u64 ns)
 {
-	void *buf;
-	dma_addr_t dma_addr;
-	struct map_benchmark_data *map = data;
-	int npages = map->bparam.granule;
-	u64 size = npages * PAGE_SIZE;
-	int ret = 0;
+	unsigned int shift;
+
+	if (ns < HIST_SUB_BUCKETS)
+		return ns;
+
+	shift = fls64(ns) - 1 - HIST_SUB_BITS;
+	if (shift > HIST_MAX_SHIFT - 1)
+		return HIST_BUCKETS - 1;
+
+	return (shift + 1) * HIST_SUB_BUCKETS +
+	       ((ns >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+static u64 hist_bucket_ns(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < HIST_SUB_BUCKETS)
+		return bucket;
+
+	shift = bucket / HIST_SUB_BUCKETS - 1;
+	return (u64)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << shift;
+}
+
+/* Lower bound of the bucket holding the permille-th permille sample */
+static u64 hist_percentile(const u64 *hist, u64 total, unsigned int permille)
+{
+	u64 rank = div_u64(total * permille, 1000), seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen > rank)
+			return hist_bucket_ns(i);
+	}
+
+	return 0;
+}
+
+/* single: dma_map_single() and dma_unmap_single() of granule pages */
+struct map_single_param {
+	struct map_benchmark_data *map;
+	unsigned int depth;
+	size_t size;
+	void **buf;
+	dma_addr_t *addr;
+};
+
+static void map_single_unprepare(void *mparam)
+{
+	struct map_single_param *params = mparam;
+	unsigned int i;
+
+	for (i = 0; i < params->depth; i++)
+		if (params->buf[i])
+			free_pages_exact(params->buf[i], params->size);
+	kfree(params->buf);
+	kfree(params->addr);
+	kfree(params);
+}
+
+static void *map_single_prepare(struct map_benchmark_data *map,
+				unsigned int depth)
+{
+	struct map_single_param *params;
+	unsigned int i;
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return NULL;
+
+	params->map = map;
+	params->depth = depth;
+	params->size = map->bparam.granule * PAGE_SIZE;
+	params->buf = kcalloc(depth, sizeof(*params->buf), GFP_KERNEL);
+	params->addr = kcalloc(depth, sizeof(*params->addr), GFP_KERNEL);
+	if (!params->buf || !params->addr)
+		goto err;
+
+	for (i = 0; i < depth; i++) {
+		params->buf[i] = alloc_pages_exact(params->size, GFP_KERNEL);
+		if (!params->buf[i])
+			goto err;
+	}
+
+	return params;
+
+err:
+	map_single_unprepare(params);
+	return NULL;
+}
+
+static void map_single_initialize_data(void *mparam, unsigned int slot)
+{
+	struct map_single_param *params = mparam;
+
+	/*
+	 * for a non-coherent device, if we don't stain them in the
+	 * cache, this will give an underestimate of the real-world
+	 * overhead of BIDIRECTIONAL or TO_DEVICE mappings;
+	 * 66 means evertything goes well! 66 is lucky.
+	 */
+	if (params->map->dir != DMA_FROM_DEVICE)
+		memset(params->buf[slot], 0x66, params->size);
+}
+
+static int map_single_do_map(void *mparam, unsigned int slot)
+{
+	struct map_single_param *params = mparam;
+	struct device *dev = params->map->dev;
 
-	buf = alloc_pages_exact(size, GFP_KERNEL);
-	if (!buf)
+	params->addr[slot] = dma_map_single(dev, params->buf[slot],
+					    params->size, params->map->dir);
+	if (unlikely(dma_mapping_error(dev, params->addr[slot]))) {
+		pr_err("dma_map_single failed on %s\n", dev_name(dev));
 		return -ENOMEM;
+	}
 
-	while (!kthread_should_stop())  {
-		u64 map_100ns, unmap_100ns, map_sq, unmap_sq;
-		ktime_t map_stime, map_etime, unmap_stime, unmap_etime;
-		ktime_t map_delta, unmap_delta;
+	return 0;
+}
 
-		/*
-		 * for a non-coherent device, if we don't stain them in the
-		 * cache, this will give an underestimate of the real-world
-		 * overhead of BIDIRECTIONAL or TO_DEVICE mappings;
-		 * 66 means evertything goes well! 66 is lucky.
-		 */
-		if (map->dir != DMA_FROM_DEVICE)
-			memset(buf, 0x66, size);
+static void map_single_do_unmap(void *mparam, unsigned int slot)
+{
+	struct map_single_param *params = mparam;
 
-		map_stime = ktime_get();
-		dma_addr = dma_map_single(map->dev, buf, size, map->dir);
-		if (unlikely(dma_mapping_error(map->dev, dma_addr))) {
-			pr_err("dma_map_single failed on %s\n",
-				dev_name(map->dev));
-			ret = -ENOMEM;
-			goto out;
+	dma_unmap_single(params->map->dev, params->addr[slot], params->size,
+			 params->map->dir);
+}
+
+static const struct map_benchmark_ops map_single_ops = {
+	.prepare = map_single_prepare,
+	.unprepare = map_single_unprepare,
+	.initialize_data = map_single_initialize_data,
+	.do_map = map_single_do_map,
+	.do_unmap = map_single_do_unmap,
+};
+
+/* sync: the buffers stay mapped, time dma_sync_single_for_{device,cpu}() */
+static void map_sync_unprepare(void *mparam)
+{
+	struct map_single_param *params = mparam;
+	unsigned int i;
+
+	for (i = 0; i < params->depth; i++)
+		if (params->buf[i] &&
+		    !dma_mapping_error(params->map->dev, params->addr[i]))
+			map_single_do_unmap(params, i);
+
+	map_single_unprepare(params);
+}
+
+static void *map_sync_prepare(struct map_benchmark_data *map,
+			      unsigned int depth)
+{
+	struct map_single_param *params = map_single_prepare(map, depth);
+	unsigned int i;
+
+	if (!params)
+		return NULL;
+
+	for (i = 0; i < depth; i++)
+		params->addr[i] = DMA_MAPPING_ERROR;
+
+	for (i = 0; i < depth; i++) {
+		if (map_single_do_map(params, i)) {
+			map_sync_unprepare(params);
+			return NULL;
 		}
-		map_etime = ktime_get();
-		map_delta = ktime_sub(map_etime, map_stime);
+	}
+
+	return params;
+}
 
-		/* Pretend DMA is transmitting */
-		ndelay(map->bparam.dma_trans_ns);
+static int map_sync_do_map(void *mparam, unsigned int slot)
+{
+	struct map_single_param *params = mparam;
+
+	dma_sync_single_for_device(params->map->dev, params->addr[slot],
+				   params->size, params->map->dir);
+	return 0;
+}
+
+static void map_sync_do_unmap(void *mparam, unsigned int slot)
+{
+	struct map_single_param *params = mparam;
 
-		unmap_stime = ktime_get();
-		dma_unmap_single(map->dev, dma_addr, size, map->dir);
-		unmap_etime = ktime_get();
-		unmap_delta = ktime_sub(unmap_etime, unmap_stime);
+	dma_sync_single_for_cpu(params->map->dev, params->addr[slot],
+				params->size, params->map->dir);
+}
+
+static const struct map_benchmark_ops map_sync_ops = {
+	.prepare = map_sync_prepare,
+	.unprepare = map_sync_unprepare,
+	.initialize_data = map_single_initialize_data,
+	.do_map = map_sync_do_map,
+	.do_unmap = map_sync_do_unmap,
+};
 
-		/* calculate sum and sum of squares */
+/* sg: dma_map_sgtable() of nents entries, granule pages each */
+struct map_sg_param {
+	struct map_benchmark_data *map;
+	unsigned int depth;
+	unsigned int nents;
+	size_t seg_size;
+	void **buf;			/* depth * nents segments */
+	struct sg_table *sgt;
+};
 
-		map_100ns = div64_ul(map_delta,  100);
-		unmap_100ns = div64_ul(unmap_delta, 100);
-		map_sq = map_100ns * map_100ns;
-		unmap_sq = unmap_100ns * unmap_100ns;
+static void map_sg_unprepare(void *mparam)
+{
+	struct map_sg_param *params = mparam;
+	unsigned int i;
+
+	if (params->buf) {
+		for (i = 0; i < params->depth * params->nents; i++)
+			if (params->buf[i])
+				free_pages_exact(params->buf[i],
+						 params->seg_size);
+		kfree(params->buf);
+	}
+	if (params->sgt) {
+		for (i = 0; i < params->depth; i++)
+			sg_free_table(&params->sgt[i]);
+		kfree(params->sgt);
+	}
+	kfree(params);
+}
 
-		atomic64_add(map_100ns, &map->sum_map_100ns);
-		atomic64_add(unmap_100ns, &map->sum_unmap_100ns);
-		atomic64_add(map_sq, &map->sum_sq_map);
-		atomic64_add(unmap_sq, &map->sum_sq_unmap);
-		atomic64_inc(&map->loops);
+static void *map_sg_prepare(struct map_benchmark_data *map,
+			    unsigned int depth)
+{
+	struct map_sg_param *params;
+	struct scatterlist *sg;
+	unsigned int i, j;
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return NULL;
+
+	params->map = map;
+	params->depth = depth;
+	params->nents = map->bparam.nents;
+	params->seg_size = map->bparam.granule * PAGE_SIZE;
+	params->buf = kcalloc(depth * params->nents, sizeof(*params->buf),
+			      GFP_KERNEL);
+	params->sgt = kcalloc(depth, sizeof(*params->sgt), GFP_KERNEL);
+	if (!params->buf || !params->sgt)
+		goto err;
+
+	for (i = 0; i < depth; i++) {
+		if (sg_alloc_table(&params->sgt[i], params->nents, GFP_KERNEL))
+			goto err;
+
+		for_each_sgtable_sg(&params->sgt[i], sg, j) {
+			void **buf = &params->buf[i * params->nents + j];
+
+			*buf = alloc_pages_exact(params->seg_size, GFP_KERNEL);
+			if (!*buf)
+				goto err;
+			sg_set_buf(sg, *buf, params->seg_size);
+		}
+	}
+
+	return params;
+
+err:
+	map_sg_unprepare(params);
+	return NULL;
+}
+
+static void map_sg_initialize_data(void *mparam, unsigned int slot)
+{
+	struct map_sg_param *params = mparam;
+	unsigned int i;
+
+	if (params->map->dir == DMA_FROM_DEVICE)
+		return;
+
+	for (i = 0; i < params->nents; i++)
+		memset(params->buf[slot * params->nents + i], 0x66,
+		       params->seg_size);
+}
+
+static int map_sg_do_map(void *mparam, unsigned int slot)
+{
+	struct map_sg_param *params = mparam;
+	struct device *dev = params->map->dev;
+	int ret;
+
+	ret = dma_map_sgtable(dev, &params->sgt[slot], params->map->dir, 0);
+	if (unlikely(ret)) {
+		pr_err("dma_map_sgtable failed on %s\n", dev_name(dev));
+		return ret;
+	}
+
+	return 0;
+}
+
+static void map_sg_do_unmap(void *mparam, unsigned int slot)
+{
+	struct map_sg_param *params = mparam;
+
+	dma_unmap_sgtable(params->map->dev, &params->sgt[slot],
+			  params->map->dir, 0);
+}
+
+static const struct map_benchmark_ops map_sg_ops = {
+	.prepare = map_sg_prepare,
+	.unprepare = map_sg_unprepare,
+	.initialize_data = map_sg_initialize_data,
+	.do_map = map_sg_do_map,
+	.do_unmap = map_sg_do_unmap,
+};
+
+/* alloc: dma_alloc_coherent() and dma_free_coherent() of granule pages */
+struct map_alloc_param {
+	struct map_benchmark_data *map;
+	size_t size;
+	void **cpu_addr;
+	dma_addr_t *addr;
+};
+
+static void map_alloc_unprepare(void *mparam)
+{
+	struct map_alloc_param *params = mparam;
+
+	kfree(params->cpu_addr);
+	kfree(params->addr);
+	kfree(params);
+}
+
+static void *map_alloc_prepare(struct map_benchmark_data *map,
+			       unsigned int depth)
+{
+	struct map_alloc_param *params;
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return NULL;
+
+	params->map = map;
+	params->size = map->bparam.granule * PAGE_SIZE;
+	params->cpu_addr = kcalloc(depth, sizeof(*params->cpu_addr),
+				   GFP_KERNEL);
+	params->addr = kcalloc(depth, sizeof(*params->addr), GFP_KERNEL);
+	if (!params->cpu_addr || !params->addr) {
+		map_alloc_unprepare(params);
+		return NULL;
+	}
+
+	return params;
+}
+
+static void map_alloc_initialize_data(void *mparam, unsigned int slot)
+{
+}
+
+static int map_alloc_do_map(void *mparam, unsigned int slot)
+{
+	struct map_alloc_param *params = mparam;
+	struct device *dev = params->map->dev;
+
+	params->cpu_addr[slot] = dma_alloc_coherent(dev, params->size,
+						    &params->addr[slot],
+						    GFP_KERNEL);
+	if (unlikely(!params->cpu_addr[slot])) {
+		pr_err("dma_alloc_coherent failed on %s\n", dev_name(dev));
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void map_alloc_do_unmap(void *mparam, unsigned int slot)
+{
+	struct map_alloc_param *params = mparam;
+
+	dma_free_coherent(params->map->dev, params->size,
+			  params->cpu_addr[slot], params->addr[slot]);
+}
+
+static const struct map_benchmark_ops map_alloc_ops = {
+	.prepare = map_alloc_prepare,
+	.unprepare = map_alloc_unprepare,
+	.initialize_data = map_alloc_initialize_data,
+	.do_map = map_alloc_do_map,
+	.do_unmap = map_alloc_do_unmap,
+};
+
+static const struct map_benchmark_ops *map_benchmark_ops[] = {
+	[DMA_MAP_MODE_SINGLE] = &map_single_ops,
+	[DMA_MAP_MODE_SG] = &map_sg_ops,
+	[DMA_MAP_MODE_ALLOC] = &map_alloc_ops,
+	[DMA_MAP_MODE_SYNC] = &map_sync_ops,
+};
+
+/* Account samples of delta ns each, spread over count operations */
+static void map_benchmark_account(u64 *hist, atomic64_t *sum,
+				  atomic64_t *sum_sq, ktime_t delta,
+				  unsigned int count)
+{
+	u64 ns = div_u64(ktime_to_ns(delta), count);
+	u64 ns100 = div64_ul(ns, 100);
+
+	hist[hist_bucket(ns)] += count;
+
+	/* calculate sum and sum of squares */
+	atomic64_add(ns100 * count, sum);
+	atomic64_add(ns100 * ns100 * count, sum_sq);
+}
+
+static int map_benchmark_thread(void *data)
+{
+	struct map_benchmark_thread *t = data;
+	struct map_benchmark_data *map = t->map;
+	const struct map_benchmark_ops *ops = map_benchmark_ops[map->bparam.mode];
+	unsigned int depth = max(map->bparam.defer_unmap, 1U);
+	unsigned int i, mapped = 0;
+	void *mparam;
+	int ret = 0;
+
+	mparam = ops->prepare(map, depth);
+	if (!mparam)
+		return -ENOMEM;
+
+	while (!kthread_should_stop())  {
+		ktime_t stime, delta;
+
+		for (mapped = 0; mapped < depth; mapped++) {
+			ops->initialize_data(mparam, mapped);
+
+			stime = ktime_get();
+			ret = ops->do_map(mparam, mapped);
+			if (ret)
+				goto out;
+			delta = ktime_sub(ktime_get(), stime);
+			map_benchmark_account(t->hist->map, &map->sum_map_100ns,
+					      &map->sum_sq_map, delta, 1);
+
+			/* Pretend DMA is transmitting */
+			ndelay(map->bparam.dma_trans_ns);
+		}
+
+		/*
+		 * With deferred unmaps the whole batch is torn down back to
+		 * back, as a driver completing many requests at once would,
+		 * so that an IOMMU can batch its IOTLB invalidations. The
+		 * batch time is shared out evenly between the unmaps.
+		 */
+		stime = ktime_get();
+		for (i = 0; i < depth; i++)
+			ops->do_unmap(mparam, i);
+		delta = ktime_sub(ktime_get(), stime);
+		mapped = 0;
+		map_benchmark_account(t->hist->unmap, &map->sum_unmap_100ns,
+				      &map->sum_sq_unmap, delta, depth);
+
+		atomic64_add(depth, &map->loops);
 	}
 
 out:
-	free_pages_exact(buf, size);
+	for (i = 0; i < mapped; i++)
+		ops->do_unmap(mparam, i);
+	ops->unprepare(mparam);
 	return ret;
 }
 
 static int do_map_benchmark(struct map_benchmark_data *map)
 {
 	struct task_struct **tsk;
+	struct map_benchmark_thread *t;
+	struct map_benchmark_hist *hist;
 	int threads = map->bparam.threads;
 	int node = map->bparam.node;
 	const cpumask_t *cpu_mask = cpumask_of_node(node);
 	u64 loops;
 	int ret = 0;
-	int i;
+	int i, j;
 
 	tsk = kmalloc_array(threads, sizeof(*tsk), GFP_KERNEL);
-	if (!tsk)
-		return -ENOMEM;
+	t = kcalloc(threads, sizeof(*t), GFP_KERNEL);
+	hist = kvcalloc(threads + 1, sizeof(*hist), GFP_KERNEL);
+	if (!tsk || !t || !hist) {
+		ret = -ENOMEM;
+		goto free;
+	}
 
 	get_device(map->dev);
 
 	for (i = 0; i < threads; i++) {
-		tsk[i] = kthread_create_on_node(map_benchmark_thread, map,
+		t[i].map = map;
+		t[i].hist = &hist[i + 1];
+		tsk[i] = kthread_create_on_node(map_benchmark_thread, &t[i],
 				map->bparam.node, "dma-map-benchmark/%d", i);
 		if (IS_ERR(tsk[i])) {
 			pr_err("create dma_map thread failed\n");
 			ret = PTR_ERR(tsk[i]);
-			goto out;
+			while (--i >= 0)
+				kthread_stop(tsk[i]);
+			goto put;
 		}
 
 		if (node != NUMA_NO_NODE)
@@ -139,20 +586,28 @@ static int do_map_benchmark(struct map_benchmark_data *map)
 
 	msleep_interruptible(map->bparam.seconds * 1000);
 
-	/* wait for the completion of benchmark threads */
+	/*
+	 * wait for the completion of benchmark threads, all of them as they
+	 * share the histograms freed below
+	 */
 	for (i = 0; i < threads; i++) {
-		ret = kthread_stop(tsk[i]);
-		if (ret)
-			goto out;
+		int err = kthread_stop(tsk[i]);
+
+		if (err && !ret)
+			ret = err;
 	}
+	if (ret)
+		goto out;
 
 	loops = atomic64_read(&map->loops);
+	map->bparam.loops = loops;
 	if (likely(loops > 0)) {
 		u64 map_variance, unmap_variance;
 		u64 sum_map = atomic64_read(&map->sum_map_100ns);
 		u64 sum_unmap = atomic64_read(&map->sum_unmap_100ns);
 		u64 sum_sq_map = atomic64_read(&map->sum_sq_map);
 		u64 sum_sq_unmap = atomic64_read(&map->sum_sq_unmap);
+		u64 nr_map = 0, nr_unmap = 0;
 
 		/* average latency */
 		map->bparam.avg_map_100ns = div64_u64(sum_map, loops);
@@ -167,12 +622,38 @@ static int do_map_benchmark(struct map_benchmark_data *map)
 				map->bparam.avg_unmap_100ns;
 		map->bparam.map_stddev = int_sqrt64(map_variance);
 		map->bparam.unmap_stddev = int_sqrt64(unmap_variance);
+
+		/* percentiles over the merged per-thread histograms */
+		for (i = 1; i <= threads; i++) {
+			for (j = 0; j < HIST_BUCKETS; j++) {
+				hist[0].map[j] += hist[i].map[j];
+				hist[0].unmap[j] += hist[i].unmap[j];
+			}
+		}
+		for (j = 0; j < HIST_BUCKETS; j++) {
+			nr_map += hist[0].map[j];
+			nr_unmap += hist[0].unmap[j];
+		}
+
+		map->bparam.map_p50_ns = hist_percentile(hist[0].map, nr_map, 500);
+		map->bparam.map_p99_ns = hist_percentile(hist[0].map, nr_map, 990);
+		map->bparam.map_p999_ns = hist_percentile(hist[0].map, nr_map, 999);
+		map->bparam.unmap_p50_ns =
+			hist_percentile(hist[0].unmap, nr_unmap, 500);
+		map->bparam.unmap_p99_ns =
+			hist_percentile(hist[0].unmap, nr_unmap, 990);
+		map->bparam.unmap_p999_ns =
+			hist_percentile(hist[0].unmap, nr_unmap, 999);
 	}
 
 out:
 	for (i = 0; i < threads; i++)
 		put_task_struct(tsk[i]);
+put:
 	put_device(map->dev);
+free:
+	kvfree(hist);
+	kfree(t);
 	kfree(tsk);
 	return ret;
 }
@@ -182,10 +663,26 @@ static long map_benchmark_ioctl(struct file *file, unsigned int cmd,
 {
 	struct map_benchmark_data *map = file->private_data;
 	void __user *argp = (void __user *)arg;
-	u64 old_dma_mask;
+	unsigned int size = _IOC_SIZE(cmd);
+	u64 old_dma_mask, pages;
 	int ret;
 
-	if (copy_from_user(&map->bparam, argp, sizeof(map->bparam)))
+	/*
+	 * Binaries built against the original, shorter struct map_benchmark
+	 * encode its size in the command. That size ends with pad0, which
+	 * they may leave uninitialised; the fields they lack read as zero,
+	 * which selects the original dma_map_single() benchmark.
+	 */
+	if (_IOC_TYPE(cmd) != _IOC_TYPE(DMA_MAP_BENCHMARK) ||
+	    size > sizeof(map->bparam) ||
+	    size < offsetofend(struct map_benchmark, granule))
+		return -EINVAL;
+	if (cmd == _IOC(_IOC_DIR(DMA_MAP_BENCHMARK), _IOC_TYPE(cmd),
+			_IOC_NR(DMA_MAP_BENCHMARK), size))
+		cmd = DMA_MAP_BENCHMARK;
+
+	memset(&map->bparam, 0, sizeof(map->bparam));
+	if (copy_from_user(&map->bparam, argp, size))
 		return -EFAULT;
 
 	switch (cmd) {
@@ -218,6 +715,37 @@ static long map_benchmark_ioctl(struct file *file, unsigned int cmd,
 			return -EINVAL;
 		}
 
+		if (map->bparam.mode >= ARRAY_SIZE(map_benchmark_ops)) {
+			pr_err("invalid benchmark mode\n");
+			return -EINVAL;
+		}
+
+		if (map->bparam.pad1) {
+			pr_err("reserved field set\n");
+			return -EINVAL;
+		}
+
+		if (map->bparam.mode != DMA_MAP_MODE_SG)
+			map->bparam.nents = 1;
+		else if (map->bparam.nents == 0)
+			map->bparam.nents = 1;
+		if (map->bparam.nents > DMA_MAP_MAX_NENTS) {
+			pr_err("invalid number of sg entries\n");
+			return -EINVAL;
+		}
+
+		if (map->bparam.defer_unmap > DMA_MAP_MAX_DEFER) {
+			pr_err("invalid number of deferred unmaps\n");
+			return -EINVAL;
+		}
+
+		pages = (u64)map->bparam.granule * map->bparam.nents *
+			max(map->bparam.defer_unmap, 1U);
+		if (pages > DMA_MAP_MAX_PAGES) {
+			pr_err("too many pages per thread\n");
+			return -EINVAL;
+		}
+
 		switch (map->bparam.dma_dir) {
 		case DMA_MAP_BIDIRECTIONAL:
 			map->dir = DMA_BIDIRECTIONAL;
@@ -257,7 +785,7 @@ static long map_benchmark_ioctl(struct file *file, unsigned int cmd,
 		return -EINVAL;
 	}
 
-	if (copy_to_user(argp, &map->bparam, sizeof(map->bparam)))
+	if (copy_to_user(argp, &map->bparam, size))
 		return -EFAULT;
 
 	return ret;
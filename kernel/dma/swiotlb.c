@@ -34,18 +34,22 @@
 #include <linux/init.h>
 #include <linux/memblock.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
 #include <linux/pfn.h>
+#include <linux/rculist.h>
 #include <linux/scatterlist.h>
+#include <linux/sched/clock.h>
 #include <linux/set_memory.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/swiotlb.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_DMA_RESTRICTED_POOL
 #include <linux/of.h>
 #include <linux/of_fdt.h>
 #include <linux/of_reserved_mem.h>
-#include <linux/slab.h>
 #endif
 
 #define CREATE_TRACE_POINTS
@@ -68,10 +72,45 @@ struct io_tlb_slot {
 	unsigned int list;
 };
 
+/*
+ * Per-CPU cache of free single slots of the default pool.  Most bounced
+ * mappings are small (a USB or MMC request, a network packet), so a few
+ * recently released slots are kept at hand to be reused without taking an
+ * area lock and scanning for free space.  Cached slots stay allocated in
+ * the pool and are accounted as used.  The lock is only ever contended when
+ * a CPU that ran out of slots drains the caches of all CPUs.
+ */
+#define IO_TLB_PCP_SLOTS	16
+
+struct io_tlb_pcp {
+	spinlock_t lock;
+	unsigned int nr;
+	unsigned int index[IO_TLB_PCP_SLOTS];
+	unsigned long hits;
+};
+
 static bool swiotlb_force_bounce;
 static bool swiotlb_force_disable;
 
-struct io_tlb_mem io_tlb_default_mem;
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+
+static void swiotlb_dyn_alloc(struct work_struct *work);
+
+struct io_tlb_mem io_tlb_default_mem = {
+	.pools = LIST_HEAD_INIT(io_tlb_default_mem.pools),
+	.lock = __SPIN_LOCK_UNLOCKED(io_tlb_default_mem.lock),
+	.dyn_alloc = __WORK_INITIALIZER(io_tlb_default_mem.dyn_alloc,
+					swiotlb_dyn_alloc),
+};
+
+#else  /* !CONFIG_SWIOTLB_DYNAMIC */
+
+struct io_tlb_mem io_tlb_default_mem = {
+	.pools = LIST_HEAD_INIT(io_tlb_default_mem.pools),
+	.lock = __SPIN_LOCK_UNLOCKED(io_tlb_default_mem.lock),
+};
+
+#endif /* CONFIG_SWIOTLB_DYNAMIC */
 
 phys_addr_t swiotlb_unencrypted_base;
 
@@ -84,12 +123,17 @@ static unsigned long default_nareas;
  * This is a single area with a single lock.
  *
  * @used:	The number of used IO TLB block.
+ * @used_hiwater: The high water mark for @used.  Used only for reporting
+ *		in debugfs.
  * @index:	The slot index to start searching in this area for next round.
  * @lock:	The lock to protect the above data structures in the map and
  *		unmap calls.
  */
 struct io_tlb_area {
 	unsigned long used;
+#ifdef CONFIG_DEBUG_FS
+	unsigned long used_hiwater;
+#endif
 	unsigned int index;
 	spinlock_t lock;
 };
@@ -195,8 +239,8 @@ void swiotlb_print_info(void)
 		return;
 	}
 
-	pr_info("mapped [mem %pa-%pa] (%luMB)\n", &mem->start, &mem->end,
-	       (mem->nslabs << IO_TLB_SHIFT) >> 20);
+	pr_info("mapped [mem %pa-%pa] (%luMB)\n", &mem->defpool.start,
+		&mem->defpool.end, (mem->defpool.nslabs << IO_TLB_SHIFT) >> 20);
 }
 
 static inline unsigned long io_tlb_offset(unsigned long val)
@@ -215,7 +259,7 @@ static inline unsigned long nr_slots(u64 val)
  * Isolation VMs).
  */
 #ifdef CONFIG_HAS_IOMEM
-static void *swiotlb_mem_remap(struct io_tlb_mem *mem, unsigned long bytes)
+static void *swiotlb_mem_remap(struct io_tlb_pool *mem, unsigned long bytes)
 {
 	void *vaddr = NULL;
 
@@ -231,7 +275,7 @@ static void *swiotlb_mem_remap(struct io_tlb_mem *mem, unsigned long bytes)
 	return vaddr;
 }
 #else
-static void *swiotlb_mem_remap(struct io_tlb_mem *mem, unsigned long bytes)
+static void *swiotlb_mem_remap(struct io_tlb_pool *mem, unsigned long bytes)
 {
 	return NULL;
 }
@@ -245,7 +289,7 @@ static void *swiotlb_mem_remap(struct io_tlb_mem *mem, unsigned long bytes)
  */
 void __init swiotlb_update_mem_attributes(void)
 {
-	struct io_tlb_mem *mem = &io_tlb_default_mem;
+	struct io_tlb_pool *mem = &io_tlb_default_mem.defpool;
 	void *vaddr;
 	unsigned long bytes;
 
@@ -260,9 +304,9 @@ void __init swiotlb_update_mem_attributes(void)
 		mem->vaddr = vaddr;
 }
 
-static void swiotlb_init_io_tlb_mem(struct io_tlb_mem *mem, phys_addr_t start,
-		unsigned long nslabs, unsigned int flags,
-		bool late_alloc, unsigned int nareas)
+static void swiotlb_init_io_tlb_pool(struct io_tlb_pool *mem,
+		phys_addr_t start, unsigned long nslabs, bool late_alloc,
+		unsigned int nareas)
 {
 	void *vaddr = phys_to_virt(start);
 	unsigned long bytes = nslabs << IO_TLB_SHIFT, i;
@@ -274,8 +318,6 @@ static void swiotlb_init_io_tlb_mem(struct io_tlb_mem *mem, phys_addr_t start,
 	mem->nareas = nareas;
 	mem->area_nslabs = nslabs / mem->nareas;
 
-	mem->force_bounce = swiotlb_force_bounce || (flags & SWIOTLB_FORCE);
-
 	for (i = 0; i < mem->nareas; i++) {
 		spin_lock_init(&mem->areas[i].lock);
 		mem->areas[i].index = 0;
@@ -300,6 +342,22 @@ static void swiotlb_init_io_tlb_mem(struct io_tlb_mem *mem, phys_addr_t start,
 	return;
 }
 
+/**
+ * add_mem_pool() - add a memory pool to the allocator
+ * @mem:	Software IO TLB allocator.
+ * @pool:	Memory pool to be added.
+ */
+static void add_mem_pool(struct io_tlb_mem *mem, struct io_tlb_pool *pool)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&mem->lock, flags);
+	list_add_tail_rcu(&pool->node, &mem->pools);
+	mem->nslabs += pool->nslabs;
+	mem->nr_pools++;
+	spin_unlock_irqrestore(&mem->lock, flags);
+}
+
 /*
  * Statically reserve bounce buffer space and initialize bounce buffer data
  * structures for the software IO TLB used to implement the DMA API.
@@ -308,6 +366,7 @@ void __init swiotlb_init_remap(bool addressing_limit, unsigned int flags,
 		int (*remap)(void *tlb, unsigned long nslabs))
 {
 	struct io_tlb_mem *mem = &io_tlb_default_mem;
+	struct io_tlb_pool *pool = &mem->defpool;
 	unsigned long nslabs;
 	size_t alloc_size;
 	size_t bytes;
@@ -353,23 +412,34 @@ void __init swiotlb_init_remap(bool addressing_limit, unsigned int flags,
 		return;
 	}
 
-	alloc_size = PAGE_ALIGN(array_size(sizeof(*mem->slots), nslabs));
-	mem->slots = memblock_alloc(alloc_size, PAGE_SIZE);
-	if (!mem->slots) {
+	alloc_size = PAGE_ALIGN(array_size(sizeof(*pool->slots), nslabs));
+	pool->slots = memblock_alloc(alloc_size, PAGE_SIZE);
+	if (!pool->slots) {
 		pr_warn("%s: Failed to allocate %zu bytes align=0x%lx\n",
 			__func__, alloc_size, PAGE_SIZE);
 		return;
 	}
 
-	mem->areas = memblock_alloc(array_size(sizeof(struct io_tlb_area),
+	pool->areas = memblock_alloc(array_size(sizeof(struct io_tlb_area),
 		default_nareas), SMP_CACHE_BYTES);
-	if (!mem->areas) {
+	if (!pool->areas) {
 		pr_warn("%s: Failed to allocate mem->areas.\n", __func__);
 		return;
 	}
 
-	swiotlb_init_io_tlb_mem(mem, __pa(tlb), nslabs, flags, false,
-				default_nareas);
+	swiotlb_init_io_tlb_pool(pool, __pa(tlb), nslabs, false,
+				 default_nareas);
+	mem->force_bounce = swiotlb_force_bounce || (flags & SWIOTLB_FORCE);
+
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+	if (!remap && !swiotlb_unencrypted_base)
+		mem->can_grow = true;
+	if (flags & SWIOTLB_ANY)
+		mem->phys_limit = virt_to_phys(high_memory - 1);
+	else
+		mem->phys_limit = ARCH_LOW_ADDRESS_LIMIT;
+#endif
+	add_mem_pool(mem, pool);
 
 	if (flags & SWIOTLB_VERBOSE)
 		swiotlb_print_info();
@@ -389,6 +459,7 @@ int swiotlb_init_late(size_t size, gfp_t gfp_mask,
 		int (*remap)(void *tlb, unsigned long nslabs))
 {
 	struct io_tlb_mem *mem = &io_tlb_default_mem;
+	struct io_tlb_pool *pool = &mem->defpool;
 	unsigned long nslabs = ALIGN(size >> IO_TLB_SHIFT, IO_TLB_SEGSIZE);
 	unsigned char *vstart = NULL;
 	unsigned int order, area_order;
@@ -435,28 +506,41 @@ int swiotlb_init_late(size_t size, gfp_t gfp_mask,
 	if (!default_nareas)
 		swiotlb_adjust_nareas(num_possible_cpus());
 
-	area_order = get_order(array_size(sizeof(*mem->areas),
+	area_order = get_order(array_size(sizeof(*pool->areas),
 		default_nareas));
-	mem->areas = (struct io_tlb_area *)
+	pool->areas = (struct io_tlb_area *)
 		__get_free_pages(GFP_KERNEL | __GFP_ZERO, area_order);
-	if (!mem->areas)
+	if (!pool->areas)
 		goto error_area;
 
-	mem->slots = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
-		get_order(array_size(sizeof(*mem->slots), nslabs)));
-	if (!mem->slots)
+	pool->slots = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+		get_order(array_size(sizeof(*pool->slots), nslabs)));
+	if (!pool->slots)
 		goto error_slots;
 
 	set_memory_decrypted((unsigned long)vstart,
 			     (nslabs << IO_TLB_SHIFT) >> PAGE_SHIFT);
-	swiotlb_init_io_tlb_mem(mem, virt_to_phys(vstart), nslabs, 0, true,
-				default_nareas);
+	swiotlb_init_io_tlb_pool(pool, virt_to_phys(vstart), nslabs, true,
+				 default_nareas);
+	mem->force_bounce = swiotlb_force_bounce;
+
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+	if (!remap && !swiotlb_unencrypted_base)
+		mem->can_grow = true;
+	if (IS_ENABLED(CONFIG_ZONE_DMA) && (gfp_mask & __GFP_DMA))
+		mem->phys_limit = DMA_BIT_MASK(zone_dma_bits);
+	else if (IS_ENABLED(CONFIG_ZONE_DMA32) && (gfp_mask & __GFP_DMA32))
+		mem->phys_limit = DMA_BIT_MASK(32);
+	else
+		mem->phys_limit = virt_to_phys(high_memory - 1);
+#endif
+	add_mem_pool(mem, pool);
 
 	swiotlb_print_info();
 	return 0;
 
 error_slots:
-	free_pages((unsigned long)mem->areas, area_order);
+	free_pages((unsigned long)pool->areas, area_order);
 error_area:
 	free_pages((unsigned long)vstart, order);
 	return -ENOMEM;
@@ -465,6 +549,7 @@ int swiotlb_init_late(size_t size, gfp_t gfp_mask,
 void __init swiotlb_exit(void)
 {
 	struct io_tlb_mem *mem = &io_tlb_default_mem;
+	struct io_tlb_pool *pool = &mem->defpool;
 	unsigned long tbl_vaddr;
 	size_t tbl_size, slots_size;
 	unsigned int area_order;
@@ -476,25 +561,33 @@ void __init swiotlb_exit(void)
 		return;
 
 	pr_info("tearing down default memory pool\n");
-	tbl_vaddr = (unsigned long)phys_to_virt(mem->start);
-	tbl_size = PAGE_ALIGN(mem->end - mem->start);
-	slots_size = PAGE_ALIGN(array_size(sizeof(*mem->slots), mem->nslabs));
+	tbl_vaddr = (unsigned long)phys_to_virt(pool->start);
+	tbl_size = PAGE_ALIGN(pool->end - pool->start);
+	slots_size = PAGE_ALIGN(array_size(sizeof(*pool->slots), pool->nslabs));
 
 	set_memory_encrypted(tbl_vaddr, tbl_size >> PAGE_SHIFT);
-	if (mem->late_alloc) {
-		area_order = get_order(array_size(sizeof(*mem->areas),
-			mem->nareas));
-		free_pages((unsigned long)mem->areas, area_order);
+	if (pool->late_alloc) {
+		area_order = get_order(array_size(sizeof(*pool->areas),
+			pool->nareas));
+		free_pages((unsigned long)pool->areas, area_order);
 		free_pages(tbl_vaddr, get_order(tbl_size));
-		free_pages((unsigned long)mem->slots, get_order(slots_size));
+		free_pages((unsigned long)pool->slots, get_order(slots_size));
 	} else {
-		memblock_free_late(__pa(mem->areas),
-			array_size(sizeof(*mem->areas), mem->nareas));
-		memblock_free_late(mem->start, tbl_size);
-		memblock_free_late(__pa(mem->slots), slots_size);
+		memblock_free_late(__pa(pool->areas),
+			array_size(sizeof(*pool->areas), pool->nareas));
+		memblock_free_late(pool->start, tbl_size);
+		memblock_free_late(__pa(pool->slots), slots_size);
 	}
 
-	memset(mem, 0, sizeof(*mem));
+	/* Nothing has been mapped yet, so no other pool can exist. */
+	memset(pool, 0, sizeof(*pool));
+	INIT_LIST_HEAD(&mem->pools);
+	mem->nslabs = 0;
+	mem->nr_pools = 0;
+	mem->force_bounce = false;
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+	mem->can_grow = false;
+#endif
 }
 
 /*
@@ -505,13 +598,171 @@ static unsigned int swiotlb_align_offset(struct device *dev, u64 addr)
 	return addr & dma_get_min_align_mask(dev) & (IO_TLB_SIZE - 1);
 }
 
+/**
+ * swiotlb_find_pool() - find the IO TLB pool for a physical address
+ * @dev:	Device which has mapped the DMA buffer.
+ * @paddr:	Physical address within the DMA buffer.
+ *
+ * Find the IO TLB memory pool descriptor which contains the given physical
+ * address, if any.
+ *
+ * Return: Memory pool which contains @paddr, or %NULL if none.
+ */
+struct io_tlb_pool *swiotlb_find_pool(struct device *dev, phys_addr_t paddr)
+{
+	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
+	struct io_tlb_pool *pool;
+
+	if (paddr >= mem->defpool.start && paddr < mem->defpool.end)
+		return &mem->defpool;
+
+	/* Pools are never freed, so the result stays valid after unlock. */
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &mem->pools, node) {
+		if (paddr >= pool->start && paddr < pool->end)
+			goto out;
+	}
+	pool = NULL;
+out:
+	rcu_read_unlock();
+	return pool;
+}
+
+/*
+ * The default pool is checked after mapping, see swiotlb_map().  Any other
+ * pool may have been allocated for a device with a wider DMA mask than
+ * @dev, so only use it if all of it is addressable.
+ */
+static bool swiotlb_pool_usable(struct device *dev, struct io_tlb_mem *mem,
+		struct io_tlb_pool *pool)
+{
+	if (pool == &mem->defpool)
+		return true;
+
+	return dma_capable(dev, phys_to_dma_unencrypted(dev, pool->start),
+			   pool->end - pool->start, true);
+}
+
+static unsigned long mem_pool_used(struct io_tlb_pool *pool)
+{
+	int i;
+	unsigned long used = 0;
+
+	for (i = 0; i < pool->nareas; i++)
+		used += pool->areas[i].used;
+	return used;
+}
+
+/*
+ * Areas are picked by CPU, so their counters already are the per-CPU count
+ * of used slots, kept under the area lock.  Only readers sum them up.
+ */
+static unsigned long mem_used(struct io_tlb_mem *mem)
+{
+	struct io_tlb_pool *pool;
+	unsigned long used = 0;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &mem->pools, node)
+		used += mem_pool_used(pool);
+	rcu_read_unlock();
+
+	return used;
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+/* Called with the area lock held. */
+static void update_hiwater(struct io_tlb_area *area)
+{
+	if (area->used > area->used_hiwater)
+		WRITE_ONCE(area->used_hiwater, area->used);
+}
+
+/*
+ * The sum of the per-area high water marks.  Areas need not peak at the
+ * same time, so this is an upper bound of the high water mark of all of
+ * the allocator.
+ */
+static unsigned long mem_hiwater(struct io_tlb_mem *mem)
+{
+	struct io_tlb_pool *pool;
+	unsigned long hiwater = 0;
+	int i;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &mem->pools, node)
+		for (i = 0; i < pool->nareas; i++)
+			hiwater += READ_ONCE(pool->areas[i].used_hiwater);
+	rcu_read_unlock();
+
+	return hiwater;
+}
+
+static void reset_hiwater(struct io_tlb_mem *mem)
+{
+	struct io_tlb_pool *pool;
+	int i;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &mem->pools, node)
+		for (i = 0; i < pool->nareas; i++)
+			WRITE_ONCE(pool->areas[i].used_hiwater, 0);
+	rcu_read_unlock();
+}
+
+static void inc_alloc_failed(struct io_tlb_mem *mem)
+{
+	atomic_long_inc(&mem->alloc_failed);
+}
+
+static u64 search_clock(void)
+{
+	return local_clock();
+}
+
+static void account_search(struct io_tlb_mem *mem, u64 start)
+{
+	s64 ns = local_clock() - start;
+	s64 old_max;
+
+	atomic_long_inc(&mem->search_count);
+	atomic64_add(ns, &mem->search_ns);
+	old_max = atomic64_read(&mem->search_ns_max);
+	do {
+		if (ns <= old_max)
+			break;
+	} while (!atomic64_try_cmpxchg(&mem->search_ns_max, &old_max, ns));
+}
+
+#else  /* !CONFIG_DEBUG_FS */
+
+static void update_hiwater(struct io_tlb_area *area)
+{
+}
+
+static void inc_alloc_failed(struct io_tlb_mem *mem)
+{
+}
+
+static u64 search_clock(void)
+{
+	return 0;
+}
+
+static void account_search(struct io_tlb_mem *mem, u64 start)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
+
 /*
  * Bounce: copy the swiotlb buffer from or back to the original dma location
  */
 static void swiotlb_bounce(struct device *dev, phys_addr_t tlb_addr, size_t size,
 			   enum dma_data_direction dir)
 {
-	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
+	struct io_tlb_pool *mem = swiotlb_find_pool(dev, tlb_addr);
 	int index = (tlb_addr - mem->start) >> IO_TLB_SHIFT;
 	phys_addr_t orig_addr = mem->slots[index].orig_addr;
 	size_t alloc_size = mem->slots[index].alloc_size;
@@ -593,22 +844,44 @@ static inline unsigned long get_max_slots(unsigned long boundary_mask)
 	return nr_slots(boundary_mask + 1);
 }
 
-static unsigned int wrap_area_index(struct io_tlb_mem *mem, unsigned int index)
+static unsigned int wrap_area_index(struct io_tlb_pool *mem, unsigned int index)
 {
 	if (index >= mem->area_nslabs)
 		return 0;
 	return index;
 }
 
+static void swiotlb_check_watermark(struct io_tlb_mem *mem);
+
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+/*
+ * Summing up all areas is too costly for every mapping, so the watermark of
+ * the whole allocator is only checked when an area crosses its own one.
+ * Called with the area lock held.
+ */
+static bool swiotlb_area_crossed_watermark(struct io_tlb_pool *pool,
+		struct io_tlb_area *area, unsigned int nslots)
+{
+	unsigned long wmark = pool->area_nslabs / 4 * 3;
+
+	return area->used > wmark && area->used - nslots <= wmark;
+}
+#else
+static bool swiotlb_area_crossed_watermark(struct io_tlb_pool *pool,
+		struct io_tlb_area *area, unsigned int nslots)
+{
+	return false;
+}
+#endif
+
 /*
  * Find a suitable number of IO TLB entries size that will fit this request and
  * allocate a buffer from that IO TLB pool.
  */
-static int swiotlb_do_find_slots(struct device *dev, int area_index,
-		phys_addr_t orig_addr, size_t alloc_size,
+static int swiotlb_do_find_slots(struct device *dev, struct io_tlb_pool *mem,
+		int area_index, phys_addr_t orig_addr, size_t alloc_size,
 		unsigned int alloc_align_mask)
 {
-	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
 	struct io_tlb_area *area = mem->areas + area_index;
 	unsigned long boundary_mask = dma_get_seg_boundary(dev);
 	dma_addr_t tbl_dma_addr =
@@ -622,6 +895,7 @@ static int swiotlb_do_find_slots(struct device *dev, int area_index,
 	unsigned long flags;
 	unsigned int slot_base;
 	unsigned int slot_index;
+	bool above;
 
 	BUG_ON(!nslots);
 	BUG_ON(area_index >= mem->nareas);
@@ -690,37 +964,586 @@ static int swiotlb_do_find_slots(struct device *dev, int area_index,
 	else
 		area->index = 0;
 	area->used += nslots;
+	update_hiwater(area);
+	above = swiotlb_area_crossed_watermark(mem, area, nslots);
 	spin_unlock_irqrestore(&area->lock, flags);
+
+	if (above)
+		swiotlb_check_watermark(dev->dma_io_tlb_mem);
 	return slot_index;
 }
 
-static int swiotlb_find_slots(struct device *dev, phys_addr_t orig_addr,
-		size_t alloc_size, unsigned int alloc_align_mask)
+static int swiotlb_pool_find_slots(struct device *dev, struct io_tlb_pool *pool,
+		phys_addr_t orig_addr, size_t alloc_size,
+		unsigned int alloc_align_mask)
 {
-	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
-	int start = raw_smp_processor_id() & (mem->nareas - 1);
+	int start = raw_smp_processor_id() & (pool->nareas - 1);
 	int i = start, index;
 
 	do {
-		index = swiotlb_do_find_slots(dev, i, orig_addr, alloc_size,
-					      alloc_align_mask);
+		index = swiotlb_do_find_slots(dev, pool, i, orig_addr,
+					      alloc_size, alloc_align_mask);
 		if (index >= 0)
 			return index;
-		if (++i >= mem->nareas)
+		if (++i >= pool->nareas)
 			i = 0;
 	} while (i != start);
 
 	return -1;
 }
 
-static unsigned long mem_used(struct io_tlb_mem *mem)
+static void swiotlb_pool_release(struct io_tlb_mem *mem,
+		struct io_tlb_pool *pool, int index, int nslots)
 {
-	int i;
-	unsigned long used = 0;
+	unsigned long flags;
+	int aindex = index / pool->area_nslabs;
+	struct io_tlb_area *area = &pool->areas[aindex];
+	int count, i;
 
-	for (i = 0; i < mem->nareas; i++)
-		used += mem->areas[i].used;
-	return used;
+	/*
+	 * Return the buffer to the free list by setting the corresponding
+	 * entries to indicate the number of contiguous entries available.
+	 * While returning the entries to the free list, we merge the entries
+	 * with slots below and above the pool being returned.
+	 */
+	BUG_ON(aindex >= pool->nareas);
+
+	spin_lock_irqsave(&area->lock, flags);
+	if (index + nslots < ALIGN(index + 1, IO_TLB_SEGSIZE))
+		count = pool->slots[index + nslots].list;
+	else
+		count = 0;
+
+	/*
+	 * Step 1: return the slots to the free list, merging the slots with
+	 * superceeding slots
+	 */
+	for (i = index + nslots - 1; i >= index; i--) {
+		pool->slots[i].list = ++count;
+		pool->slots[i].orig_addr = INVALID_PHYS_ADDR;
+		pool->slots[i].alloc_size = 0;
+	}
+
+	/*
+	 * Step 2: merge the returned slots with the preceding slots, if
+	 * available (non zero)
+	 */
+	for (i = index - 1;
+	     io_tlb_offset(i) != IO_TLB_SEGSIZE - 1 && pool->slots[i].list;
+	     i--)
+		pool->slots[i].list = ++count;
+	area->used -= nslots;
+	spin_unlock_irqrestore(&area->lock, flags);
+}
+
+/*
+ * A request can be served from the per-CPU cache if it fits a single slot
+ * and places no constraint on the slot address beyond IO_TLB_SIZE.
+ */
+static bool swiotlb_pcp_eligible(struct device *dev, size_t alloc_size,
+		unsigned int alloc_align_mask)
+{
+	return alloc_size <= IO_TLB_SIZE && alloc_align_mask < IO_TLB_SIZE &&
+		!(dma_get_min_align_mask(dev) & ~(IO_TLB_SIZE - 1));
+}
+
+static int swiotlb_pcp_get(struct io_tlb_mem *mem)
+{
+	struct io_tlb_pcp __percpu *pcpu = READ_ONCE(mem->pcp);
+	struct io_tlb_pcp *pcp;
+	unsigned long flags;
+	int index = -1;
+
+	if (!pcpu)
+		return -1;
+
+	/* Migrating after the lookup only means using another CPU's cache. */
+	pcp = raw_cpu_ptr(pcpu);
+	spin_lock_irqsave(&pcp->lock, flags);
+	if (pcp->nr) {
+		index = pcp->index[--pcp->nr];
+		pcp->hits++;
+	}
+	spin_unlock_irqrestore(&pcp->lock, flags);
+
+	return index;
+}
+
+static bool swiotlb_pcp_put(struct io_tlb_mem *mem, int index)
+{
+	struct io_tlb_pcp __percpu *pcpu = READ_ONCE(mem->pcp);
+	struct io_tlb_pcp *pcp;
+	unsigned long flags;
+	bool cached = false;
+
+	if (!pcpu)
+		return false;
+
+	mem->defpool.slots[index].orig_addr = INVALID_PHYS_ADDR;
+	mem->defpool.slots[index].alloc_size = 0;
+
+	pcp = raw_cpu_ptr(pcpu);
+	spin_lock_irqsave(&pcp->lock, flags);
+	if (pcp->nr < IO_TLB_PCP_SLOTS) {
+		pcp->index[pcp->nr++] = index;
+		cached = true;
+	}
+	spin_unlock_irqrestore(&pcp->lock, flags);
+
+	return cached;
+}
+
+/*
+ * Give the slots cached on all CPUs back to the default pool, before a
+ * mapping fails or the allocator grows for lack of free slots.  This may
+ * run with interrupts disabled, so the caches are walked under their locks
+ * instead of asking each CPU to drain its own.
+ */
+static bool swiotlb_pcp_drain(struct io_tlb_mem *mem)
+{
+	struct io_tlb_pcp __percpu *pcpu = READ_ONCE(mem->pcp);
+	unsigned int index[IO_TLB_PCP_SLOTS];
+	struct io_tlb_pcp *pcp;
+	unsigned long flags;
+	bool drained = false;
+	unsigned int nr, i;
+	int cpu;
+
+	if (!pcpu)
+		return false;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pcpu, cpu);
+		if (!READ_ONCE(pcp->nr))
+			continue;
+
+		spin_lock_irqsave(&pcp->lock, flags);
+		nr = pcp->nr;
+		memcpy(index, pcp->index, nr * sizeof(*index));
+		pcp->nr = 0;
+		spin_unlock_irqrestore(&pcp->lock, flags);
+
+		for (i = 0; i < nr; i++)
+			swiotlb_pool_release(mem, &mem->defpool, index[i], 1);
+		if (nr)
+			drained = true;
+	}
+
+	return drained;
+}
+
+#ifdef CONFIG_SWIOTLB_DYNAMIC
+
+/**
+ * alloc_dma_pages() - allocate pages to be used for DMA
+ * @gfp:	GFP flags for the allocation.
+ * @bytes:	Size of the buffer.
+ * @phys_limit:	Maximum allowed physical address of the buffer.
+ *
+ * Allocate pages from the buddy allocator. If successful, make the allocated
+ * pages decrypted that they can be used for DMA.
+ *
+ * Return: Decrypted pages, %NULL on allocation failure, or ERR_PTR(-EAGAIN)
+ * if the allocated physical address was above @phys_limit.
+ */
+static struct page *alloc_dma_pages(gfp_t gfp, size_t bytes, u64 phys_limit)
+{
+	unsigned int order = get_order(bytes);
+	struct page *page;
+	phys_addr_t paddr;
+	void *vaddr;
+
+	page = alloc_pages(gfp, order);
+	if (!page)
+		return NULL;
+
+	paddr = page_to_phys(page);
+	if (paddr + bytes - 1 > phys_limit) {
+		__free_pages(page, order);
+		return ERR_PTR(-EAGAIN);
+	}
+
+	vaddr = phys_to_virt(paddr);
+	if (set_memory_decrypted((unsigned long)vaddr, PFN_UP(bytes)))
+		goto error;
+	return page;
+
+error:
+	/* Intentional leak if pages cannot be encrypted again. */
+	if (!set_memory_encrypted((unsigned long)vaddr, PFN_UP(bytes)))
+		__free_pages(page, order);
+	return NULL;
+}
+
+/**
+ * swiotlb_alloc_tlb() - allocate a dynamic IO TLB buffer
+ * @dev:	Device for which a memory pool is allocated.
+ * @bytes:	Size of the buffer.
+ * @phys_limit:	Maximum allowed physical address of the buffer.
+ * @gfp:	GFP flags for the allocation.
+ *
+ * The zone is picked from @phys_limit, falling back to lower zones when the
+ * page allocator returns memory above the limit.
+ *
+ * Return: Allocated pages, or %NULL on allocation failure.
+ */
+static struct page *swiotlb_alloc_tlb(struct device *dev, size_t bytes,
+		u64 phys_limit, gfp_t gfp)
+{
+	struct page *page;
+
+	/*
+	 * Allocate from the atomic pools if memory is encrypted and
+	 * the allocation is atomic, because decrypting may block.
+	 */
+	if (!gfpflags_allow_blocking(gfp) && dev && force_dma_unencrypted(dev))
+		return NULL;
+
+	gfp &= ~GFP_ZONEMASK;
+	if (phys_limit <= DMA_BIT_MASK(zone_dma_bits))
+		gfp |= __GFP_DMA;
+	else if (phys_limit <= DMA_BIT_MASK(32))
+		gfp |= __GFP_DMA32;
+
+	while (IS_ERR(page = alloc_dma_pages(gfp, bytes, phys_limit))) {
+		if (IS_ENABLED(CONFIG_ZONE_DMA32) &&
+		    phys_limit < DMA_BIT_MASK(64) &&
+		    !(gfp & (__GFP_DMA32 | __GFP_DMA)))
+			gfp |= __GFP_DMA32;
+		else if (IS_ENABLED(CONFIG_ZONE_DMA) &&
+			 !(gfp & __GFP_DMA))
+			gfp = (gfp & ~__GFP_DMA32) | __GFP_DMA;
+		else
+			return NULL;
+	}
+
+	return page;
+}
+
+/**
+ * swiotlb_free_tlb() - free a dynamically allocated IO TLB buffer
+ * @vaddr:	Virtual address of the buffer.
+ * @bytes:	Size of the buffer.
+ */
+static void swiotlb_free_tlb(void *vaddr, size_t bytes)
+{
+	/* Intentional leak if pages cannot be encrypted again. */
+	if (!set_memory_encrypted((unsigned long)vaddr, PFN_UP(bytes)))
+		free_pages((unsigned long)vaddr, get_order(bytes));
+}
+
+/*
+ * Areas must be a power of two and hold at least one full segment each.
+ */
+static unsigned int limit_nareas(unsigned int nareas, unsigned long nslots)
+{
+	if (nslots < nareas * IO_TLB_SEGSIZE)
+		return rounddown_pow_of_two(nslots / IO_TLB_SEGSIZE);
+	return nareas;
+}
+
+/**
+ * swiotlb_alloc_pool() - allocate a new IO TLB memory pool
+ * @dev:	Device for which a memory pool is allocated.
+ * @minslabs:	Minimum number of slabs.
+ * @nslabs:	Desired (maximum) number of slabs.
+ * @nareas:	Number of areas.
+ * @phys_limit:	Maximum DMA buffer physical address.
+ * @gfp:	GFP flags for the allocations.
+ *
+ * Allocate and initialize a new IO TLB memory pool. The actual number of
+ * slabs may be reduced if allocation of @nslabs fails. If even
+ * @minslabs cannot be allocated, this function fails.
+ *
+ * Return: New memory pool, or %NULL on allocation failure.
+ */
+static struct io_tlb_pool *swiotlb_alloc_pool(struct device *dev,
+		unsigned long minslabs, unsigned long nslabs,
+		unsigned int nareas, u64 phys_limit, gfp_t gfp)
+{
+	struct io_tlb_pool *pool;
+	unsigned int slot_order;
+	struct page *tlb;
+	size_t pool_size;
+	size_t tlb_size;
+
+	if (nslabs > SLABS_PER_PAGE << (MAX_ORDER - 1)) {
+		nslabs = SLABS_PER_PAGE << (MAX_ORDER - 1);
+		nareas = limit_nareas(nareas, nslabs);
+	}
+
+	pool_size = sizeof(*pool) + array_size(sizeof(*pool->areas), nareas);
+	pool = kzalloc(pool_size, gfp);
+	if (!pool)
+		goto error;
+	pool->areas = (void *)pool + sizeof(*pool);
+
+	tlb_size = nslabs << IO_TLB_SHIFT;
+	while (!(tlb = swiotlb_alloc_tlb(dev, tlb_size, phys_limit, gfp))) {
+		if (nslabs <= minslabs)
+			goto error_tlb;
+		nslabs = ALIGN(nslabs >> 1, IO_TLB_SEGSIZE);
+		nareas = limit_nareas(nareas, nslabs);
+		tlb_size = nslabs << IO_TLB_SHIFT;
+	}
+
+	slot_order = get_order(array_size(sizeof(*pool->slots), nslabs));
+	pool->slots = (struct io_tlb_slot *)
+		__get_free_pages(gfp, slot_order);
+	if (!pool->slots)
+		goto error_slots;
+
+	swiotlb_init_io_tlb_pool(pool, page_to_phys(tlb), nslabs, true, nareas);
+	return pool;
+
+error_slots:
+	swiotlb_free_tlb(page_address(tlb), tlb_size);
+error_tlb:
+	kfree(pool);
+error:
+	return NULL;
+}
+
+static void swiotlb_free_pool(struct io_tlb_pool *pool)
+{
+	swiotlb_free_tlb(pool->vaddr, pool->end - pool->start);
+	free_pages((unsigned long)pool->slots,
+		   get_order(array_size(sizeof(*pool->slots), pool->nslabs)));
+	kfree(pool);
+}
+
+/*
+ * A growable allocator never gets bigger than this many times its default
+ * pool. Pools are not freed again, so this also bounds what a burst can
+ * leave behind.
+ */
+#define IO_TLB_DYN_MAX_FACTOR	8
+
+static bool swiotlb_may_grow(struct io_tlb_mem *mem, unsigned long nslabs)
+{
+	return mem->can_grow &&
+	       READ_ONCE(mem->nslabs) + nslabs <=
+	       mem->defpool.nslabs * IO_TLB_DYN_MAX_FACTOR;
+}
+
+/* Three quarters of all slots are in use. */
+static bool swiotlb_above_watermark(struct io_tlb_mem *mem)
+{
+	return mem_used(mem) > READ_ONCE(mem->nslabs) / 4 * 3;
+}
+
+/**
+ * swiotlb_dyn_alloc() - dynamic memory pool allocation worker
+ * @work:	Pointer to dyn_alloc in struct io_tlb_mem.
+ *
+ * Grows the allocator by another pool the size of the default one, in
+ * low enough memory for every device using it. The watermark is checked
+ * again first: the work may have been queued long before it runs, or by
+ * a burst that is over by now.
+ */
+static void swiotlb_dyn_alloc(struct work_struct *work)
+{
+	struct io_tlb_mem *mem =
+		container_of(work, struct io_tlb_mem, dyn_alloc);
+	struct io_tlb_pool *pool;
+
+	if (!swiotlb_above_watermark(mem))
+		return;
+	if (!swiotlb_may_grow(mem, default_nslabs)) {
+		pr_warn_once("Dynamic pools reached the size limit\n");
+		return;
+	}
+
+	pool = swiotlb_alloc_pool(NULL, IO_TLB_MIN_SLABS, default_nslabs,
+				  max(default_nareas, 1UL), mem->phys_limit,
+				  GFP_KERNEL);
+	if (!pool) {
+		pr_warn_ratelimited("Failed to allocate new pool");
+		return;
+	}
+
+	add_mem_pool(mem, pool);
+}
+
+/*
+ * Highest physical address a pool allocated on behalf of @dev may end at.
+ * Pools are only ever handed to devices that can reach them, so pools grown
+ * for a device with a narrow DMA mask end up serving all devices with that
+ * mask or a wider one.
+ */
+static u64 swiotlb_dev_phys_limit(struct device *dev, struct io_tlb_mem *mem)
+{
+	u64 dma_limit = min_not_zero(*dev->dma_mask, dev->bus_dma_limit);
+
+	return min_t(u64, mem->phys_limit, dma_to_phys(dev, dma_limit));
+}
+
+/**
+ * swiotlb_grow() - add a pool on an allocation failure
+ * @dev:	Device which needs the bounce buffer.
+ * @mem:	Software IO TLB allocator.
+ *
+ * Called when none of the existing pools has room for a mapping, possibly
+ * in atomic context. A full sized pool is queued for allocation from
+ * process context and a small one is allocated right away, without
+ * sleeping, so that this mapping can still be served.
+ *
+ * Return: The new pool, or %NULL if the allocator cannot grow now.
+ */
+static struct io_tlb_pool *swiotlb_grow(struct device *dev,
+		struct io_tlb_mem *mem)
+{
+	struct io_tlb_pool *pool;
+
+	if (!swiotlb_may_grow(mem, IO_TLB_MIN_SLABS))
+		return NULL;
+
+	schedule_work(&mem->dyn_alloc);
+
+	pool = swiotlb_alloc_pool(dev, IO_TLB_SEGSIZE, IO_TLB_MIN_SLABS, 1,
+				  swiotlb_dev_phys_limit(dev, mem),
+				  GFP_NOWAIT | __GFP_NOWARN);
+	if (!pool)
+		return NULL;
+
+	if (!swiotlb_pool_usable(dev, mem, pool)) {
+		swiotlb_free_pool(pool);
+		return NULL;
+	}
+
+	add_mem_pool(mem, pool);
+	return pool;
+}
+
+/*
+ * Start growing in the background once three quarters of all slots are in
+ * use, so that bursts do not have to wait for a pool to be allocated. This
+ * runs whenever an area crosses three quarters of its own slots. As areas
+ * fill up, or allocations spill over from full areas, every area crosses
+ * its watermark before all of them together can.
+ */
+static void swiotlb_check_watermark(struct io_tlb_mem *mem)
+{
+	if (swiotlb_may_grow(mem, default_nslabs) &&
+	    swiotlb_above_watermark(mem))
+		schedule_work(&mem->dyn_alloc);
+}
+
+static void swiotlb_mark_dyn_user(struct device *dev, struct io_tlb_mem *mem,
+		struct io_tlb_pool *pool)
+{
+	if (pool == &mem->defpool)
+		return;
+
+	if (!READ_ONCE(dev->dma_uses_io_tlb))
+		WRITE_ONCE(dev->dma_uses_io_tlb, true);
+
+	/*
+	 * The general barrier orders reads and writes against a presumed store
+	 * of the SWIOTLB buffer address by a device driver (to a driver private
+	 * data structure). It serves two purposes.
+	 *
+	 * First, the store to dev->dma_uses_io_tlb must be ordered before the
+	 * presumed store. This guarantees that the returned buffer address
+	 * cannot be passed to another CPU before updating dev->dma_uses_io_tlb.
+	 *
+	 * Second, the load from mem->pools must be ordered before the same
+	 * presumed store. This guarantees that the returned buffer address
+	 * cannot be observed by another CPU before an update of the RCU list
+	 * that was made by swiotlb_grow() on this CPU.
+	 *
+	 * Pairs with the smp_rmb() in is_swiotlb_buffer().
+	 */
+	smp_mb();
+}
+
+#else  /* !CONFIG_SWIOTLB_DYNAMIC */
+
+static struct io_tlb_pool *swiotlb_grow(struct device *dev,
+		struct io_tlb_mem *mem)
+{
+	return NULL;
+}
+
+static void swiotlb_check_watermark(struct io_tlb_mem *mem)
+{
+}
+
+static void swiotlb_mark_dyn_user(struct device *dev, struct io_tlb_mem *mem,
+		struct io_tlb_pool *pool)
+{
+}
+
+#endif /* CONFIG_SWIOTLB_DYNAMIC */
+
+/**
+ * swiotlb_find_slots() - search for slots in the whole swiotlb
+ * @dev:		Device which maps the buffer.
+ * @orig_addr:		Original (non-bounced) IO buffer address.
+ * @alloc_size:		Total requested size of the bounce buffer,
+ *			including initial alignment padding.
+ * @alloc_align_mask:	Required alignment of the allocated buffer.
+ * @retpool:		Used memory pool, updated on return.
+ *
+ * Search through the whole software IO TLB to find a sequence of slots that
+ * match the allocation constraints, growing it if allowed and needed.
+ *
+ * Return: Index of the first allocated slot, or -1 on error.
+ */
+static int swiotlb_find_slots(struct device *dev, phys_addr_t orig_addr,
+		size_t alloc_size, unsigned int alloc_align_mask,
+		struct io_tlb_pool **retpool)
+{
+	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
+	struct io_tlb_pool *pool;
+	bool drained = false;
+	u64 start;
+	int index;
+
+	if (swiotlb_pcp_eligible(dev, alloc_size, alloc_align_mask)) {
+		index = swiotlb_pcp_get(mem);
+		if (index >= 0) {
+			mem->defpool.slots[index].alloc_size = alloc_size -
+				swiotlb_align_offset(dev, orig_addr);
+			*retpool = &mem->defpool;
+			return index;
+		}
+	}
+
+	start = search_clock();
+retry:
+	rcu_read_lock();
+	list_for_each_entry_rcu(pool, &mem->pools, node) {
+		if (!swiotlb_pool_usable(dev, mem, pool))
+			continue;
+		index = swiotlb_pool_find_slots(dev, pool, orig_addr,
+						alloc_size, alloc_align_mask);
+		if (index >= 0) {
+			rcu_read_unlock();
+			goto found;
+		}
+	}
+	rcu_read_unlock();
+
+	if (!drained && swiotlb_pcp_drain(mem)) {
+		drained = true;
+		goto retry;
+	}
+
+	pool = swiotlb_grow(dev, mem);
+	index = pool ? swiotlb_pool_find_slots(dev, pool, orig_addr,
+					       alloc_size, alloc_align_mask) : -1;
+	if (index < 0) {
+		inc_alloc_failed(mem);
+		return -1;
+	}
+
+found:
+	account_search(mem, start);
+	swiotlb_mark_dyn_user(dev, mem, pool);
+
+	*retpool = pool;
+	return index;
 }
 
 phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
@@ -730,6 +1553,7 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 {
 	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
 	unsigned int offset = swiotlb_align_offset(dev, orig_addr);
+	struct io_tlb_pool *pool;
 	unsigned int i;
 	int index;
 	phys_addr_t tlb_addr;
@@ -750,7 +1574,7 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 	}
 
 	index = swiotlb_find_slots(dev, orig_addr,
-				   alloc_size + offset, alloc_align_mask);
+				   alloc_size + offset, alloc_align_mask, &pool);
 	if (index == -1) {
 		if (!(attrs & DMA_ATTR_NO_WARN))
 			dev_warn_ratelimited(dev,
@@ -765,8 +1589,8 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 	 * needed.
 	 */
 	for (i = 0; i < nr_slots(alloc_size + offset); i++)
-		mem->slots[index + i].orig_addr = slot_addr(orig_addr, i);
-	tlb_addr = slot_addr(mem->start, index) + offset;
+		pool->slots[index + i].orig_addr = slot_addr(orig_addr, i);
+	tlb_addr = slot_addr(pool->start, index) + offset;
 	/*
 	 * When dir == DMA_FROM_DEVICE we could omit the copy from the orig
 	 * to the tlb buffer, if we knew for sure the device will
@@ -781,48 +1605,20 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 static void swiotlb_release_slots(struct device *dev, phys_addr_t tlb_addr)
 {
 	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
-	unsigned long flags;
 	unsigned int offset = swiotlb_align_offset(dev, tlb_addr);
-	int index = (tlb_addr - offset - mem->start) >> IO_TLB_SHIFT;
-	int nslots = nr_slots(mem->slots[index].alloc_size + offset);
-	int aindex = index / mem->area_nslabs;
-	struct io_tlb_area *area = &mem->areas[aindex];
-	int count, i;
-
-	/*
-	 * Return the buffer to the free list by setting the corresponding
-	 * entries to indicate the number of contiguous entries available.
-	 * While returning the entries to the free list, we merge the entries
-	 * with slots below and above the pool being returned.
-	 */
-	BUG_ON(aindex >= mem->nareas);
+	struct io_tlb_pool *pool;
+	int index, nslots;
 
-	spin_lock_irqsave(&area->lock, flags);
-	if (index + nslots < ALIGN(index + 1, IO_TLB_SEGSIZE))
-		count = mem->slots[index + nslots].list;
-	else
-		count = 0;
+	tlb_addr -= offset;
+	pool = swiotlb_find_pool(dev, tlb_addr);
+	index = (tlb_addr - pool->start) >> IO_TLB_SHIFT;
+	nslots = nr_slots(pool->slots[index].alloc_size + offset);
 
-	/*
-	 * Step 1: return the slots to the free list, merging the slots with
-	 * superceeding slots
-	 */
-	for (i = index + nslots - 1; i >= index; i--) {
-		mem->slots[i].list = ++count;
-		mem->slots[i].orig_addr = INVALID_PHYS_ADDR;
-		mem->slots[i].alloc_size = 0;
-	}
+	if (nslots == 1 && pool == &mem->defpool &&
+	    swiotlb_pcp_put(mem, index))
+		return;
 
-	/*
-	 * Step 2: merge the returned slots with the preceding slots, if
-	 * available (non zero)
-	 */
-	for (i = index - 1;
-	     io_tlb_offset(i) != IO_TLB_SEGSIZE - 1 && mem->slots[i].list;
-	     i--)
-		mem->slots[i].list = ++count;
-	area->used -= nslots;
-	spin_unlock_irqrestore(&area->lock, flags);
+	swiotlb_pool_release(mem, pool, index, nslots);
 }
 
 /*
@@ -917,12 +1713,128 @@ bool is_swiotlb_active(struct device *dev)
 }
 EXPORT_SYMBOL_GPL(is_swiotlb_active);
 
+static int __init swiotlb_pcp_init(void)
+{
+	struct io_tlb_mem *mem = &io_tlb_default_mem;
+	struct io_tlb_pcp __percpu *pcp;
+	int cpu;
+
+	if (!mem->nslabs)
+		return 0;
+
+	pcp = alloc_percpu(struct io_tlb_pcp);
+	if (!pcp)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pcp, cpu)->lock);
+	WRITE_ONCE(mem->pcp, pcp);
+	return 0;
+}
+late_initcall(swiotlb_pcp_init);
+
+#ifdef CONFIG_DEBUG_FS
+
 static int io_tlb_used_get(void *data, u64 *val)
 {
-	*val = mem_used(&io_tlb_default_mem);
+	struct io_tlb_mem *mem = data;
+
+	*val = mem_used(mem);
+	return 0;
+}
+
+static int io_tlb_hiwater_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+
+	*val = mem_hiwater(mem);
+	return 0;
+}
+
+static int io_tlb_hiwater_set(void *data, u64 val)
+{
+	struct io_tlb_mem *mem = data;
+
+	/* Only allow setting to zero */
+	if (val != 0)
+		return -EINVAL;
+
+	reset_hiwater(mem);
+	return 0;
+}
+
+static int io_tlb_alloc_failed_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+
+	*val = atomic_long_read(&mem->alloc_failed);
+	return 0;
+}
+
+static int io_tlb_pcp_hits_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+	int cpu;
+
+	*val = 0;
+	if (!mem->pcp)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		*val += per_cpu_ptr(mem->pcp, cpu)->hits;
+	return 0;
+}
+
+static int io_tlb_search_count_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+
+	*val = atomic_long_read(&mem->search_count);
+	return 0;
+}
+
+static int io_tlb_search_avg_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+	unsigned long count = atomic_long_read(&mem->search_count);
+
+	*val = count ? div64_ul(atomic64_read(&mem->search_ns), count) : 0;
 	return 0;
 }
+
+static int io_tlb_search_max_get(void *data, u64 *val)
+{
+	struct io_tlb_mem *mem = data;
+
+	*val = atomic64_read(&mem->search_ns_max);
+	return 0;
+}
+
+static int io_tlb_search_max_set(void *data, u64 val)
+{
+	struct io_tlb_mem *mem = data;
+
+	/* Only allow setting to zero */
+	if (val != 0)
+		return -EINVAL;
+
+	atomic64_set(&mem->search_ns_max, val);
+	return 0;
+}
+
 DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_used, io_tlb_used_get, NULL, "%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_hiwater, io_tlb_hiwater_get,
+				io_tlb_hiwater_set, "%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_alloc_failed, io_tlb_alloc_failed_get,
+				NULL, "%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_pcp_hits, io_tlb_pcp_hits_get, NULL,
+				"%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_search_count, io_tlb_search_count_get,
+				NULL, "%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_search_avg, io_tlb_search_avg_get, NULL,
+				"%llu\n");
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_search_max, io_tlb_search_max_get,
+				io_tlb_search_max_set, "%llu\n");
 
 static void swiotlb_create_debugfs_files(struct io_tlb_mem *mem,
 					 const char *dirname)
@@ -932,36 +1844,57 @@ static void swiotlb_create_debugfs_files(struct io_tlb_mem *mem,
 		return;
 
 	debugfs_create_ulong("io_tlb_nslabs", 0400, mem->debugfs, &mem->nslabs);
-	debugfs_create_file("io_tlb_used", 0400, mem->debugfs, NULL,
+	debugfs_create_u32("io_tlb_pools", 0400, mem->debugfs, &mem->nr_pools);
+	debugfs_create_file("io_tlb_used", 0400, mem->debugfs, mem,
 			&fops_io_tlb_used);
+	debugfs_create_file("io_tlb_used_hiwater", 0600, mem->debugfs, mem,
+			&fops_io_tlb_hiwater);
+	debugfs_create_file("io_tlb_alloc_failed", 0400, mem->debugfs, mem,
+			&fops_io_tlb_alloc_failed);
+	debugfs_create_file("io_tlb_pcp_hits", 0400, mem->debugfs, mem,
+			&fops_io_tlb_pcp_hits);
+	debugfs_create_file("io_tlb_search_count", 0400, mem->debugfs, mem,
+			&fops_io_tlb_search_count);
+	debugfs_create_file("io_tlb_search_avg_ns", 0400, mem->debugfs, mem,
+			&fops_io_tlb_search_avg);
+	debugfs_create_file("io_tlb_search_max_ns", 0600, mem->debugfs, mem,
+			&fops_io_tlb_search_max);
 }
 
-static int __init __maybe_unused swiotlb_create_default_debugfs(void)
+static int __init swiotlb_create_default_debugfs(void)
 {
 	swiotlb_create_debugfs_files(&io_tlb_default_mem, "swiotlb");
 	return 0;
 }
 
-#ifdef CONFIG_DEBUG_FS
 late_initcall(swiotlb_create_default_debugfs);
-#endif
+
+#else  /* !CONFIG_DEBUG_FS */
+
+static inline void swiotlb_create_debugfs_files(struct io_tlb_mem *mem,
+						const char *dirname)
+{
+}
+
+#endif	/* CONFIG_DEBUG_FS */
 
 #ifdef CONFIG_DMA_RESTRICTED_POOL
 
 struct page *swiotlb_alloc(struct device *dev, size_t size)
 {
 	struct io_tlb_mem *mem = dev->dma_io_tlb_mem;
+	struct io_tlb_pool *pool;
 	phys_addr_t tlb_addr;
 	int index;
 
 	if (!mem)
 		return NULL;
 
-	index = swiotlb_find_slots(dev, 0, size, 0);
+	index = swiotlb_find_slots(dev, 0, size, 0, &pool);
 	if (index == -1)
 		return NULL;
 
-	tlb_addr = slot_addr(mem->start, index);
+	tlb_addr = slot_addr(pool->start, index);
 
 	return pfn_to_page(PFN_DOWN(tlb_addr));
 }
@@ -993,29 +1926,36 @@ static int rmem_swiotlb_device_init(struct reserved_mem *rmem,
 	 * to it.
 	 */
 	if (!mem) {
+		struct io_tlb_pool *pool;
+
 		mem = kzalloc(sizeof(*mem), GFP_KERNEL);
 		if (!mem)
 			return -ENOMEM;
+		pool = &mem->defpool;
 
-		mem->slots = kcalloc(nslabs, sizeof(*mem->slots), GFP_KERNEL);
-		if (!mem->slots) {
+		pool->slots = kcalloc(nslabs, sizeof(*pool->slots), GFP_KERNEL);
+		if (!pool->slots) {
 			kfree(mem);
 			return -ENOMEM;
 		}
 
-		mem->areas = kcalloc(nareas, sizeof(*mem->areas),
+		pool->areas = kcalloc(nareas, sizeof(*pool->areas),
 				GFP_KERNEL);
-		if (!mem->areas) {
-			kfree(mem->slots);
+		if (!pool->areas) {
+			kfree(pool->slots);
 			kfree(mem);
 			return -ENOMEM;
 		}
 
 		set_memory_decrypted((unsigned long)phys_to_virt(rmem->base),
 				     rmem->size >> PAGE_SHIFT);
-		swiotlb_init_io_tlb_mem(mem, rmem->base, nslabs, SWIOTLB_FORCE,
-					false, nareas);
+		swiotlb_init_io_tlb_pool(pool, rmem->base, nslabs,
+					 false, nareas);
+		mem->force_bounce = true;
 		mem->for_alloc = true;
+		INIT_LIST_HEAD(&mem->pools);
+		spin_lock_init(&mem->lock);
+		add_mem_pool(mem, pool);
 
 		rmem->priv = mem;
 
@@ -32,6 +32,7 @@
  *  "But they come in a choice of three flavours!"
  */
 #include <linux/compat.h>
+#include <linux/debugfs.h>
 #include <linux/jhash.h>
 #include <linux/pagemap.h>
 #include <linux/memblock.h>
@@ -529,7 +530,7 @@ struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
 
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock);
+	futex_hb_lock(hb);
 	return hb;
 }
 
@@ -1134,8 +1135,40 @@ static int __init futex_init(void)
 		atomic_set(&futex_queues[i].waiters, 0);
 		plist_head_init(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
+		futex_queues[i].contended = 0;
 	}
 
 	return 0;
 }
 core_initcall(futex_init);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * "<bucket> <contended>" for every bucket of the hash on which a lookup had
+ * to wait for the lock.
+ */
+static int futex_hash_contention_show(struct seq_file *m, void *v)
+{
+	unsigned long i;
+
+	for (i = 0; i < futex_hashsize; i++) {
+		unsigned long contended = data_race(futex_queues[i].contended);
+
+		if (contended)
+			seq_printf(m, "%lu %lu\n", i, contended);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(futex_hash_contention);
+
+static int __init futex_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("futex", NULL);
+
+	debugfs_create_file("hash_contention", 0400, dir, NULL,
+			    &futex_hash_contention_fops);
+	return 0;
+}
+late_initcall(futex_debugfs_init);
+#endif
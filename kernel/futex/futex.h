@@ -46,6 +46,7 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+	unsigned long contended;	/* lookups that had to wait for lock */
 } ____cacheline_aligned_in_smp;
 
 /*
@@ -216,6 +217,20 @@ static inline int futex_hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+/*
+ * Take hb->lock, counting the acquisitions that found it held. The counter
+ * is only written under the lock, so this costs nothing extra when the
+ * bucket is uncontended.
+ */
+static inline void futex_hb_lock(struct futex_hash_bucket *hb)
+	__acquires(&hb->lock)
+{
+	if (unlikely(!spin_trylock(&hb->lock))) {
+		spin_lock(&hb->lock);
+		hb->contended++;
+	}
+}
+
 extern struct futex_hash_bucket *futex_q_lock(struct futex_q *q);
 extern void futex_q_unlock(struct futex_hash_bucket *hb);
 
@@ -241,7 +256,7 @@ double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 	if (hb1 > hb2)
 		swap(hb1, hb2);
 
-	spin_lock(&hb1->lock);
+	futex_hb_lock(hb1);
 	if (hb1 != hb2)
 		spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
 }
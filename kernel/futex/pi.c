@@ -1122,7 +1122,7 @@ int futex_unlock_pi(u32 __user *uaddr, unsigned int flags)
 		return ret;
 
 	hb = futex_hash(&key);
-	spin_lock(&hb->lock);
+	futex_hb_lock(hb);
 
 	/*
 	 * Check waiters first. We do not trust user space values at
@@ -161,7 +161,7 @@ int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!futex_hb_waiters_pending(hb))
 		return ret;
 
-	spin_lock(&hb->lock);
+	futex_hb_lock(hb);
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (futex_match (&this->key, &key)) {
@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * In-kernel interrupt affinity balancing
+ *
+ * Every interval the rate of each interrupt is sampled from its counters,
+ * and the interrupt load of each CPU from kstat_cpu_irqs_sum(). CPU loads
+ * are scaled by CPU capacity, so a LITTLE core counts as busier than a big
+ * one handling the same rate. Movable interrupts are then
+ *
+ *  - moved off CPUs which are not housekeeping CPUs,
+ *  - moved to the least loaded highest capacity CPU when they fire more
+ *    often than irq_balance.big_rate, on asymmetric systems,
+ *  - moved from the most loaded CPU to the least loaded one, largest first,
+ *    as long as the load differs by more than irq_balance.imbalance_pct
+ *    and the move lowers the peak.
+ *
+ * Movable means that user space could set the affinity, minus per-CPU and
+ * NMI lines, and that nobody else pinned it: the affinity still covers all
+ * default CPUs or is still the single CPU the balancer picked. Whatever
+ * /proc/irq/N/smp_affinity or a driver affinity hint sets is left alone.
+ */
+
+#include <linux/cpu.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/isolation.h>
+#include <linux/sched/topology.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "irq_balance."
+
+static unsigned int interval_ms = 2000;
+module_param(interval_ms, uint, 0644);
+MODULE_PARM_DESC(interval_ms, "Sampling interval in milliseconds");
+
+static unsigned int big_rate = 1000;
+module_param(big_rate, uint, 0644);
+MODULE_PARM_DESC(big_rate, "Interrupts per second above which an interrupt belongs on a big CPU, 0 = never");
+
+static unsigned int imbalance_pct = 25;
+module_param(imbalance_pct, uint, 0644);
+MODULE_PARM_DESC(imbalance_pct, "Load difference in percent tolerated between CPUs");
+
+static unsigned int max_moves = 4;
+module_param(max_moves, uint, 0644);
+MODULE_PARM_DESC(max_moves, "Interrupts moved per interval at most");
+
+static unsigned int cooldown = 5;
+module_param(cooldown, uint, 0644);
+MODULE_PARM_DESC(cooldown, "Intervals before a moved interrupt is considered again");
+
+static bool enable;
+static int irq_balance_set_enable(const char *val, const struct kernel_param *kp);
+static const struct kernel_param_ops irq_balance_enable_ops = {
+	.set = irq_balance_set_enable,
+	.get = param_get_bool,
+};
+module_param_cb(enable, &irq_balance_enable_ops, &enable, 0644);
+MODULE_PARM_DESC(enable, "Balance interrupt affinities");
+
+struct irq_balance_cpu {
+	unsigned long	last_sum;
+	unsigned int	rate;		/* interrupts per second */
+	unsigned int	load;		/* rate scaled by capacity */
+	unsigned long	capacity;
+};
+
+struct irq_balance_irq {
+	unsigned int	irq;
+	unsigned int	rate;
+	unsigned int	cpu;
+	bool		cooling;
+};
+
+#define IRQ_BALANCE_LOG		64
+
+struct irq_balance_move {
+	u64		time;
+	unsigned int	irq;
+	unsigned int	rate;
+	unsigned int	from, to;
+	const char	*why;
+};
+
+static DEFINE_PER_CPU(struct irq_balance_cpu, irq_balance_cpus);
+
+/* Serializes the balancer runs and protects everything below. */
+static DEFINE_MUTEX(irq_balance_mutex);
+static unsigned long irq_balance_last;	/* jiffies of the last sample */
+static bool irq_balance_primed;
+static bool irq_balance_ready;
+static unsigned long irq_balance_runs, irq_balance_nr_moves;
+static struct irq_balance_move irq_balance_log[IRQ_BALANCE_LOG];
+static unsigned int irq_balance_log_next;
+
+static void irq_balance_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(irq_balance_work, irq_balance_work_fn);
+
+static unsigned int irq_balance_scale(unsigned int rate, unsigned int cpu)
+{
+	struct irq_balance_cpu *bc = per_cpu_ptr(&irq_balance_cpus, cpu);
+
+	return div64_ul((u64)rate * SCHED_CAPACITY_SCALE, bc->capacity);
+}
+
+static unsigned int irq_balance_load(unsigned int cpu)
+{
+	return per_cpu_ptr(&irq_balance_cpus, cpu)->load;
+}
+
+static unsigned int irq_balance_idlest(const struct cpumask *mask)
+{
+	unsigned int cpu, best = nr_cpu_ids;
+
+	for_each_cpu(cpu, mask)
+		if (best >= nr_cpu_ids ||
+		    irq_balance_load(cpu) < irq_balance_load(best))
+			best = cpu;
+	return best;
+}
+
+static void irq_balance_sample_cpus(unsigned long elapsed_ms)
+{
+	unsigned int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct irq_balance_cpu *bc = per_cpu_ptr(&irq_balance_cpus, cpu);
+		unsigned long sum = kstat_cpu_irqs_sum(cpu);
+
+		bc->rate = div64_ul((u64)(sum - bc->last_sum) * MSEC_PER_SEC,
+				    elapsed_ms);
+		bc->last_sum = sum;
+		bc->capacity = max(arch_scale_cpu_capacity(cpu), 1UL);
+		bc->load = irq_balance_scale(bc->rate, cpu);
+	}
+}
+
+/*
+ * Samples the rate of @desc and returns whether the balancer may move it.
+ * @cpu is set to the CPU the interrupt is currently delivered to.
+ */
+static bool irq_balance_sample_irq(struct irq_desc *desc,
+				   unsigned long elapsed_ms,
+				   const struct cpumask *defaults,
+				   unsigned int *cpu)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+	const struct cpumask *aff, *eff;
+	unsigned int count;
+	bool movable = false;
+
+	raw_spin_lock_irq(&desc->lock);
+	count = desc->tot_count;
+	desc->balance_rate = div64_ul((u64)(count - desc->balance_last_count) *
+				      MSEC_PER_SEC, elapsed_ms);
+	desc->balance_last_count = count;
+
+	if (!desc->action || irqd_is_per_cpu(d) || (desc->istate & IRQS_NMI) ||
+	    !irq_can_set_affinity_usr(d->irq))
+		goto out;
+
+	aff = irq_data_get_affinity_mask(d);
+	if (desc->balance_cpu >= 0) {
+		/* Somebody else set the affinity since, hands off. */
+		if (!cpumask_equal(aff, cpumask_of(desc->balance_cpu))) {
+			desc->balance_cpu = -1;
+			goto out;
+		}
+	} else if (!cpumask_subset(defaults, aff)) {
+		goto out;
+	}
+
+	eff = irq_data_get_effective_affinity_mask(d);
+	*cpu = cpumask_first_and(eff, cpu_online_mask);
+	if (*cpu >= nr_cpu_ids)
+		*cpu = cpumask_first_and(aff, cpu_online_mask);
+	movable = *cpu < nr_cpu_ids;
+out:
+	raw_spin_unlock_irq(&desc->lock);
+	return movable;
+}
+
+static void irq_balance_move(struct irq_balance_irq *c, unsigned int to,
+			     const char *why)
+{
+	struct irq_balance_cpu *from_bc = per_cpu_ptr(&irq_balance_cpus, c->cpu);
+	struct irq_balance_cpu *to_bc = per_cpu_ptr(&irq_balance_cpus, to);
+	struct irq_balance_move *m;
+	struct irq_desc *desc;
+
+	if (irq_set_affinity(c->irq, cpumask_of(to)))
+		return;
+
+	desc = irq_to_desc(c->irq);
+	raw_spin_lock_irq(&desc->lock);
+	desc->balance_cpu = to;
+	desc->balance_moved = jiffies ? : 1;
+	raw_spin_unlock_irq(&desc->lock);
+
+	from_bc->load -= min(from_bc->load, irq_balance_scale(c->rate, c->cpu));
+	to_bc->load += irq_balance_scale(c->rate, to);
+
+	m = &irq_balance_log[irq_balance_log_next++ % IRQ_BALANCE_LOG];
+	m->time = local_clock();
+	m->irq = c->irq;
+	m->rate = c->rate;
+	m->from = c->cpu;
+	m->to = to;
+	m->why = why;
+	irq_balance_nr_moves++;
+
+	c->cpu = to;
+	c->cooling = true;
+}
+
+/* Picks the largest interrupt on @busiest whose move lowers the peak load. */
+static struct irq_balance_irq *
+irq_balance_pick(struct irq_balance_irq *cands, unsigned int nr,
+		 unsigned int busiest, const struct cpumask *allowed,
+		 const struct cpumask *big, unsigned int *target)
+{
+	struct irq_balance_irq *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct irq_balance_irq *c = &cands[i];
+		const struct cpumask *to_mask = allowed;
+		unsigned int to;
+
+		if (c->cpu != busiest || c->cooling || !c->rate)
+			continue;
+		if (best && c->rate <= best->rate)
+			continue;
+
+		/* Don't undo the big core placement for load reasons. */
+		if (big && big_rate && c->rate >= big_rate)
+			to_mask = big;
+		to = irq_balance_idlest(to_mask);
+		if (to >= nr_cpu_ids || to == busiest)
+			continue;
+		if (irq_balance_load(to) + irq_balance_scale(c->rate, to) >=
+		    irq_balance_load(busiest))
+			continue;
+
+		best = c;
+		*target = to;
+	}
+
+	return best;
+}
+
+static void irq_balance_run(struct cpumask *allowed, struct cpumask *defaults,
+			    struct cpumask *big)
+{
+	unsigned long elapsed_ms, now = jiffies, max_cap = 0;
+	unsigned long cool = cooldown * msecs_to_jiffies(interval_ms);
+	struct irq_balance_irq *cands;
+	unsigned int nr = 0, moves = 0, limit = max_moves;
+	unsigned int i, irq, cpu;
+
+	elapsed_ms = max(jiffies_to_msecs(now - irq_balance_last), 1U);
+	irq_balance_last = now;
+	irq_balance_runs++;
+
+	cpumask_and(defaults, irq_default_affinity, cpu_online_mask);
+	cpumask_and(allowed, defaults, housekeeping_cpumask(HK_TYPE_DOMAIN));
+	cpumask_and(allowed, allowed, housekeeping_cpumask(HK_TYPE_MANAGED_IRQ));
+
+	irq_balance_sample_cpus(elapsed_ms);
+
+	for_each_cpu(cpu, allowed)
+		max_cap = max(max_cap, arch_scale_cpu_capacity(cpu));
+	cpumask_clear(big);
+	for_each_cpu(cpu, allowed)
+		if (arch_scale_cpu_capacity(cpu) == max_cap)
+			__cpumask_set_cpu(cpu, big);
+
+	cands = kvmalloc_array(nr_irqs, sizeof(*cands), GFP_KERNEL);
+
+	for_each_active_irq(irq) {
+		struct irq_desc *desc = irq_to_desc(irq);
+		struct irq_balance_irq *c;
+
+		if (!desc)
+			continue;
+		if (!irq_balance_sample_irq(desc, elapsed_ms, defaults, &cpu) ||
+		    !cands)
+			continue;
+
+		c = &cands[nr++];
+		c->irq = irq;
+		c->rate = desc->balance_rate;
+		c->cpu = cpu;
+		c->cooling = desc->balance_moved &&
+			     time_before(now, desc->balance_moved + cool);
+	}
+
+	/* The first run after enabling only establishes the baseline. */
+	if (!irq_balance_primed || !cands || cpumask_empty(allowed)) {
+		irq_balance_primed = true;
+		goto out;
+	}
+
+	/* Symmetric systems have no big cores to prefer. */
+	if (cpumask_equal(big, allowed))
+		big = NULL;
+
+	for (i = 0; i < nr && moves < limit; i++) {
+		struct irq_balance_irq *c = &cands[i];
+
+		if (cpumask_test_cpu(c->cpu, allowed))
+			continue;
+		irq_balance_move(c, irq_balance_idlest(allowed), "isolated");
+		moves++;
+	}
+
+	for (i = 0; big && big_rate && i < nr && moves < limit; i++) {
+		struct irq_balance_irq *c = &cands[i];
+
+		if (c->cooling || c->rate < big_rate ||
+		    cpumask_test_cpu(c->cpu, big))
+			continue;
+		irq_balance_move(c, irq_balance_idlest(big), "capacity");
+		moves++;
+	}
+
+	while (moves < limit) {
+		unsigned int busiest = nr_cpu_ids, idlest, to;
+		struct irq_balance_irq *c;
+
+		for_each_cpu(cpu, allowed)
+			if (busiest >= nr_cpu_ids ||
+			    irq_balance_load(cpu) > irq_balance_load(busiest))
+				busiest = cpu;
+		idlest = irq_balance_idlest(allowed);
+		if ((u64)irq_balance_load(busiest) * 100 <=
+		    (u64)irq_balance_load(idlest) * (100 + imbalance_pct))
+			break;
+
+		c = irq_balance_pick(cands, nr, busiest, allowed, big, &to);
+		if (!c)
+			break;
+		irq_balance_move(c, to, "load");
+		moves++;
+	}
+out:
+	kvfree(cands);
+}
+
+static void irq_balance_work_fn(struct work_struct *work)
+{
+	cpumask_var_t allowed, defaults, big;
+
+	if (!READ_ONCE(enable))
+		return;
+
+	if (zalloc_cpumask_var(&allowed, GFP_KERNEL) &&
+	    zalloc_cpumask_var(&defaults, GFP_KERNEL) &&
+	    zalloc_cpumask_var(&big, GFP_KERNEL)) {
+		mutex_lock(&irq_balance_mutex);
+		cpus_read_lock();
+		irq_lock_sparse();
+		irq_balance_run(allowed, defaults, big);
+		irq_unlock_sparse();
+		cpus_read_unlock();
+		mutex_unlock(&irq_balance_mutex);
+	}
+	free_cpumask_var(big);
+	free_cpumask_var(defaults);
+	free_cpumask_var(allowed);
+
+	if (READ_ONCE(enable))
+		queue_delayed_work(system_unbound_wq, &irq_balance_work,
+				   msecs_to_jiffies(max(interval_ms, 10U)));
+}
+
+static void irq_balance_start(void)
+{
+	mutex_lock(&irq_balance_mutex);
+	irq_balance_primed = false;
+	irq_balance_last = jiffies;
+	mutex_unlock(&irq_balance_mutex);
+	mod_delayed_work(system_unbound_wq, &irq_balance_work, 0);
+}
+
+static int irq_balance_set_enable(const char *val, const struct kernel_param *kp)
+{
+	bool was = enable;
+	int ret;
+
+	ret = param_set_bool(val, kp);
+	if (ret || !irq_balance_ready)
+		return ret;
+
+	if (enable && !was)
+		irq_balance_start();
+	else if (!enable)
+		cancel_delayed_work_sync(&irq_balance_work);
+	return 0;
+}
+
+static int __init irq_balance_init(void)
+{
+	irq_balance_ready = true;
+	if (enable)
+		irq_balance_start();
+	return 0;
+}
+late_initcall(irq_balance_init);
+
+#ifdef CONFIG_GENERIC_IRQ_DEBUGFS
+static int irq_balance_show(struct seq_file *m, void *p)
+{
+	unsigned int cpu, i, n;
+
+	mutex_lock(&irq_balance_mutex);
+	seq_printf(m, "enabled %d runs %lu moves %lu\n", READ_ONCE(enable),
+		   irq_balance_runs, irq_balance_nr_moves);
+
+	seq_printf(m, "\n%4s %8s %10s %10s %s\n", "cpu", "capacity", "irq/s",
+		   "load", "flags");
+	for_each_online_cpu(cpu) {
+		struct irq_balance_cpu *bc = per_cpu_ptr(&irq_balance_cpus, cpu);
+
+		seq_printf(m, "%4u %8lu %10u %10u%s\n", cpu,
+			   arch_scale_cpu_capacity(cpu), bc->rate, bc->load,
+			   housekeeping_cpu(cpu, HK_TYPE_DOMAIN) &&
+			   housekeeping_cpu(cpu, HK_TYPE_MANAGED_IRQ) ?
+			   "" : " isolated");
+	}
+
+	seq_printf(m, "\n%14s %6s %10s %4s %4s %s\n", "time", "irq", "irq/s",
+		   "from", "to", "reason");
+	n = min_t(unsigned int, irq_balance_log_next, IRQ_BALANCE_LOG);
+	for (i = irq_balance_log_next - n; i != irq_balance_log_next; i++) {
+		struct irq_balance_move *mv = &irq_balance_log[i % IRQ_BALANCE_LOG];
+		u64 ts = mv->time;
+		unsigned long rem = do_div(ts, NSEC_PER_SEC);
+
+		seq_printf(m, "%7llu.%06lu %6u %10u %4u %4u %s\n", ts,
+			   rem / NSEC_PER_USEC, mv->irq, mv->rate, mv->from,
+			   mv->to, mv->why);
+	}
+	mutex_unlock(&irq_balance_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(irq_balance);
+
+void __init irq_balance_debugfs_init(struct dentry *root)
+{
+	debugfs_create_file("balance", 0444, root, NULL, &irq_balance_fops);
+}
+#endif
@@ -249,6 +249,7 @@ static int __init irq_debugfs_init(void)
 	root_dir = debugfs_create_dir("irq", NULL);
 
 	irq_domain_debugfs_init(root_dir);
+	irq_balance_debugfs_init(root_dir);
 
 	irq_dir = debugfs_create_dir("irqs", root_dir);
 
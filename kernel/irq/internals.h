@@ -293,10 +293,13 @@ irq_pm_remove_action(struct irq_desc *desc, struct irqaction *action) { }
  * struct irq_timings - irq timings storing structure
  * @values: a circular buffer of u64 encoded <timestamp,irq> values
  * @count: the number of elements in the array
+ * @flushed: elements were consumed by irq_timings_next_irq_event() since
+ *	     the last irq_timings_next_event()
  */
 struct irq_timings {
 	u64	values[IRQ_TIMINGS_SIZE];
 	int	count;
+	bool	flushed;
 };
 
 DECLARE_PER_CPU(struct irq_timings, irq_timings);
@@ -501,6 +504,13 @@ static inline void irq_domain_debugfs_init(struct dentry *root)
 {
 }
 # endif
+# ifdef CONFIG_IRQ_BALANCE
+void irq_balance_debugfs_init(struct dentry *root);
+# else
+static inline void irq_balance_debugfs_init(struct dentry *root)
+{
+}
+# endif
 #else /* CONFIG_GENERIC_IRQ_DEBUGFS */
 static inline void irq_add_debugfs_entry(unsigned int irq, struct irq_desc *d)
 {
@@ -124,6 +124,12 @@ static void desc_set_defaults(unsigned int irq, struct irq_desc *desc, int node,
 	desc->owner = owner;
 	for_each_possible_cpu(cpu)
 		*per_cpu_ptr(desc->kstat_irqs, cpu) = 0;
+#ifdef CONFIG_IRQ_BALANCE
+	desc->balance_last_count = 0;
+	desc->balance_rate = 0;
+	desc->balance_moved = 0;
+	desc->balance_cpu = -1;
+#endif
 	desc_smp_init(desc, node, affinity);
 }
 
@@ -23,15 +23,21 @@ DEFINE_PER_CPU(struct irq_timings, irq_timings);
 
 static DEFINE_IDR(irqt_stats);
 
+/*
+ * The users of the predictions (the menu governor, network drivers) turn
+ * the recording on and off independently, so enable and disable nest.
+ */
 void irq_timings_enable(void)
 {
-	static_branch_enable(&irq_timing_enabled);
+	static_branch_inc(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_enable);
 
 void irq_timings_disable(void)
 {
-	static_branch_disable(&irq_timing_enabled);
+	static_branch_dec(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_disable);
 
 /*
  * The main goal of this algorithm is to predict the next interrupt
@@ -507,6 +513,34 @@ static inline void irq_timings_store(int irq, struct irqt_stat *irqs, u64 ts)
 	__irq_timings_store(irq, irqs, interval);
 }
 
+static void irq_timings_flush(struct irq_timings *irqts)
+{
+	struct irqt_stat __percpu *s;
+	u64 ts;
+	int i, irq;
+
+	/*
+	 * Number of elements in the circular buffer: If it happens it
+	 * was flushed before, then the number of elements could be
+	 * smaller than IRQ_TIMINGS_SIZE, so the count is used,
+	 * otherwise the array size is used as we wrapped. The index
+	 * begins from zero when we did not wrap. That could be done
+	 * in a nicer way with the proper circular array structure
+	 * type but with the cost of extra computation in the
+	 * interrupt handler hot path. We choose efficiency.
+	 *
+	 * Inject measured irq/timestamp to the pattern prediction
+	 * model while decrementing the counter because we consume the
+	 * data from our circular buffer.
+	 */
+	for_each_irqts(i, irqts) {
+		irq = irq_timing_decode(irqts->values[i], &ts);
+		s = idr_find(&irqt_stats, irq);
+		if (s)
+			irq_timings_store(irq, this_cpu_ptr(s), ts);
+	}
+}
+
 /**
  * irq_timings_next_event - Return when the next event is supposed to arrive
  *
@@ -539,7 +573,7 @@ u64 irq_timings_next_event(u64 now)
 	struct irqt_stat *irqs;
 	struct irqt_stat __percpu *s;
 	u64 ts, next_evt = U64_MAX;
-	int i, irq = 0;
+	int i;
 
 	/*
 	 * This function must be called with the local irq disabled in
@@ -548,29 +582,15 @@ u64 irq_timings_next_event(u64 now)
 	 */
 	lockdep_assert_irqs_disabled();
 
-	if (!irqts->count)
-		return next_evt;
-
 	/*
-	 * Number of elements in the circular buffer: If it happens it
-	 * was flushed before, then the number of elements could be
-	 * smaller than IRQ_TIMINGS_SIZE, so the count is used,
-	 * otherwise the array size is used as we wrapped. The index
-	 * begins from zero when we did not wrap. That could be done
-	 * in a nicer way with the proper circular array structure
-	 * type but with the cost of extra computation in the
-	 * interrupt handler hot path. We choose efficiency.
-	 *
-	 * Inject measured irq/timestamp to the pattern prediction
-	 * model while decrementing the counter because we consume the
-	 * data from our circular buffer.
+	 * Events consumed by irq_timings_next_irq_event() since the
+	 * last call count as activity too.
 	 */
-	for_each_irqts(i, irqts) {
-		irq = irq_timing_decode(irqts->values[i], &ts);
-		s = idr_find(&irqt_stats, irq);
-		if (s)
-			irq_timings_store(irq, this_cpu_ptr(s), ts);
-	}
+	if (!irqts->count && !irqts->flushed)
+		return next_evt;
+	irqts->flushed = false;
+
+	irq_timings_flush(irqts);
 
 	/*
 	 * Look in the list of interrupts' statistics, the earliest
@@ -591,6 +611,69 @@ u64 irq_timings_next_event(u64 now)
 	return next_evt;
 }
 
+/**
+ * irq_timings_next_irq_event - Return when an interrupt is expected next
+ * @irq: the interrupt number
+ * @now: the current local_clock() time
+ *
+ * Same as irq_timings_next_event(), but for a single interrupt and as
+ * seen from the current CPU only. Must be called with the local irq
+ * disabled.
+ *
+ * Returns a nanosec time based estimation of the next occurrence of
+ * @irq, U64_MAX otherwise.
+ */
+u64 irq_timings_next_irq_event(unsigned int irq, u64 now)
+{
+	struct irq_timings *irqts = this_cpu_ptr(&irq_timings);
+	struct irqt_stat __percpu *s;
+
+	lockdep_assert_irqs_disabled();
+
+	if (irqts->count) {
+		irq_timings_flush(irqts);
+		irqts->flushed = true;
+	}
+
+	s = idr_find(&irqt_stats, irq);
+	if (!s)
+		return U64_MAX;
+
+	return __irq_timings_next_event(this_cpu_ptr(s), irq, now);
+}
+
+/**
+ * irq_timings_predict_ns - Time until an interrupt is expected next
+ * @irq: the interrupt number
+ * @max_ns: the longest interval of interest
+ *
+ * Meant for NAPI drivers deciding at the end of a poll whether to
+ * re-enable their interrupt or to keep it masked and poll again from a
+ * timer when the next packet is due. The latter saves an interrupt and
+ * the wakeup latency when the traffic is regular.
+ *
+ * Returns the number of nanoseconds until @irq is expected to fire
+ * again on this CPU if that is at most @max_ns, 0 if it is not or if
+ * there is no prediction. Nothing is predicted unless the recording was
+ * turned on with irq_timings_enable().
+ */
+u64 irq_timings_predict_ns(unsigned int irq, u64 max_ns)
+{
+	unsigned long flags;
+	u64 now, next;
+
+	local_irq_save(flags);
+	now = local_clock();
+	next = irq_timings_next_irq_event(irq, now);
+	local_irq_restore(flags);
+
+	if (next == U64_MAX || next <= now || next - now > max_ns)
+		return 0;
+
+	return next - now;
+}
+EXPORT_SYMBOL_GPL(irq_timings_predict_ns);
+
 void irq_timings_free(int irq)
 {
 	struct irqt_stat __percpu *s;
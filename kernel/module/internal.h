@@ -12,6 +12,7 @@
 #include <linux/rculist.h>
 #include <linux/rcupdate.h>
 #include <linux/mm.h>
+#include <linux/sched/clock.h>
 
 #ifndef ARCH_SHF_SMALL
 #define ARCH_SHF_SMALL 0
@@ -42,6 +43,10 @@ static inline unsigned int strict_align(unsigned int size)
 extern struct mutex module_mutex;
 extern struct list_head modules;
 
+#ifdef CONFIG_DEBUG_FS
+extern struct dentry *mod_debugfs_root;
+#endif
+
 extern struct module_attribute *modinfo_attrs[];
 extern size_t modinfo_attrs_count;
 
@@ -53,6 +58,15 @@ extern const struct kernel_symbol __stop___ksymtab_gpl[];
 extern const s32 __start___kcrctab[];
 extern const s32 __start___kcrctab_gpl[];
 
+/* Phases of load_module() timed by CONFIG_MODULE_LOAD_STATS */
+enum mod_stats_phase {
+	MOD_STATS_LAYOUT,	/* checks, layout and allocation */
+	MOD_STATS_SYMBOLS,	/* simplify_symbols() */
+	MOD_STATS_RELOCS,	/* apply_relocations() */
+	MOD_STATS_TOTAL,	/* everything before do_init_module() */
+	MOD_STATS_NR,
+};
+
 #include <linux/dynamic_debug.h>
 struct load_info {
 	const char *name;
@@ -76,6 +90,10 @@ struct load_info {
 	struct {
 		unsigned int sym, str, mod, vers, info, pcpu;
 	} index;
+#ifdef CONFIG_MODULE_LOAD_STATS
+	u64 stats_ns[MOD_STATS_NR];
+	unsigned int stats_reloc_workers;
+#endif
 };
 
 enum mod_license {
@@ -83,6 +101,18 @@ enum mod_license {
 	GPL_ONLY,
 };
 
+struct symsearch {
+	const struct kernel_symbol *start, *stop;
+	const s32 *crcs;
+	enum mod_license license;
+};
+
+#ifndef CONFIG_MODVERSIONS
+#define symversion(base, idx) NULL
+#else
+#define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
+#endif
+
 struct find_symbol_arg {
 	/* Input */
 	const char *name;
@@ -117,6 +147,15 @@ static inline void module_assert_mutex_or_preempt(void)
 #endif
 }
 
+static inline const char *kernel_symbol_name(const struct kernel_symbol *sym)
+{
+#ifdef CONFIG_HAVE_ARCH_PREL32_RELOCATIONS
+	return offset_to_ptr(&sym->name_offset);
+#else
+	return sym->name;
+#endif
+}
+
 static inline unsigned long kernel_symbol_value(const struct kernel_symbol *sym)
 {
 #ifdef CONFIG_HAVE_ARCH_PREL32_RELOCATIONS
@@ -169,6 +208,73 @@ static inline void print_unloaded_tainted_modules(void)
 }
 #endif /* CONFIG_MODULE_UNLOAD_TAINT_TRACKING */
 
+#ifdef CONFIG_MODULE_SYMBOL_HASH
+int mod_symhash_find(struct find_symbol_arg *fsa);
+int mod_symhash_add(struct module *mod);
+void mod_symhash_del(struct module *mod);
+void mod_symhash_free(struct module *mod);
+#else /* !CONFIG_MODULE_SYMBOL_HASH */
+static inline int mod_symhash_find(struct find_symbol_arg *fsa)
+{
+	return -EAGAIN;
+}
+
+static inline int mod_symhash_add(struct module *mod)
+{
+	return 0;
+}
+
+static inline void mod_symhash_del(struct module *mod) { }
+static inline void mod_symhash_free(struct module *mod) { }
+#endif /* CONFIG_MODULE_SYMBOL_HASH */
+
+#ifdef CONFIG_MODULE_PARALLEL_RELOCS
+int module_apply_relocs_parallel(struct module *mod,
+				 const struct load_info *info);
+#else /* !CONFIG_MODULE_PARALLEL_RELOCS */
+static inline int module_apply_relocs_parallel(struct module *mod,
+					       const struct load_info *info)
+{
+	return -EAGAIN;
+}
+#endif /* CONFIG_MODULE_PARALLEL_RELOCS */
+
+#ifdef CONFIG_MODULE_LOAD_STATS
+void mod_stats_record(const struct module *mod, const struct load_info *info);
+void mod_stats_failed(void);
+
+static inline u64 mod_stats_clock(void)
+{
+	return local_clock();
+}
+
+static inline void mod_stats_account(struct load_info *info,
+				     enum mod_stats_phase phase, u64 start)
+{
+	info->stats_ns[phase] += local_clock() - start;
+}
+
+static inline void mod_stats_reloc_workers(struct load_info *info,
+					   unsigned int nr)
+{
+	info->stats_reloc_workers = nr;
+}
+#else /* !CONFIG_MODULE_LOAD_STATS */
+static inline void mod_stats_record(const struct module *mod,
+				    const struct load_info *info) { }
+static inline void mod_stats_failed(void) { }
+
+static inline u64 mod_stats_clock(void)
+{
+	return 0;
+}
+
+static inline void mod_stats_account(struct load_info *info,
+				     enum mod_stats_phase phase, u64 start) { }
+static inline void mod_stats_reloc_workers(struct load_info *info,
+					   unsigned int nr) { }
+#endif /* CONFIG_MODULE_LOAD_STATS */
+
 #ifdef CONFIG_MODULE_DECOMPRESS
 int module_decompress(struct load_info *info, const void *buf, size_t size);
 void module_decompress_cleanup(struct load_info *info);
@@ -17,6 +17,7 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/kernel_read_file.h>
+#include <linux/debugfs.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/elf.h>
@@ -88,12 +89,6 @@ struct mod_tree_root mod_data_tree __cacheline_aligned = {
 #define module_addr_min mod_tree.addr_min
 #define module_addr_max mod_tree.addr_max
 
-struct symsearch {
-	const struct kernel_symbol *start, *stop;
-	const s32 *crcs;
-	enum mod_license license;
-};
-
 /*
  * Bounds of module text, for speeding up __module_address.
  * Protected by module_mutex.
@@ -238,21 +233,6 @@ static __maybe_unused void *any_section_objs(const struct load_info *info,
 	return (void *)info->sechdrs[sec].sh_addr;
 }
 
-#ifndef CONFIG_MODVERSIONS
-#define symversion(base, idx) NULL
-#else
-#define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
-#endif
-
-static const char *kernel_symbol_name(const struct kernel_symbol *sym)
-{
-#ifdef CONFIG_HAVE_ARCH_PREL32_RELOCATIONS
-	return offset_to_ptr(&sym->name_offset);
-#else
-	return sym->name;
-#endif
-}
-
 static const char *kernel_symbol_namespace(const struct kernel_symbol *sym)
 {
 #ifdef CONFIG_HAVE_ARCH_PREL32_RELOCATIONS
@@ -291,11 +271,7 @@ static bool find_exported_symbol_in_section(const struct symsearch *syms,
 	return true;
 }
 
-/*
- * Find an exported symbol and return it, along with, (optional) crc and
- * (optional) module which owns it.  Needs preempt disabled or module_mutex.
- */
-bool find_symbol(struct find_symbol_arg *fsa)
+static bool find_symbol_in_tables(struct find_symbol_arg *fsa)
 {
 	static const struct symsearch arr[] = {
 		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
@@ -307,8 +283,6 @@ bool find_symbol(struct find_symbol_arg *fsa)
 	struct module *mod;
 	unsigned int i;
 
-	module_assert_mutex_or_preempt();
-
 	for (i = 0; i < ARRAY_SIZE(arr); i++)
 		if (find_exported_symbol_in_section(&arr[i], NULL, fsa))
 			return true;
@@ -331,6 +305,23 @@ bool find_symbol(struct find_symbol_arg *fsa)
 				return true;
 	}
 
+	return false;
+}
+
+/*
+ * Find an exported symbol and return it, along with, (optional) crc and
+ * (optional) module which owns it.  Needs preempt disabled or module_mutex.
+ */
+bool find_symbol(struct find_symbol_arg *fsa)
+{
+	int err;
+
+	module_assert_mutex_or_preempt();
+
+	err = mod_symhash_find(fsa);
+	if (!err || (err == -EAGAIN && find_symbol_in_tables(fsa)))
+		return true;
+
 	pr_debug("Failed to find symbol %s\n", fsa->name);
 	return false;
 }
@@ -1180,10 +1171,12 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	mod_symhash_del(mod);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU-sched synchronizing before releasing mod->list and buglist. */
 	synchronize_rcu();
+	mod_symhash_free(mod);
 	if (try_add_tainted_module(mod))
 		pr_err("%s: adding tainted module to the unloaded tainted modules list failed.\n",
 		       mod->name);
@@ -1346,10 +1339,21 @@ static int simplify_symbols(struct module *mod, const struct load_info *info)
 	return ret;
 }
 
-static int apply_relocations(struct module *mod, const struct load_info *info)
+static int apply_relocations(struct module *mod, struct load_info *info)
 {
 	unsigned int i;
-	int err = 0;
+	int err;
+
+	/* Large modules may be relocated by several CPUs at once. */
+	err = module_apply_relocs_parallel(mod, info);
+	if (err != -EAGAIN) {
+		if (err < 0)
+			return err;
+		mod_stats_reloc_workers(info, err);
+		return 0;
+	}
+	mod_stats_reloc_workers(info, 1);
+	err = 0;
 
 	/* Now do relocations. */
 	for (i = 1; i < info->hdr->e_shnum; i++) {
@@ -2607,6 +2611,11 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (module_check_misalignment(mod))
 		goto out_misaligned;
 
+	/* Visible to find_symbol() from here, like on the modules list. */
+	err = mod_symhash_add(mod);
+	if (err < 0)
+		goto out;
+
 	module_enable_ro(mod, false);
 	module_enable_nx(mod);
 	module_enable_x(mod);
@@ -2674,6 +2683,9 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	struct module *mod;
 	long err = 0;
 	char *after_dashes;
+	u64 start, t;
+
+	start = mod_stats_clock();
 
 	/*
 	 * Do the signature check (if any) first. All that
@@ -2778,12 +2790,18 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Set up MODINFO_ATTR fields */
 	setup_modinfo(mod, info);
 
+	mod_stats_account(info, MOD_STATS_LAYOUT, start);
+
 	/* Fix up syms, so that st_value is a pointer to location. */
+	t = mod_stats_clock();
 	err = simplify_symbols(mod, info);
+	mod_stats_account(info, MOD_STATS_SYMBOLS, t);
 	if (err < 0)
 		goto free_modinfo;
 
+	t = mod_stats_clock();
 	err = apply_relocations(mod, info);
+	mod_stats_account(info, MOD_STATS_RELOCS, t);
 	if (err < 0)
 		goto free_modinfo;
 
@@ -2840,6 +2858,9 @@ static int load_module(struct load_info *info, const char __user *uargs,
 			goto sysfs_cleanup;
 	}
 
+	mod_stats_account(info, MOD_STATS_TOTAL, start);
+	mod_stats_record(mod, info);
+
 	/* Get rid of temporary copy. */
 	free_copy(info, flags);
 
@@ -2879,10 +2900,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	mod_symhash_del(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
+	mod_symhash_free(mod);
  free_module:
 	/* Free lock-classes; relies on the preceding sync_rcu() */
 	lockdep_free_key_range(mod->data_layout.base, mod->data_layout.size);
@@ -2890,6 +2913,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	module_deallocate(mod, info);
  free_copy:
 	free_copy(info, flags);
+	mod_stats_failed();
 	return err;
 }
 
@@ -3118,3 +3142,14 @@ void print_modules(void)
 			last_unloaded_module.taints);
 	pr_cont("\n");
 }
+
+#ifdef CONFIG_DEBUG_FS
+struct dentry *mod_debugfs_root;
+
+static int module_debugfs_init(void)
+{
+	mod_debugfs_root = debugfs_create_dir("modules", NULL);
+	return 0;
+}
+postcore_initcall(module_debugfs_init);
+#endif
@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Parallel application of module relocations
+ *
+ * Big modules carry tens of thousands of relocations, which
+ * apply_relocate{,_add}() work through one at a time. Where applying a
+ * relocation only writes the location it patches, the relocations can be
+ * cut into ranges and handed to several CPUs. Every worker gets a private
+ * copy of the section headers with the relocation section narrowed down to
+ * its range, so the arch code does not need to know.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/moduleloader.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "internal.h"
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "module."
+/* Relocations a module needs to have before they are split up, 0 = never */
+static unsigned int reloc_parallel_threshold = 16384;
+module_param(reloc_parallel_threshold, uint, 0644);
+
+/* Fewer relocations than this per worker aren't worth the hand-off. */
+#define MODULE_RELOCS_PER_WORKER	4096
+
+struct mod_reloc_worker {
+	struct work_struct work;
+	struct module *mod;
+	const struct load_info *info;
+	Elf_Shdr *sechdrs;		/* private copy */
+	unsigned long first, last;	/* [first, last) of all relocations */
+	int err;
+};
+
+static bool reloc_section(const struct load_info *info, unsigned int i)
+{
+	const Elf_Shdr *shdr = &info->sechdrs[i];
+
+	if (shdr->sh_type != SHT_REL && shdr->sh_type != SHT_RELA)
+		return false;
+	if (shdr->sh_info >= info->hdr->e_shnum)
+		return false;
+
+	/* Don't bother with non-allocated sections */
+	return info->sechdrs[shdr->sh_info].sh_flags & SHF_ALLOC;
+}
+
+static size_t reloc_entsize(const Elf_Shdr *shdr)
+{
+	return shdr->sh_type == SHT_REL ? sizeof(Elf_Rel) : sizeof(Elf_Rela);
+}
+
+static void mod_reloc_work(struct work_struct *work)
+{
+	struct mod_reloc_worker *w =
+		container_of(work, struct mod_reloc_worker, work);
+	const struct load_info *info = w->info;
+	unsigned long base = 0;
+	unsigned int i;
+
+	for (i = 1; i < info->hdr->e_shnum && base < w->last; i++) {
+		const Elf_Shdr *shdr = &info->sechdrs[i];
+		unsigned long nr, from, to;
+		size_t entsize;
+		int err;
+
+		if (!reloc_section(info, i))
+			continue;
+
+		entsize = reloc_entsize(shdr);
+		nr = shdr->sh_size / entsize;
+		from = max(base, w->first);
+		to = min(base + nr, w->last);
+		if (from < to) {
+			w->sechdrs[i].sh_addr = shdr->sh_addr +
+						(from - base) * entsize;
+			w->sechdrs[i].sh_size = (to - from) * entsize;
+
+			if (shdr->sh_type == SHT_REL)
+				err = apply_relocate(w->sechdrs, info->strtab,
+						     info->index.sym, i, w->mod);
+			else
+				err = apply_relocate_add(w->sechdrs, info->strtab,
+							 info->index.sym, i,
+							 w->mod);
+			if (err < 0) {
+				w->err = err;
+				return;
+			}
+		}
+		base += nr;
+	}
+}
+
+/*
+ * Returns the number of workers the relocations were applied with, a
+ * negative errno if one of them failed, or -EAGAIN if the module should
+ * be relocated serially.
+ */
+int module_apply_relocs_parallel(struct module *mod,
+				 const struct load_info *info)
+{
+	unsigned int threshold = READ_ONCE(reloc_parallel_threshold);
+	size_t shdrs_size = info->hdr->e_shnum * sizeof(Elf_Shdr);
+	struct mod_reloc_worker *workers;
+	unsigned long total = 0, per_worker;
+	unsigned int i, nr_workers;
+	int err = 0;
+
+	/* Livepatch relocations are resolved by klp, keep them in order. */
+	if (!threshold || is_livepatch_module(mod))
+		return -EAGAIN;
+
+	for (i = 1; i < info->hdr->e_shnum; i++)
+		if (reloc_section(info, i))
+			total += info->sechdrs[i].sh_size /
+				 reloc_entsize(&info->sechdrs[i]);
+	if (total < threshold)
+		return -EAGAIN;
+
+	nr_workers = min_t(unsigned long, num_online_cpus(),
+			   total / MODULE_RELOCS_PER_WORKER);
+	if (nr_workers < 2)
+		return -EAGAIN;
+
+	workers = kcalloc(nr_workers, sizeof(*workers), GFP_KERNEL);
+	if (!workers)
+		return -EAGAIN;
+
+	per_worker = DIV_ROUND_UP(total, nr_workers);
+	for (i = 0; i < nr_workers; i++) {
+		struct mod_reloc_worker *w = &workers[i];
+
+		w->sechdrs = kmemdup(info->sechdrs, shdrs_size, GFP_KERNEL);
+		if (!w->sechdrs) {
+			err = -EAGAIN;
+			goto out_free;
+		}
+
+		INIT_WORK(&w->work, mod_reloc_work);
+		w->mod = mod;
+		w->info = info;
+		w->first = i * per_worker;
+		w->last = min(total, w->first + per_worker);
+	}
+
+	/* The loading task takes the first range instead of just waiting. */
+	for (i = 1; i < nr_workers; i++)
+		queue_work(system_unbound_wq, &workers[i].work);
+	mod_reloc_work(&workers[0].work);
+
+	for (i = 0; i < nr_workers; i++) {
+		if (i)
+			flush_work(&workers[i].work);
+		if (!err)
+			err = workers[i].err;
+	}
+	if (!err)
+		err = nr_workers;
+
+out_free:
+	for (i = 0; i < nr_workers; i++)
+		kfree(workers[i].sechdrs);
+	kfree(workers);
+	return err;
+}
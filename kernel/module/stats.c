@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Module load statistics
+ *
+ * Keeps the time load_module() spent in each phase for every module that
+ * was loaded, to see where module loading goes during boot. The time spent
+ * in the module's init function is not included, initcall_debug already
+ * reports that.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include "internal.h"
+
+/* Per-module records kept, loads past this only count towards the totals */
+#define MOD_STATS_MAX_RECORDS	1024
+
+struct mod_load_record {
+	struct list_head list;
+	char name[MODULE_NAME_LEN];
+	unsigned int size;
+	unsigned int reloc_workers;
+	u64 ns[MOD_STATS_NR];
+};
+
+static LIST_HEAD(mod_load_records);
+static DEFINE_MUTEX(mod_stats_mutex);
+static unsigned int mod_nr_records;
+static unsigned long mod_nr_loaded, mod_nr_failed;
+static u64 mod_total_ns[MOD_STATS_NR];
+
+static const char * const mod_stats_phase_names[MOD_STATS_NR] = {
+	[MOD_STATS_LAYOUT]	= "layout",
+	[MOD_STATS_SYMBOLS]	= "symbols",
+	[MOD_STATS_RELOCS]	= "relocs",
+	[MOD_STATS_TOTAL]	= "total",
+};
+
+void mod_stats_record(const struct module *mod, const struct load_info *info)
+{
+	struct mod_load_record *rec = NULL;
+	int i;
+
+	mutex_lock(&mod_stats_mutex);
+	mod_nr_loaded++;
+	for (i = 0; i < MOD_STATS_NR; i++)
+		mod_total_ns[i] += info->stats_ns[i];
+
+	if (mod_nr_records < MOD_STATS_MAX_RECORDS)
+		rec = kzalloc(sizeof(*rec), GFP_KERNEL);
+	if (rec) {
+		strscpy(rec->name, mod->name, sizeof(rec->name));
+		rec->size = mod->core_layout.size + mod->init_layout.size;
+		rec->reloc_workers = info->stats_reloc_workers;
+		memcpy(rec->ns, info->stats_ns, sizeof(rec->ns));
+		list_add_tail(&rec->list, &mod_load_records);
+		mod_nr_records++;
+	}
+	mutex_unlock(&mod_stats_mutex);
+}
+
+void mod_stats_failed(void)
+{
+	mutex_lock(&mod_stats_mutex);
+	mod_nr_failed++;
+	mutex_unlock(&mod_stats_mutex);
+}
+
+static int mod_load_stats_show(struct seq_file *m, void *v)
+{
+	struct mod_load_record *rec;
+	int i;
+
+	mutex_lock(&mod_stats_mutex);
+	seq_printf(m, "loaded %lu failed %lu\n", mod_nr_loaded, mod_nr_failed);
+	for (i = 0; i < MOD_STATS_NR; i++)
+		seq_printf(m, "%-8s %llu us\n", mod_stats_phase_names[i],
+			   div_u64(mod_total_ns[i], NSEC_PER_USEC));
+
+	seq_printf(m, "\n%-*s %10s %10s %10s %10s %7s %10s\n",
+		   (int)MODULE_NAME_LEN / 2, "module", "size", "layout_us",
+		   "symbols_us", "relocs_us", "workers", "total_us");
+	list_for_each_entry(rec, &mod_load_records, list) {
+		seq_printf(m, "%-*s %10u", (int)MODULE_NAME_LEN / 2,
+			   rec->name, rec->size);
+		for (i = 0; i < MOD_STATS_TOTAL; i++)
+			seq_printf(m, " %10llu",
+				   div_u64(rec->ns[i], NSEC_PER_USEC));
+		seq_printf(m, " %7u %10llu\n", rec->reloc_workers,
+			   div_u64(rec->ns[MOD_STATS_TOTAL], NSEC_PER_USEC));
+	}
+	mutex_unlock(&mod_stats_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mod_load_stats);
+
+static int __init mod_stats_init(void)
+{
+	debugfs_create_file("load_stats", 0400, mod_debugfs_root, NULL,
+			    &mod_load_stats_fops);
+	return 0;
+}
+module_init(mod_stats_init);
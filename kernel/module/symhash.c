@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Hashed lookup of exported symbols
+ *
+ * find_symbol() bsearches the export tables of vmlinux and then of every
+ * loaded module in turn, once for each undefined symbol of a module being
+ * loaded. With a lot of modules that walk dominates simplify_symbols().
+ * Here all exported symbols are kept in one hash table keyed by name
+ * instead: vmlinux' at boot, a module's from complete_formation() until it
+ * is unlinked again. Lookups run under RCU-sched like the list walk they
+ * replace, updates are serialized by module_mutex.
+ */
+
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/rculist.h>
+#include <linux/stringhash.h>
+#include "internal.h"
+
+struct mod_symhash_entry {
+	struct hlist_node node;
+	struct mod_symhash *sh;
+	/* Index into tables[0], continuing into tables[1] */
+	unsigned int idx;
+	u32 hash;
+};
+
+struct mod_symhash {
+	struct module *owner;
+	struct symsearch tables[2];
+	unsigned int nr;
+	struct mod_symhash_entry entries[];
+};
+
+static struct hlist_head *mod_symhash_table __read_mostly;
+static unsigned int mod_symhash_bits __read_mostly;
+
+static u32 mod_symhash_name(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static const struct symsearch *
+mod_symhash_entry_sym(const struct mod_symhash_entry *e,
+		      const struct kernel_symbol **sym, unsigned int *idx)
+{
+	const struct symsearch *ss = &e->sh->tables[0];
+
+	*idx = e->idx;
+	if (*idx >= ss->stop - ss->start) {
+		*idx -= ss->stop - ss->start;
+		ss++;
+	}
+	*sym = ss->start + *idx;
+
+	return ss;
+}
+
+static struct mod_symhash *mod_symhash_alloc(struct module *owner,
+					     const struct symsearch *tables)
+{
+	struct mod_symhash *sh;
+	unsigned int i, nr;
+
+	nr = (tables[0].stop - tables[0].start) +
+	     (tables[1].stop - tables[1].start);
+	if (!nr)
+		return NULL;
+
+	sh = kvmalloc(struct_size(sh, entries, nr), GFP_KERNEL);
+	if (!sh)
+		return ERR_PTR(-ENOMEM);
+
+	sh->owner = owner;
+	sh->tables[0] = tables[0];
+	sh->tables[1] = tables[1];
+	sh->nr = nr;
+
+	for (i = 0; i < nr; i++) {
+		struct mod_symhash_entry *e = &sh->entries[i];
+		const struct kernel_symbol *sym;
+		unsigned int idx;
+
+		e->sh = sh;
+		e->idx = i;
+		mod_symhash_entry_sym(e, &sym, &idx);
+		e->hash = mod_symhash_name(kernel_symbol_name(sym));
+	}
+
+	return sh;
+}
+
+static void mod_symhash_link(struct hlist_head *table, struct mod_symhash *sh)
+{
+	unsigned int i;
+
+	for (i = 0; i < sh->nr; i++) {
+		struct mod_symhash_entry *e = &sh->entries[i];
+
+		hlist_add_head_rcu(&e->node,
+				   &table[hash_32(e->hash, mod_symhash_bits)]);
+	}
+}
+
+/*
+ * Same contract as the list walk in find_symbol(). Returns -EAGAIN while
+ * the table has not been set up yet, the caller has to fall back to the
+ * walk then.
+ */
+int mod_symhash_find(struct find_symbol_arg *fsa)
+{
+	struct hlist_head *table = smp_load_acquire(&mod_symhash_table);
+	struct mod_symhash_entry *e;
+	u32 hash;
+
+	if (!table)
+		return -EAGAIN;
+
+	hash = mod_symhash_name(fsa->name);
+	hlist_for_each_entry_rcu(e, &table[hash_32(hash, mod_symhash_bits)],
+				 node, lockdep_is_held(&module_mutex)) {
+		struct module *owner = e->sh->owner;
+		const struct kernel_symbol *sym;
+		const struct symsearch *ss;
+		unsigned int idx;
+
+		if (e->hash != hash)
+			continue;
+
+		ss = mod_symhash_entry_sym(e, &sym, &idx);
+		if (strcmp(fsa->name, kernel_symbol_name(sym)))
+			continue;
+
+		/*
+		 * A module on its way out stays hashed until it is unlinked,
+		 * and another module may already export the same name again.
+		 */
+		if (owner && owner->state == MODULE_STATE_UNFORMED)
+			continue;
+		if (!fsa->gplok && ss->license == GPL_ONLY)
+			continue;
+
+		fsa->owner = owner;
+		fsa->crc = symversion(ss->crcs, idx);
+		fsa->sym = sym;
+		fsa->license = ss->license;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+static struct mod_symhash *mod_symhash_alloc_module(struct module *mod)
+{
+	const struct symsearch tables[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
+		  NOT_GPL_ONLY },
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
+		  GPL_ONLY },
+	};
+
+	return mod_symhash_alloc(mod, tables);
+}
+
+/* Called with module_mutex held, after verify_exported_symbols(). */
+int mod_symhash_add(struct module *mod)
+{
+	struct mod_symhash *sh;
+
+	lockdep_assert_held(&module_mutex);
+
+	if (!mod_symhash_table)
+		return 0;
+
+	sh = mod_symhash_alloc_module(mod);
+	if (IS_ERR_OR_NULL(sh))
+		return PTR_ERR_OR_ZERO(sh);
+
+	mod_symhash_link(mod_symhash_table, sh);
+	mod->symhash = sh;
+
+	return 0;
+}
+
+/* Called with module_mutex held, before the module's grace period. */
+void mod_symhash_del(struct module *mod)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&module_mutex);
+
+	if (!mod->symhash)
+		return;
+
+	for (i = 0; i < mod->symhash->nr; i++)
+		hlist_del_rcu(&mod->symhash->entries[i].node);
+}
+
+/* Called once no find_symbol() can see the entries any more. */
+void mod_symhash_free(struct module *mod)
+{
+	kvfree(mod->symhash);
+	mod->symhash = NULL;
+}
+
+static int __init mod_symhash_init(void)
+{
+	static const struct symsearch vmlinux[] = {
+		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+		  NOT_GPL_ONLY },
+		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+		  __start___kcrctab_gpl,
+		  GPL_ONLY },
+	};
+	struct mod_symhash *sh;
+	struct hlist_head *table;
+	struct module *mod;
+	unsigned int bits;
+
+	sh = mod_symhash_alloc(NULL, vmlinux);
+	if (IS_ERR(sh))
+		return PTR_ERR(sh);
+
+	/* About one vmlinux export per bucket, modules add to the chains. */
+	bits = order_base_2(max(sh ? sh->nr : 0, 1024U));
+	table = kvcalloc(1U << bits, sizeof(*table), GFP_KERNEL);
+	if (!table) {
+		kvfree(sh);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&module_mutex);
+	mod_symhash_bits = bits;
+	if (sh)
+		mod_symhash_link(table, sh);
+
+	/* Nothing can have been loaded yet, but don't rely on it. */
+	list_for_each_entry(mod, &modules, list) {
+		if (mod->state == MODULE_STATE_UNFORMED)
+			continue;
+
+		mod->symhash = mod_symhash_alloc_module(mod);
+		if (IS_ERR(mod->symhash)) {
+			mod->symhash = NULL;
+			goto out_free;
+		}
+		if (mod->symhash)
+			mod_symhash_link(table, mod->symhash);
+	}
+
+	/* Pairs with smp_load_acquire() in mod_symhash_find(). */
+	smp_store_release(&mod_symhash_table, table);
+	mutex_unlock(&module_mutex);
+
+	pr_debug("%u exported symbols hashed into %u buckets\n",
+		 sh ? sh->nr : 0, 1U << bits);
+
+	return 0;
+
+out_free:
+	/* The table was never published, nobody can be looking at it. */
+	list_for_each_entry(mod, &modules, list)
+		mod_symhash_free(mod);
+	mutex_unlock(&module_mutex);
+	kvfree(table);
+	kvfree(sh);
+	return -ENOMEM;
+}
+core_initcall(mod_symhash_init);
@@ -20,9 +20,11 @@
 #include <linux/delay.h>
 #include <linux/fs.h>
 #include <linux/mount.h>
+#include <linux/moduleparam.h>
 #include <linux/pm.h>
 #include <linux/nmi.h>
 #include <linux/console.h>
+#include <linux/crypto.h>
 #include <linux/cpu.h>
 #include <linux/freezer.h>
 #include <linux/gfp.h>
@@ -37,6 +39,7 @@
 
 
 static int nocompress;
+static char hibernate_compressor[8] = CONFIG_HIBERNATION_DEF_COMP;
 static int noresume;
 static int nohibernate;
 static int resume_wait;
@@ -46,6 +49,13 @@ dev_t swsusp_resume_device;
 sector_t swsusp_resume_block;
 __visible int in_suspend __nosavedata;
 
+/*
+ * Resume phase durations, measured by the boot kernel. They are not saved
+ * in the image, so the restored kernel sees them and can report them.
+ */
+static s64 resume_freeze_ms __nosavedata;
+static s64 resume_load_ms __nosavedata;
+
 enum {
 	HIBERNATION_INVALID,
 	HIBERNATION_PLATFORM,
@@ -687,6 +697,7 @@ static int load_image_and_restore(void)
 {
 	int error;
 	unsigned int flags;
+	ktime_t start;
 
 	pm_pr_dbg("Loading hibernation image.\n");
 
@@ -697,8 +708,10 @@ static int load_image_and_restore(void)
 		goto Unlock;
 	}
 
+	start = ktime_get();
 	error = swsusp_read(&flags);
 	swsusp_close(FMODE_READ | FMODE_EXCL);
+	resume_load_ms = ktime_ms_delta(ktime_get(), start);
 	if (!error)
 		error = hibernation_restore(flags & SF_PLATFORM_MODE);
 
@@ -718,6 +731,7 @@ int hibernate(void)
 {
 	bool snapshot_test = false;
 	unsigned int sleep_flags;
+	ktime_t start, frozen, snapshot_done;
 	int error;
 
 	if (!hibernation_available()) {
@@ -726,6 +740,15 @@ int hibernate(void)
 	}
 
 	sleep_flags = lock_system_sleep();
+
+	/* lzo and lz4 come from the crypto API, check before freezing. */
+	if (!nocompress && strcmp(hibernate_compressor, "zstd") &&
+	    crypto_has_comp(hibernate_compressor, 0, 0) != 1) {
+		pr_err("%s compression is not available\n", hibernate_compressor);
+		error = -EOPNOTSUPP;
+		goto Unlock;
+	}
+
 	/* The snapshot device should not be opened while we're running */
 	if (!hibernate_acquire()) {
 		error = -EBUSY;
@@ -740,9 +763,11 @@ int hibernate(void)
 
 	ksys_sync_helper();
 
+	start = ktime_get();
 	error = freeze_processes();
 	if (error)
 		goto Exit;
+	frozen = ktime_get();
 
 	lock_device_hotplug();
 	/* Allocate memory management structures */
@@ -757,16 +782,27 @@ int hibernate(void)
 	if (in_suspend) {
 		unsigned int flags = 0;
 
+		snapshot_done = ktime_get();
+
 		if (hibernation_mode == HIBERNATION_PLATFORM)
 			flags |= SF_PLATFORM_MODE;
-		if (nocompress)
+		if (nocompress) {
 			flags |= SF_NOCOMPRESS_MODE;
-		else
-		        flags |= SF_CRC32_MODE;
+		} else {
+			flags |= SF_CRC32_MODE;
+			if (!strcmp(hibernate_compressor, "zstd"))
+				flags |= SF_COMPRESSION_ALG_ZSTD;
+			else if (!strcmp(hibernate_compressor, "lz4"))
+				flags |= SF_COMPRESSION_ALG_LZ4;
+		}
 
 		pm_pr_dbg("Writing hibernation image.\n");
 		error = swsusp_write(flags);
 		swsusp_free();
+		pr_info("Hibernation phases: freeze %lld ms, snapshot %lld ms, image write %lld ms\n",
+			ktime_ms_delta(frozen, start),
+			ktime_ms_delta(snapshot_done, frozen),
+			ktime_ms_delta(ktime_get(), snapshot_done));
 		if (!error) {
 			if (hibernation_mode == HIBERNATION_TEST_RESUME)
 				snapshot_test = true;
@@ -777,6 +813,8 @@ int hibernate(void)
 		pm_restore_gfp_mask();
 	} else {
 		pm_pr_dbg("Hibernation image restored successfully.\n");
+		pr_info("Resume phases: freeze %lld ms, image load %lld ms\n",
+			resume_freeze_ms, resume_load_ms);
 	}
 
  Free_bitmaps:
@@ -920,6 +958,7 @@ EXPORT_SYMBOL_GPL(hibernate_quiet_exec);
  */
 static int software_resume(void)
 {
+	ktime_t start;
 	int error;
 
 	/*
@@ -1001,6 +1040,7 @@ static int software_resume(void)
 		goto Restore;
 
 	pm_pr_dbg("Preparing processes for hibernation restore.\n");
+	start = ktime_get();
 	error = freeze_processes();
 	if (error)
 		goto Close_Finish;
@@ -1010,6 +1050,7 @@ static int software_resume(void)
 		thaw_processes();
 		goto Close_Finish;
 	}
+	resume_freeze_ms = ktime_ms_delta(ktime_get(), start);
 
 	error = load_image_and_restore();
 	thaw_processes();
@@ -1349,6 +1390,46 @@ static int __init nohibernate_setup(char *str)
 	return 1;
 }
 
+static const char * const hibernate_compressors[] = {
+	"lzo",
+	"lz4",
+#ifdef CONFIG_HIBERNATION_COMP_ZSTD
+	"zstd",
+#endif
+};
+
+static int hibernate_compressor_set(const char *val,
+				    const struct kernel_param *kp)
+{
+	int index = sysfs_match_string(hibernate_compressors, val);
+
+	if (index < 0)
+		return index;
+
+	lock_system_sleep();
+	strscpy(hibernate_compressor, hibernate_compressors[index],
+		sizeof(hibernate_compressor));
+	unlock_system_sleep();
+	return 0;
+}
+
+static int hibernate_compressor_get(char *buffer,
+				    const struct kernel_param *kp)
+{
+	return sysfs_emit(buffer, "%s\n", hibernate_compressor);
+}
+
+static const struct kernel_param_ops hibernate_compressor_ops = {
+	.set	= hibernate_compressor_set,
+	.get	= hibernate_compressor_get,
+};
+
+/*
+ * Compressor used for the image unless hibernate=nocompress is given. The
+ * choice is recorded in the image header, so resume does not depend on it.
+ */
+module_param_cb(compressor, &hibernate_compressor_ops, NULL, 0644);
+
 __setup("noresume", noresume_setup);
 __setup("resume_offset=", resume_offset_setup);
 __setup("resume=", resume_setup);
@@ -171,6 +171,8 @@ extern int swsusp_swap_in_use(void);
 #define SF_NOCOMPRESS_MODE	2
 #define SF_CRC32_MODE	        4
 #define SF_HW_SIG		8
+#define SF_COMPRESSION_ALG_ZSTD	16
+#define SF_COMPRESSION_ALG_LZ4	32
 
 /* kernel/power/hibernate.c */
 extern int swsusp_check(void);
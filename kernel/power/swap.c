@@ -24,12 +24,14 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/crypto.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
 #include <linux/kthread.h>
 #include <linux/crc32.h>
 #include <linux/ktime.h>
+#include <linux/zstd.h>
 
 #include "power.h"
 
@@ -224,11 +226,20 @@ int swsusp_swap_in_use(void)
 static unsigned short root_swap = 0xffff;
 static struct block_device *hib_resume_bdev;
 
+/*
+ * Image pages that are adjacent on the swap device are merged into bios of
+ * up to HIB_BIO_MAX_PAGES pages. The bio being filled is only submitted
+ * once it is full, the next page isn't adjacent or hib_wait_io() is called.
+ */
+#define HIB_BIO_MAX_PAGES	BIO_MAX_VECS
+
 struct hib_bio_batch {
 	atomic_t		count;
 	wait_queue_head_t	wait;
 	blk_status_t		error;
 	struct blk_plug		plug;
+	struct bio		*bio;		/* being filled */
+	ktime_t			wait_time;	/* in hib_wait_io() */
 };
 
 static void hib_init_batch(struct hib_bio_batch *hb)
@@ -236,18 +247,32 @@ static void hib_init_batch(struct hib_bio_batch *hb)
 	atomic_set(&hb->count, 0);
 	init_waitqueue_head(&hb->wait);
 	hb->error = BLK_STS_OK;
+	hb->bio = NULL;
+	hb->wait_time = 0;
 	blk_start_plug(&hb->plug);
 }
 
+static void hib_submit_batch_bio(struct hib_bio_batch *hb)
+{
+	if (hb->bio) {
+		submit_bio(hb->bio);
+		hb->bio = NULL;
+	}
+}
+
 static void hib_finish_batch(struct hib_bio_batch *hb)
 {
+	/* Error paths may get here with I/O still going on. */
+	hib_submit_batch_bio(hb);
+	wait_event(hb->wait, atomic_read(&hb->count) == 0);
 	blk_finish_plug(&hb->plug);
 }
 
 static void hib_end_io(struct bio *bio)
 {
 	struct hib_bio_batch *hb = bio->bi_private;
-	struct page *page = bio_first_page_all(bio);
+	struct bvec_iter_all iter_all;
+	struct bio_vec *bvec;
 
 	if (bio->bi_status) {
 		pr_alert("Read-error on swap-device (%u:%u:%Lu)\n",
@@ -255,11 +280,16 @@ static void hib_end_io(struct bio *bio)
 			 (unsigned long long)bio->bi_iter.bi_sector);
 	}
 
-	if (bio_data_dir(bio) == WRITE)
-		put_page(page);
-	else if (clean_pages_on_read)
-		flush_icache_range((unsigned long)page_address(page),
-				   (unsigned long)page_address(page) + PAGE_SIZE);
+	bio_for_each_segment_all(bvec, bio, iter_all) {
+		struct page *page = bvec->bv_page;
+
+		if (bio_data_dir(bio) == WRITE)
+			put_page(page);
+		else if (clean_pages_on_read)
+			flush_icache_range((unsigned long)page_address(page),
+					   (unsigned long)page_address(page) +
+					   PAGE_SIZE);
+	}
 
 	if (bio->bi_status && !hb->error)
 		hb->error = bio->bi_status;
@@ -273,11 +303,38 @@ static int hib_submit_io(blk_opf_t opf, pgoff_t page_off, void *addr,
 			 struct hib_bio_batch *hb)
 {
 	struct page *page = virt_to_page(addr);
+	sector_t sector = page_off * (PAGE_SIZE >> 9);
 	struct bio *bio;
 	int error = 0;
 
+	if (hb) {
+		bio = hb->bio;
+		if (bio && (bio->bi_opf != opf ||
+			    bio_end_sector(bio) != sector)) {
+			hib_submit_batch_bio(hb);
+			bio = NULL;
+		}
+
+		if (!bio) {
+			bio = bio_alloc(hib_resume_bdev, HIB_BIO_MAX_PAGES, opf,
+					GFP_NOIO | __GFP_HIGH);
+			bio->bi_iter.bi_sector = sector;
+			bio->bi_end_io = hib_end_io;
+			bio->bi_private = hb;
+			atomic_inc(&hb->count);
+			hb->bio = bio;
+		}
+
+		/* Cannot fail, the bio is submitted as soon as it is full. */
+		__bio_add_page(bio, page, PAGE_SIZE, 0);
+		if (bio->bi_vcnt >= bio->bi_max_vecs)
+			hib_submit_batch_bio(hb);
+
+		return 0;
+	}
+
 	bio = bio_alloc(hib_resume_bdev, 1, opf, GFP_NOIO | __GFP_HIGH);
-	bio->bi_iter.bi_sector = page_off * (PAGE_SIZE >> 9);
+	bio->bi_iter.bi_sector = sector;
 
 	if (bio_add_page(bio, page, PAGE_SIZE, 0) < PAGE_SIZE) {
 		pr_err("Adding page to bio failed at %llu\n",
@@ -286,29 +343,47 @@ static int hib_submit_io(blk_opf_t opf, pgoff_t page_off, void *addr,
 		return -EFAULT;
 	}
 
-	if (hb) {
-		bio->bi_end_io = hib_end_io;
-		bio->bi_private = hb;
-		atomic_inc(&hb->count);
-		submit_bio(bio);
-	} else {
-		error = submit_bio_wait(bio);
-		bio_put(bio);
-	}
+	error = submit_bio_wait(bio);
+	bio_put(bio);
 
 	return error;
 }
 
 static int hib_wait_io(struct hib_bio_batch *hb)
 {
+	ktime_t start = ktime_get();
+
+	hib_submit_batch_bio(hb);
+
 	/*
 	 * We are relying on the behavior of blk_plug that a thread with
 	 * a plug will flush the plug list before sleeping.
 	 */
 	wait_event(hb->wait, atomic_read(&hb->count) == 0);
+	hb->wait_time = ktime_add(hb->wait_time,
+				  ktime_sub(ktime_get(), start));
 	return blk_status_to_errno(hb->error);
 }
 
+/*
+ * Show where the time of saving/loading the image went. Whatever isn't
+ * spent waiting for the compressor or the swap device is mostly copying
+ * pages to/from the snapshot.
+ */
+static void hib_show_times(const char *msg, ktime_t start, ktime_t stop,
+			   const char *alg, ktime_t cmp_time,
+			   struct hib_bio_batch *hb)
+{
+	if (alg)
+		pr_info("%s time: %lld ms, %lld ms of it in %s, %lld ms waiting for I/O\n",
+			msg, ktime_ms_delta(stop, start), ktime_to_ms(cmp_time),
+			alg, ktime_to_ms(hb->wait_time));
+	else
+		pr_info("%s time: %lld ms, %lld ms of it waiting for I/O\n",
+			msg, ktime_ms_delta(stop, start),
+			ktime_to_ms(hb->wait_time));
+}
+
 /*
  * Saving part
  */
@@ -514,23 +589,51 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 }
 
 /* We need to remember how much compressed data we need to read. */
-#define LZO_HEADER	sizeof(size_t)
+#define CMP_HEADER	sizeof(size_t)
 
 /* Number of pages/bytes we'll compress at one time. */
-#define LZO_UNC_PAGES	32
-#define LZO_UNC_SIZE	(LZO_UNC_PAGES * PAGE_SIZE)
+#define UNC_PAGES	32
+#define UNC_SIZE	(UNC_PAGES * PAGE_SIZE)
 
-/* Number of pages/bytes we need for compressed data (worst case). */
-#define LZO_CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(LZO_UNC_SIZE) + \
-			             LZO_HEADER, PAGE_SIZE)
-#define LZO_CMP_SIZE	(LZO_CMP_PAGES * PAGE_SIZE)
+/*
+ * Number of pages/bytes we need for compressed data (worst case). The LZO
+ * bound is larger than the LZ4 one, so it covers both.
+ */
+#define CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(UNC_SIZE) + \
+			             CMP_HEADER, PAGE_SIZE)
+#define CMP_SIZE	(CMP_PAGES * PAGE_SIZE)
 
 /* Maximum number of threads for compression/decompression. */
-#define LZO_THREADS	3
+#define CMP_THREADS	8
 
 /* Minimum/maximum number of pages for read buffering. */
-#define LZO_MIN_RD_PAGES	1024
-#define LZO_MAX_RD_PAGES	8192
+#define CMP_MIN_RD_PAGES	1024
+#define CMP_MAX_RD_PAGES	32768
+
+/* Crypto compression algorithm of an image not compressed with zstd. */
+static const char *hib_comp_alg(unsigned int flags)
+{
+	return flags & SF_COMPRESSION_ALG_LZ4 ? "lz4" : "lzo";
+}
+
+/*
+ * zstd images use the same record layout as the others, a length followed by
+ * the compressed data, but each record holds HIB_ZSTD_UNC_PAGES pages cut
+ * into independent frames of HIB_ZSTD_CHUNK_SIZE bytes, which are
+ * compressed and decompressed in parallel.
+ */
+#define HIB_ZSTD_LEVEL		3
+#define HIB_ZSTD_CHUNK_SIZE	(32 * PAGE_SIZE)
+#define HIB_ZSTD_UNC_PAGES	512
+#define HIB_ZSTD_UNC_SIZE	(HIB_ZSTD_UNC_PAGES * PAGE_SIZE)
+#define HIB_ZSTD_CMP_PAGES	DIV_ROUND_UP(HIB_ZSTD_UNC_SIZE /	\
+				HIB_ZSTD_CHUNK_SIZE *			\
+				ZSTD_COMPRESSBOUND(HIB_ZSTD_CHUNK_SIZE) +	\
+				CMP_HEADER, PAGE_SIZE)
+#define HIB_ZSTD_CMP_SIZE	(HIB_ZSTD_CMP_PAGES * PAGE_SIZE)
+
+/* Maximum number of CPUs used for zstd compression/decompression. */
+#define HIB_ZSTD_THREADS	8
 
 
 /**
@@ -578,6 +681,7 @@ static int save_image(struct swap_map_handle *handle,
 	if (!ret)
 		pr_info("Image saving done\n");
 	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
+	hib_show_times("Image saving", start, stop, NULL, 0, &hb);
 	return ret;
 }
 
@@ -592,8 +696,8 @@ struct crc_data {
 	wait_queue_head_t go;                     /* start crc update */
 	wait_queue_head_t done;                   /* crc update done */
 	u32 *crc32;                               /* points to handle's crc32 */
-	size_t *unc_len[LZO_THREADS];             /* uncompressed lengths */
-	unsigned char *unc[LZO_THREADS];          /* uncompressed data */
+	size_t *unc_len[CMP_THREADS];             /* uncompressed lengths */
+	unsigned char *unc[CMP_THREADS];          /* uncompressed data */
 };
 
 /**
@@ -624,7 +728,7 @@ static int crc32_threadfn(void *data)
 	return 0;
 }
 /**
- * Structure used for LZO data compression.
+ * Structure used for data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
@@ -635,17 +739,18 @@ struct cmp_data {
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
-	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
-	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
+	unsigned char unc[UNC_SIZE];              /* uncompressed buffer */
+	unsigned char cmp[CMP_SIZE];              /* compressed buffer */
+	struct crypto_comp *cc;                   /* crypto compressor */
 };
 
 /**
  * Compression function that runs in its own thread.
  */
-static int lzo_compress_threadfn(void *data)
+static int compress_threadfn(void *data)
 {
 	struct cmp_data *d = data;
+	unsigned int cmp_len;
 
 	while (1) {
 		wait_event(d->go, atomic_read(&d->ready) ||
@@ -659,9 +764,10 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		cmp_len = CMP_SIZE - CMP_HEADER;
+		d->ret = crypto_comp_compress(d->cc, d->unc, d->unc_len,
+		                              d->cmp + CMP_HEADER, &cmp_len);
+		d->cmp_len = cmp_len;
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -669,14 +775,16 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_compressed_image - Save the suspend image data after compression.
  * @handle: Swap map handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
+ * @alg: Name of the crypto compression algorithm to use.
  */
-static int save_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+static int save_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_write,
+                                 const char *alg)
 {
 	unsigned int m;
 	int ret = 0;
@@ -685,6 +793,8 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	struct hib_bio_batch hb;
 	ktime_t start;
 	ktime_t stop;
+	ktime_t wait_start;
+	ktime_t cmp_time = 0;
 	size_t off;
 	unsigned thr, run_threads, nr_threads;
 	unsigned char *page = NULL;
@@ -698,18 +808,18 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	 * footprint.
 	 */
 	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	nr_threads = clamp_val(nr_threads, 1, CMP_THREADS);
 
 	page = (void *)__get_free_page(GFP_NOIO | __GFP_HIGH);
 	if (!page) {
-		pr_err("Failed to allocate LZO page\n");
+		pr_err("Failed to allocate %s page\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vzalloc(array_size(nr_threads, sizeof(*data)));
 	if (!data) {
-		pr_err("Failed to allocate LZO data\n");
+		pr_err("Failed to allocate %s data\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
@@ -728,7 +838,15 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_compress_threadfn,
+		data[thr].cc = crypto_alloc_comp(alg, 0, 0);
+		if (IS_ERR(data[thr].cc)) {
+			ret = PTR_ERR(data[thr].cc);
+			data[thr].cc = NULL;
+			pr_err("Cannot allocate %s compressor\n", alg);
+			goto out_clean;
+		}
+
+		data[thr].thr = kthread_run(compress_threadfn,
 		                            &data[thr],
 		                            "image_compress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -766,7 +884,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	 */
 	handle->reqd_free_pages = reqd_free_pages();
 
-	pr_info("Using %u thread(s) for compression\n", nr_threads);
+	pr_info("Using %u thread(s) for %s compression\n", nr_threads, alg);
 	pr_info("Compressing and saving image data (%u pages)...\n",
 		nr_to_write);
 	m = nr_to_write / 10;
@@ -776,7 +894,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	start = ktime_get();
 	for (;;) {
 		for (thr = 0; thr < nr_threads; thr++) {
-			for (off = 0; off < LZO_UNC_SIZE; off += PAGE_SIZE) {
+			for (off = 0; off < UNC_SIZE; off += PAGE_SIZE) {
 				ret = snapshot_read_next(snapshot);
 				if (ret < 0)
 					goto out_finish;
@@ -809,21 +927,24 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		wake_up(&crc->go);
 
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
+			wait_start = ktime_get();
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
 			atomic_set(&data[thr].stop, 0);
+			cmp_time = ktime_add(cmp_time,
+			                     ktime_sub(ktime_get(), wait_start));
 
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				pr_err("LZO compression failed\n");
+				pr_err("%s compression failed\n", alg);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
 			             lzo1x_worst_compress(data[thr].unc_len))) {
-				pr_err("Invalid LZO compressed length\n");
+				pr_err("Invalid %s compressed length\n", alg);
 				ret = -1;
 				goto out_finish;
 			}
@@ -839,7 +960,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			 * read it.
 			 */
 			for (off = 0;
-			     off < LZO_HEADER + data[thr].cmp_len;
+			     off < CMP_HEADER + data[thr].cmp_len;
 			     off += PAGE_SIZE) {
 				memcpy(page, data[thr].cmp + off, PAGE_SIZE);
 
@@ -861,6 +982,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	if (!ret)
 		pr_info("Image saving done\n");
 	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
+	hib_show_times("Image saving", start, stop, alg, cmp_time, &hb);
 out_clean:
 	hib_finish_batch(&hb);
 	if (crc) {
@@ -869,9 +991,12 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		kfree(crc);
 	}
 	if (data) {
-		for (thr = 0; thr < nr_threads; thr++)
+		for (thr = 0; thr < nr_threads; thr++) {
 			if (data[thr].thr)
 				kthread_stop(data[thr].thr);
+			if (data[thr].cc)
+				crypto_free_comp(data[thr].cc);
+		}
 		vfree(data);
 	}
 	if (page) free_page((unsigned long)page);
@@ -879,6 +1004,127 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	return ret;
 }
 
+/**
+ * save_image_zstd - Save the suspend image data compressed with zstd.
+ * @handle: Swap map handle to use for saving the image.
+ * @snapshot: Image to read data from.
+ * @nr_to_write: Number of pages to save.
+ */
+static int save_image_zstd(struct swap_map_handle *handle,
+			   struct snapshot_handle *snapshot,
+			   unsigned int nr_to_write)
+{
+	unsigned int m;
+	int ret = 0;
+	int nr_pages;
+	int err2;
+	struct hib_bio_batch hb;
+	ktime_t start;
+	ktime_t stop;
+	ktime_t cmp_start;
+	ktime_t cmp_time = 0;
+	size_t off, unc_len, cmp_len;
+	unsigned int nr_threads;
+	unsigned char *page = NULL, *unc = NULL, *cmp = NULL;
+	zstd_parallel_cctx *pctx = NULL;
+
+	hib_init_batch(&hb);
+
+	nr_threads = clamp_val(num_online_cpus(), 1, HIB_ZSTD_THREADS);
+
+	page = (void *)__get_free_page(GFP_NOIO | __GFP_HIGH);
+	unc = vmalloc(HIB_ZSTD_UNC_SIZE);
+	cmp = vmalloc(HIB_ZSTD_CMP_SIZE);
+	pctx = zstd_alloc_parallel_cctx(HIB_ZSTD_LEVEL, HIB_ZSTD_CHUNK_SIZE,
+					nr_threads);
+	if (!page || !unc || !cmp || !pctx) {
+		pr_err("Failed to allocate zstd buffers\n");
+		ret = -ENOMEM;
+		goto out_clean;
+	}
+
+	/*
+	 * Adjust the number of required free pages after all allocations have
+	 * been done. We don't want to run out of pages when writing.
+	 */
+	handle->reqd_free_pages = reqd_free_pages();
+	handle->crc32 = 0;
+
+	pr_info("Using %u thread(s) for zstd compression\n", nr_threads);
+	pr_info("Compressing and saving image data (%u pages)...\n",
+		nr_to_write);
+	m = nr_to_write / 10;
+	if (!m)
+		m = 1;
+	nr_pages = 0;
+	start = ktime_get();
+	for (;;) {
+		for (unc_len = 0; unc_len < HIB_ZSTD_UNC_SIZE;
+		     unc_len += PAGE_SIZE) {
+			ret = snapshot_read_next(snapshot);
+			if (ret < 0)
+				goto out_finish;
+
+			if (!ret)
+				break;
+
+			memcpy(unc + unc_len, data_of(*snapshot), PAGE_SIZE);
+
+			if (!(nr_pages % m))
+				pr_info("Image saving progress: %3d%%\n",
+					nr_pages / m * 10);
+			nr_pages++;
+		}
+		if (!unc_len)
+			break;
+
+		handle->crc32 = crc32_le(handle->crc32, unc, unc_len);
+
+		cmp_start = ktime_get();
+		cmp_len = zstd_parallel_compress(pctx, cmp + CMP_HEADER,
+						 HIB_ZSTD_CMP_SIZE - CMP_HEADER,
+						 unc, unc_len);
+		cmp_time = ktime_add(cmp_time,
+				     ktime_sub(ktime_get(), cmp_start));
+		if (zstd_is_error(cmp_len)) {
+			pr_err("zstd compression failed: %s\n",
+			       zstd_get_error_name(cmp_len));
+			ret = -EIO;
+			goto out_finish;
+		}
+
+		*(size_t *)cmp = cmp_len;
+
+		/* As above, the tail of the last page is never looked at. */
+		for (off = 0; off < CMP_HEADER + cmp_len; off += PAGE_SIZE) {
+			memcpy(page, cmp + off, PAGE_SIZE);
+
+			ret = swap_write_page(handle, page, &hb);
+			if (ret)
+				goto out_finish;
+		}
+	}
+
+out_finish:
+	err2 = hib_wait_io(&hb);
+	stop = ktime_get();
+	if (!ret)
+		ret = err2;
+	if (!ret)
+		pr_info("Image saving done\n");
+	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
+	hib_show_times("Image saving", start, stop, "zstd", cmp_time, &hb);
+out_clean:
+	hib_finish_batch(&hb);
+	zstd_free_parallel_cctx(pctx);
+	vfree(cmp);
+	vfree(unc);
+	if (page)
+		free_page((unsigned long)page);
+
+	return ret;
+}
+
 /**
  *	enough_swap - Make sure we have enough swap to save the image.
  *
@@ -939,9 +1185,15 @@ int swsusp_write(unsigned int flags)
 	header = (struct swsusp_info *)data_of(snapshot);
 	error = swap_write_page(&handle, header, NULL);
 	if (!error) {
-		error = (flags & SF_NOCOMPRESS_MODE) ?
-			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+		if (flags & SF_NOCOMPRESS_MODE)
+			error = save_image(&handle, &snapshot, pages - 1);
+		else if (IS_ENABLED(CONFIG_HIBERNATION_COMP_ZSTD) &&
+			 (flags & SF_COMPRESSION_ALG_ZSTD))
+			error = save_image_zstd(&handle, &snapshot, pages - 1);
+		else
+			error = save_compressed_image(&handle, &snapshot,
+						      pages - 1,
+						      hib_comp_alg(flags));
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1104,11 +1356,12 @@ static int load_image(struct swap_map_handle *handle,
 			ret = -ENODATA;
 	}
 	swsusp_show_speed(start, stop, nr_to_read, "Read");
+	hib_show_times("Image loading", start, stop, NULL, 0, &hb);
 	return ret;
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
@@ -1119,16 +1372,18 @@ struct dec_data {
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
-	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
-	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
+	unsigned char unc[UNC_SIZE];              /* uncompressed buffer */
+	unsigned char cmp[CMP_SIZE];              /* compressed buffer */
+	struct crypto_comp *cc;                   /* crypto compressor */
 };
 
 /**
  * Decompression function that runs in its own thread.
  */
-static int lzo_decompress_threadfn(void *data)
+static int decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
+	unsigned int unc_len;
 
 	while (1) {
 		wait_event(d->go, atomic_read(&d->ready) ||
@@ -1142,9 +1397,10 @@ static int lzo_decompress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		unc_len = UNC_SIZE;
+		d->ret = crypto_comp_decompress(d->cc, d->cmp + CMP_HEADER,
+		                                d->cmp_len, d->unc, &unc_len);
+		d->unc_len = unc_len;
 		if (clean_pages_on_decompress)
 			flush_icache_range((unsigned long)d->unc,
 					   (unsigned long)d->unc + d->unc_len);
@@ -1156,21 +1412,26 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_compressed_image - Load compressed image data and decompress it.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
+ * @alg: Name of the crypto compression algorithm to use.
  */
-static int load_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_read)
+static int load_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_read,
+                                 const char *alg)
 {
 	unsigned int m;
 	int ret = 0;
+	int err2;
 	int eof = 0;
 	struct hib_bio_batch hb;
 	ktime_t start;
 	ktime_t stop;
+	ktime_t wait_start;
+	ktime_t cmp_time = 0;
 	unsigned nr_pages;
 	size_t off;
 	unsigned i, thr, run_threads, nr_threads;
@@ -1188,18 +1449,18 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	 * footprint.
 	 */
 	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	nr_threads = clamp_val(nr_threads, 1, CMP_THREADS);
 
-	page = vmalloc(array_size(LZO_MAX_RD_PAGES, sizeof(*page)));
+	page = vmalloc(array_size(CMP_MAX_RD_PAGES, sizeof(*page)));
 	if (!page) {
-		pr_err("Failed to allocate LZO page\n");
+		pr_err("Failed to allocate %s page\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vzalloc(array_size(nr_threads, sizeof(*data)));
 	if (!data) {
-		pr_err("Failed to allocate LZO data\n");
+		pr_err("Failed to allocate %s data\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
@@ -1220,7 +1481,15 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_decompress_threadfn,
+		data[thr].cc = crypto_alloc_comp(alg, 0, 0);
+		if (IS_ERR(data[thr].cc)) {
+			ret = PTR_ERR(data[thr].cc);
+			data[thr].cc = NULL;
+			pr_err("Cannot allocate %s decompressor\n", alg);
+			goto out_clean;
+		}
+
+		data[thr].thr = kthread_run(decompress_threadfn,
 		                            &data[thr],
 		                            "image_decompress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -1261,18 +1530,18 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	 */
 	if (low_free_pages() > snapshot_get_image_size())
 		read_pages = (low_free_pages() - snapshot_get_image_size()) / 2;
-	read_pages = clamp_val(read_pages, LZO_MIN_RD_PAGES, LZO_MAX_RD_PAGES);
+	read_pages = clamp_val(read_pages, CMP_MIN_RD_PAGES, CMP_MAX_RD_PAGES);
 
 	for (i = 0; i < read_pages; i++) {
-		page[i] = (void *)__get_free_page(i < LZO_CMP_PAGES ?
+		page[i] = (void *)__get_free_page(i < CMP_PAGES ?
 						  GFP_NOIO | __GFP_HIGH :
 						  GFP_NOIO | __GFP_NOWARN |
 						  __GFP_NORETRY);
 
 		if (!page[i]) {
-			if (i < LZO_CMP_PAGES) {
+			if (i < CMP_PAGES) {
 				ring_size = i;
-				pr_err("Failed to allocate LZO pages\n");
+				pr_err("Failed to allocate %s pages\n", alg);
 				ret = -ENOMEM;
 				goto out_clean;
 			} else {
@@ -1282,7 +1551,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	}
 	want = ring_size = i;
 
-	pr_info("Using %u thread(s) for decompression\n", nr_threads);
+	pr_info("Using %u thread(s) for %s decompression\n", nr_threads, alg);
 	pr_info("Loading and decompressing image data (%u pages)...\n",
 		nr_to_read);
 	m = nr_to_read / 10;
@@ -1343,13 +1612,13 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
-				pr_err("Invalid LZO compressed length\n");
+			             lzo1x_worst_compress(UNC_SIZE))) {
+				pr_err("Invalid %s compressed length\n", alg);
 				ret = -1;
 				goto out_finish;
 			}
 
-			need = DIV_ROUND_UP(data[thr].cmp_len + LZO_HEADER,
+			need = DIV_ROUND_UP(data[thr].cmp_len + CMP_HEADER,
 			                    PAGE_SIZE);
 			if (need > have) {
 				if (eof > 1) {
@@ -1360,7 +1629,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			}
 
 			for (off = 0;
-			     off < LZO_HEADER + data[thr].cmp_len;
+			     off < CMP_HEADER + data[thr].cmp_len;
 			     off += PAGE_SIZE) {
 				memcpy(data[thr].cmp + off,
 				       page[pg], PAGE_SIZE);
@@ -1377,7 +1646,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		/*
 		 * Wait for more data while we are decompressing.
 		 */
-		if (have < LZO_CMP_PAGES && asked) {
+		if (have < CMP_PAGES && asked) {
 			ret = hib_wait_io(&hb);
 			if (ret)
 				goto out_finish;
@@ -1388,21 +1657,24 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
+			wait_start = ktime_get();
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
 			atomic_set(&data[thr].stop, 0);
+			cmp_time = ktime_add(cmp_time,
+			                     ktime_sub(ktime_get(), wait_start));
 
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				pr_err("LZO decompression failed\n");
+				pr_err("%s decompression failed\n", alg);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].unc_len ||
-			             data[thr].unc_len > LZO_UNC_SIZE ||
+			             data[thr].unc_len > UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
-				pr_err("Invalid LZO uncompressed length\n");
+				pr_err("Invalid %s uncompressed length\n", alg);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1437,7 +1709,11 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		wait_event(crc->done, atomic_read(&crc->stop));
 		atomic_set(&crc->stop, 0);
 	}
+	/* Read-ahead past the last record may still be in flight. */
+	err2 = hib_wait_io(&hb);
 	stop = ktime_get();
+	if (!ret)
+		ret = err2;
 	if (!ret) {
 		pr_info("Image loading done\n");
 		snapshot_write_finalize(snapshot);
@@ -1453,6 +1729,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 	swsusp_show_speed(start, stop, nr_to_read, "Read");
+	hib_show_times("Image loading", start, stop, alg, cmp_time, &hb);
 out_clean:
 	hib_finish_batch(&hb);
 	for (i = 0; i < ring_size; i++)
@@ -1463,9 +1740,12 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		kfree(crc);
 	}
 	if (data) {
-		for (thr = 0; thr < nr_threads; thr++)
+		for (thr = 0; thr < nr_threads; thr++) {
 			if (data[thr].thr)
 				kthread_stop(data[thr].thr);
+			if (data[thr].cc)
+				crypto_free_comp(data[thr].cc);
+		}
 		vfree(data);
 	}
 	vfree(page);
@@ -1473,6 +1753,225 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	return ret;
 }
 
+/**
+ * load_image_zstd - Load compressed image data and decompress them with zstd.
+ * @handle: Swap map handle to use for loading data.
+ * @snapshot: Image to copy uncompressed data into.
+ * @nr_to_read: Number of pages to load.
+ */
+static int load_image_zstd(struct swap_map_handle *handle,
+			   struct snapshot_handle *snapshot,
+			   unsigned int nr_to_read)
+{
+	unsigned int m;
+	int ret = 0;
+	int err2;
+	bool eof = false;
+	struct hib_bio_batch hb;
+	ktime_t start;
+	ktime_t stop;
+	unsigned nr_pages;
+	ktime_t cmp_start;
+	ktime_t cmp_time = 0;
+	size_t off, cmp_len, unc_len;
+	unsigned i, nr_threads;
+	unsigned ring = 0, pg = 0, ring_size = 0, have = 0, asked = 0, need;
+	unsigned long read_pages = 0;
+	unsigned char **page = NULL;
+	unsigned char *unc = NULL, *cmp = NULL;
+	zstd_parallel_dctx *pdctx = NULL;
+
+	if (!IS_ENABLED(CONFIG_HIBERNATION_COMP_ZSTD)) {
+		pr_err("Image is zstd compressed, but zstd support is not built in\n");
+		return -EINVAL;
+	}
+
+	hib_init_batch(&hb);
+
+	nr_threads = clamp_val(num_online_cpus(), 1, HIB_ZSTD_THREADS);
+
+	page = vmalloc(array_size(CMP_MAX_RD_PAGES, sizeof(*page)));
+	unc = vmalloc(HIB_ZSTD_UNC_SIZE);
+	cmp = vmalloc(HIB_ZSTD_CMP_SIZE);
+	pdctx = zstd_alloc_parallel_dctx(nr_threads);
+	if (!page || !unc || !cmp || !pdctx) {
+		pr_err("Failed to allocate zstd buffers\n");
+		ret = -ENOMEM;
+		goto out_clean;
+	}
+
+	clean_pages_on_decompress = true;
+
+	/* Read buffering is sized as in load_compressed_image(). */
+	if (low_free_pages() > snapshot_get_image_size())
+		read_pages = (low_free_pages() - snapshot_get_image_size()) / 2;
+	read_pages = clamp_val(read_pages, CMP_MIN_RD_PAGES, CMP_MAX_RD_PAGES);
+
+	for (i = 0; i < read_pages; i++) {
+		page[i] = (void *)__get_free_page(i < HIB_ZSTD_CMP_PAGES ?
+						  GFP_NOIO | __GFP_HIGH :
+						  GFP_NOIO | __GFP_NOWARN |
+						  __GFP_NORETRY);
+
+		if (!page[i]) {
+			if (i < HIB_ZSTD_CMP_PAGES) {
+				ring_size = i;
+				pr_err("Failed to allocate zstd pages\n");
+				ret = -ENOMEM;
+				goto out_clean;
+			} else {
+				break;
+			}
+		}
+	}
+	ring_size = i;
+
+	pr_info("Using %u thread(s) for zstd decompression\n", nr_threads);
+	pr_info("Loading and decompressing image data (%u pages)...\n",
+		nr_to_read);
+	m = nr_to_read / 10;
+	if (!m)
+		m = 1;
+	nr_pages = 0;
+	start = ktime_get();
+
+	ret = snapshot_write_next(snapshot);
+	if (ret <= 0)
+		goto out_finish;
+
+	for (;;) {
+		/*
+		 * Keep every free ring slot busy with a read, so the device
+		 * works on the following records while this one decompresses.
+		 */
+		for (; !eof && have + asked < ring_size; asked++) {
+			ret = swap_read_page(handle, page[ring], &hb);
+			if (ret) {
+				/*
+				 * On real read error, finish. On end of data,
+				 * set EOF flag and just exit the read loop.
+				 */
+				if (handle->cur &&
+				    handle->cur->entries[handle->k])
+					goto out_finish;
+				eof = true;
+				break;
+			}
+			if (++ring >= ring_size)
+				ring = 0;
+		}
+
+		if (!have) {
+			if (!asked) {
+				ret = -ENODATA;
+				goto out_finish;
+			}
+			ret = hib_wait_io(&hb);
+			if (ret)
+				goto out_finish;
+			have += asked;
+			asked = 0;
+		}
+
+		cmp_len = *(size_t *)page[pg];
+		if (unlikely(!cmp_len ||
+			     cmp_len > HIB_ZSTD_CMP_SIZE - CMP_HEADER)) {
+			pr_err("Invalid zstd compressed length\n");
+			ret = -EINVAL;
+			goto out_finish;
+		}
+
+		need = DIV_ROUND_UP(cmp_len + CMP_HEADER, PAGE_SIZE);
+		if (need > have) {
+			if (!asked) {
+				ret = -ENODATA;
+				goto out_finish;
+			}
+			ret = hib_wait_io(&hb);
+			if (ret)
+				goto out_finish;
+			have += asked;
+			asked = 0;
+			continue;
+		}
+
+		for (off = 0; off < CMP_HEADER + cmp_len; off += PAGE_SIZE) {
+			memcpy(cmp + off, page[pg], PAGE_SIZE);
+			have--;
+			if (++pg >= ring_size)
+				pg = 0;
+		}
+
+		cmp_start = ktime_get();
+		unc_len = zstd_parallel_decompress(pdctx, unc,
+						   HIB_ZSTD_UNC_SIZE,
+						   cmp + CMP_HEADER, cmp_len);
+		cmp_time = ktime_add(cmp_time,
+				     ktime_sub(ktime_get(), cmp_start));
+		if (zstd_is_error(unc_len)) {
+			pr_err("zstd decompression failed: %s\n",
+			       zstd_get_error_name(unc_len));
+			ret = -EIO;
+			goto out_finish;
+		}
+
+		if (unlikely(!unc_len || unc_len & (PAGE_SIZE - 1))) {
+			pr_err("Invalid zstd uncompressed length\n");
+			ret = -EINVAL;
+			goto out_finish;
+		}
+
+		handle->crc32 = crc32_le(handle->crc32, unc, unc_len);
+
+		for (off = 0; off < unc_len; off += PAGE_SIZE) {
+			memcpy(data_of(*snapshot), unc + off, PAGE_SIZE);
+			if (clean_pages_on_decompress)
+				flush_icache_range((unsigned long)data_of(*snapshot),
+						   (unsigned long)data_of(*snapshot) +
+						   PAGE_SIZE);
+
+			if (!(nr_pages % m))
+				pr_info("Image loading progress: %3d%%\n",
+					nr_pages / m * 10);
+			nr_pages++;
+
+			ret = snapshot_write_next(snapshot);
+			if (ret <= 0)
+				goto out_finish;
+		}
+	}
+
+out_finish:
+	/* Read-ahead past the last record may still be in flight. */
+	err2 = hib_wait_io(&hb);
+	stop = ktime_get();
+	if (!ret)
+		ret = err2;
+	if (!ret) {
+		pr_info("Image loading done\n");
+		snapshot_write_finalize(snapshot);
+		if (!snapshot_image_loaded(snapshot))
+			ret = -ENODATA;
+		if (!ret && swsusp_header->flags & SF_CRC32_MODE &&
+		    handle->crc32 != swsusp_header->crc32) {
+			pr_err("Invalid image CRC32!\n");
+			ret = -ENODATA;
+		}
+	}
+	swsusp_show_speed(start, stop, nr_to_read, "Read");
+	hib_show_times("Image loading", start, stop, "zstd", cmp_time, &hb);
+out_clean:
+	hib_finish_batch(&hb);
+	for (i = 0; i < ring_size; i++)
+		free_page((unsigned long)page[i]);
+	zstd_free_parallel_dctx(pdctx);
+	vfree(cmp);
+	vfree(unc);
+	vfree(page);
+
+	return ret;
+}
+
 /**
  *	swsusp_read - read the hibernation image.
  *	@flags_p: flags passed by the "frozen" kernel in the image header should
@@ -1497,9 +1996,16 @@ int swsusp_read(unsigned int *flags_p)
 	if (!error)
 		error = swap_read_page(&handle, header, NULL);
 	if (!error) {
-		error = (*flags_p & SF_NOCOMPRESS_MODE) ?
-			load_image(&handle, &snapshot, header->pages - 1) :
-			load_image_lzo(&handle, &snapshot, header->pages - 1);
+		if (*flags_p & SF_NOCOMPRESS_MODE)
+			error = load_image(&handle, &snapshot,
+					   header->pages - 1);
+		else if (*flags_p & SF_COMPRESSION_ALG_ZSTD)
+			error = load_image_zstd(&handle, &snapshot,
+						header->pages - 1);
+		else
+			error = load_compressed_image(&handle, &snapshot,
+						      header->pages - 1,
+						      hib_comp_alg(*flags_p));
 	}
 	swap_reader_finish(&handle);
 end:
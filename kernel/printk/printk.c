@@ -37,6 +37,9 @@
 #include <linux/crash_core.h>
 #include <linux/ratelimit.h>
 #include <linux/kmsg_dump.h>
+#include <linux/kthread.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/syslog.h>
 #include <linux/cpu.h>
 #include <linux/rculist.h>
@@ -277,6 +280,62 @@ static bool panic_in_progress(void)
  */
 static int console_locked, console_suspended;
 
+/*
+ * Once the printing kthreads are running, printk() only stores records and
+ * wakes them up. Each console is then fed by its own thread at its own
+ * pace. The threads do not take console_sem, they are held off by holders
+ * of the console lock in one of two ways:
+ *
+ * - console_lock() sets @blocked on every console under its @lock mutex,
+ *   which also waits for a thread that is in the middle of a record.
+ *
+ * - console_trylock() can't sleep and instead succeeds only while no
+ *   thread is printing, which @console_kthreads_active tracks:
+ *   -1 = threads blocked by console_trylock()
+ *    0 = no thread printing
+ *   >0 = number of threads printing a record
+ */
+static atomic_t console_kthreads_active = ATOMIC_INIT(0);
+static bool console_kthreads_blocked;
+
+#define console_kthreads_atomic_tryblock() \
+	(atomic_cmpxchg(&console_kthreads_active, 0, -1) == 0)
+#define console_kthreads_atomic_unblock() \
+	atomic_cmpxchg(&console_kthreads_active, -1, 0)
+#define console_kthreads_atomically_blocked() \
+	(atomic_read(&console_kthreads_active) == -1)
+
+#define console_kthread_printing_tryenter() \
+	atomic_inc_unless_negative(&console_kthreads_active)
+#define console_kthread_printing_exit() \
+	atomic_dec(&console_kthreads_active)
+
+/* Set once all registered consoles have a printing kthread. */
+static bool printk_kthreads_available;
+/* Set once the kthreads are started, consoles registered later get one too. */
+static bool printk_kthreads_running;
+
+static bool console_kthreads = true;
+module_param(console_kthreads, bool, 0444);
+MODULE_PARM_DESC(console_kthreads, "print to consoles from per-console kthreads");
+
+/* Nesting count of printk_prefer_direct_enter() callers */
+static atomic_t printk_prefer_direct = ATOMIC_INIT(0);
+
+/*
+ * Printing from the calling context is only done when the kthreads can't be
+ * relied upon: before they are up, on the way down, and when the system is
+ * in trouble.
+ */
+static inline bool allow_direct_printing(void)
+{
+	return (!READ_ONCE(printk_kthreads_available) ||
+		system_state > SYSTEM_RUNNING ||
+		oops_in_progress ||
+		atomic_read(&printk_prefer_direct) ||
+		panic_in_progress());
+}
+
 /*
  *	Array of consoles built from command line options (console=)
  */
@@ -2248,8 +2307,11 @@ asmlinkage int vprintk_emit(int facility, int level,
 
 	printed_len = vprintk_store(facility, level, dev_info, fmt, args);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	/*
+	 * If called from the scheduler, we can not call up(). Otherwise
+	 * only print here if the printing kthreads can't do it.
+	 */
+	if (!in_sched && allow_direct_printing()) {
 		/*
 		 * The caller may be holding system-critical or
 		 * timing-sensitive locks. Disable preemption during
@@ -2295,6 +2357,7 @@ EXPORT_SYMBOL(_printk);
 
 static bool pr_flush(int timeout_ms, bool reset_on_progress);
 static bool __pr_flush(struct console *con, int timeout_ms, bool reset_on_progress);
+static void printk_start_kthread(struct console *con);
 
 #else /* CONFIG_PRINTK */
 
@@ -2330,6 +2393,7 @@ static void call_console_driver(struct console *con, const char *text, size_t le
 static bool suppress_message_printing(int level) { return false; }
 static bool pr_flush(int timeout_ms, bool reset_on_progress) { return true; }
 static bool __pr_flush(struct console *con, int timeout_ms, bool reset_on_progress) { return true; }
+static void printk_start_kthread(struct console *con) { }
 
 #endif /* CONFIG_PRINTK */
 
@@ -2552,6 +2616,33 @@ static int console_cpu_notify(unsigned int cpu)
 	return 0;
 }
 
+/* Wait for the printing kthreads to finish their record and hold them off. */
+static void console_kthreads_block(void)
+{
+	struct console *con;
+
+	for_each_console(con) {
+		mutex_lock(&con->lock);
+		con->blocked = true;
+		mutex_unlock(&con->lock);
+	}
+
+	console_kthreads_blocked = true;
+}
+
+static void console_kthreads_unblock(void)
+{
+	struct console *con;
+
+	for_each_console(con) {
+		mutex_lock(&con->lock);
+		con->blocked = false;
+		mutex_unlock(&con->lock);
+	}
+
+	console_kthreads_blocked = false;
+}
+
 /**
  * console_lock - lock the console system for exclusive use.
  *
@@ -2567,6 +2658,7 @@ void console_lock(void)
 	down_console_sem();
 	if (console_suspended)
 		return;
+	console_kthreads_block();
 	console_locked = 1;
 	console_may_schedule = 1;
 }
@@ -2588,6 +2680,15 @@ int console_trylock(void)
 		up_console_sem();
 		return 0;
 	}
+	/*
+	 * A printing kthread may be in the middle of a record. The panic CPU
+	 * goes ahead anyway, the thread may well have been stopped with it.
+	 */
+	if (!console_kthreads_atomic_tryblock() &&
+	    atomic_read(&panic_cpu) != raw_smp_processor_id()) {
+		up_console_sem();
+		return 0;
+	}
 	console_locked = 1;
 	console_may_schedule = 0;
 	return 1;
@@ -2648,7 +2749,12 @@ static inline bool console_is_usable(struct console *con)
 static void __console_unlock(void)
 {
 	console_locked = 0;
+	console_kthreads_atomic_unblock();
 	up_console_sem();
+
+	/* Let the printing kthreads see what arrived while we held the lock. */
+	if (READ_ONCE(printk_kthreads_available))
+		wake_up_klogd();
 }
 
 /*
@@ -2665,12 +2771,14 @@ static void __console_unlock(void)
  *
  * @handover will be set to true if a printk waiter has taken over the
  * console_lock, in which case the caller is no longer holding the
- * console_lock. Otherwise it is set to false.
+ * console_lock. Otherwise it is set to false. Printing kthreads don't own
+ * the console_lock and pass NULL, there is nothing to hand over then.
  *
  * Returns false if the given console has no next record to print, otherwise
  * true.
  *
- * Requires the console_lock.
+ * Requires the console_lock, or a printing kthread inside
+ * console_kthread_printing_tryenter().
  */
 static bool console_emit_next_record(struct console *con, char *text, char *ext_text,
 				     char *dropped_text, bool *handover)
@@ -2684,13 +2792,15 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 
 	prb_rec_init_rd(&r, &info, text, CONSOLE_LOG_MAX);
 
-	*handover = false;
+	if (handover)
+		*handover = false;
 
 	if (!prb_read_valid(prb, con->seq, &r))
 		return false;
 
 	if (con->seq != r.info->seq) {
 		con->dropped += r.info->seq - con->seq;
+		con->dropped_total += r.info->seq - con->seq;
 		con->seq = r.info->seq;
 		if (panic_in_progress() && panic_console_dropped++ > 10) {
 			suppress_panic_printk = 1;
@@ -2725,7 +2835,8 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 	 * (@console_waiter is cleared).
 	 */
 	printk_safe_enter_irqsave(flags);
-	console_lock_spinning_enable();
+	if (handover)
+		console_lock_spinning_enable();
 
 	stop_critical_timings();	/* don't trace print latency */
 	call_console_driver(con, write_text, len, dropped_text);
@@ -2733,7 +2844,8 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 
 	con->seq++;
 
-	*handover = console_lock_spinning_disable_and_check();
+	if (handover)
+		*handover = console_lock_spinning_disable_and_check();
 	printk_safe_exit_irqrestore(flags);
 skip:
 	return true;
@@ -2841,6 +2953,24 @@ void console_unlock(void)
 		return;
 	}
 
+	/*
+	 * Switch a console_lock() over to the atomic blocking used by
+	 * console_trylock(): a printk() waiter may be handed the lock below
+	 * and then has to release it from atomic context. No kthread can be
+	 * printing, so this cannot fail. During a panic the kthreads simply
+	 * stay blocked.
+	 */
+	if (console_kthreads_blocked && !panic_in_progress()) {
+		WARN_ON_ONCE(!console_kthreads_atomic_tryblock());
+		console_kthreads_unblock();
+	}
+
+	/* Leave the records to the printing kthreads if they are up. */
+	if (!allow_direct_printing()) {
+		__console_unlock();
+		return;
+	}
+
 	/*
 	 * Console drivers are called with interrupts disabled, so
 	 * @console_may_schedule should be cleared before; however, we may
@@ -3168,6 +3298,11 @@ void register_console(struct console *newcon)
 		newcon->flags &= ~CON_PRINTBUFFER;
 	}
 
+	mutex_init(&newcon->lock);
+	newcon->thread = NULL;
+	/* Unblocked with all the others by console_unlock() below. */
+	newcon->blocked = true;
+
 	/*
 	 *	Put this console in the list - keep the
 	 *	preferred driver at the head of the list.
@@ -3186,6 +3321,7 @@ void register_console(struct console *newcon)
 	}
 
 	newcon->dropped = 0;
+	newcon->dropped_total = 0;
 	if (newcon->flags & CON_PRINTBUFFER) {
 		/* Get a consistent copy of @syslog_seq. */
 		mutex_lock(&syslog_lock);
@@ -3195,6 +3331,8 @@ void register_console(struct console *newcon)
 		/* Begin with next message. */
 		newcon->seq = prb_next_seq(prb);
 	}
+	if (printk_kthreads_running)
+		printk_start_kthread(newcon);
 	console_unlock();
 	console_sysfs_notify();
 
@@ -3255,6 +3393,12 @@ int unregister_console(struct console *console)
 		console_drivers->flags |= CON_CONSDEV;
 
 	console->flags &= ~CON_ENABLED;
+
+	/* The thread is blocked by console_lock() and can't be printing. */
+	if (console->thread) {
+		kthread_stop(console->thread);
+		console->thread = NULL;
+	}
 	console_unlock();
 	console_sysfs_notify();
 
@@ -3433,6 +3577,205 @@ static bool pr_flush(int timeout_ms, bool reset_on_progress)
 	return __pr_flush(NULL, timeout_ms, reset_on_progress);
 }
 
+/**
+ * printk_prefer_direct_enter - cause printk() calls to attempt direct
+ *                              printing to all enabled consoles
+ *
+ * Since it is not possible to call into the console printing code from any
+ * context, there is no guarantee that direct printing will occur.
+ *
+ * This globally effects all printk() callers.
+ *
+ * Context: Any context.
+ */
+void printk_prefer_direct_enter(void)
+{
+	atomic_inc(&printk_prefer_direct);
+}
+EXPORT_SYMBOL_GPL(printk_prefer_direct_enter);
+
+/**
+ * printk_prefer_direct_exit - restore printk() behavior
+ *
+ * Context: Any context.
+ */
+void printk_prefer_direct_exit(void)
+{
+	WARN_ON(atomic_dec_if_positive(&printk_prefer_direct) < 0);
+}
+EXPORT_SYMBOL_GPL(printk_prefer_direct_exit);
+
+static void printk_fallback_direct(void)
+{
+	WRITE_ONCE(printk_kthreads_available, false);
+	pr_err("falling back to printing from printk() callers\n");
+}
+
+static bool printer_should_wake(struct console *con, u64 seq)
+{
+	short flags;
+
+	if (kthread_should_stop())
+		return true;
+
+	/*
+	 * Racy reads, a wrong answer only means a spurious wake-up or
+	 * waiting for the next one.
+	 */
+	flags = data_race(READ_ONCE(con->flags));
+	if (!(flags & CON_ENABLED))
+		return false;
+
+	if (data_race(READ_ONCE(con->blocked)) ||
+	    console_kthreads_atomically_blocked() ||
+	    panic_in_progress())
+		return false;
+
+	return prb_read_valid(prb, seq, NULL);
+}
+
+static int printk_kthread_func(void *data)
+{
+	struct console *con = data;
+	char *dropped_text = NULL;
+	char *ext_text = NULL;
+	u64 seq = 0;
+	char *text;
+	int error;
+
+	text = kmalloc(CONSOLE_LOG_MAX, GFP_KERNEL);
+	if (con->flags & CON_EXTENDED)
+		ext_text = kmalloc(CONSOLE_EXT_LOG_MAX, GFP_KERNEL);
+	else
+		dropped_text = kmalloc(DROPPED_TEXT_MAX, GFP_KERNEL);
+	if (!text || (!ext_text && !dropped_text)) {
+		con_printk(KERN_ERR, con, "failed to allocate printing buffers\n");
+		printk_fallback_direct();
+		goto out;
+	}
+
+	for (;;) {
+		error = wait_event_interruptible(log_wait,
+						 printer_should_wake(con, seq));
+
+		if (kthread_should_stop())
+			break;
+
+		if (error)
+			continue;
+
+		error = mutex_lock_interruptible(&con->lock);
+		if (error)
+			continue;
+
+		if (con->blocked || panic_in_progress() ||
+		    !console_kthread_printing_tryenter()) {
+			/* Another context holds the console lock. */
+			mutex_unlock(&con->lock);
+			continue;
+		}
+
+		/*
+		 * One record at a time, so a console_lock() waiter gets in
+		 * between records and the wait above re-checks the flags.
+		 */
+		if (console_is_usable(con))
+			console_emit_next_record(con, text, ext_text,
+						 dropped_text, NULL);
+		seq = con->seq;
+
+		console_kthread_printing_exit();
+		mutex_unlock(&con->lock);
+	}
+out:
+	kfree(dropped_text);
+	kfree(ext_text);
+	kfree(text);
+
+	/* Only unregister_console() gets rid of the thread. */
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+/* Requires the console_lock. */
+static void printk_start_kthread(struct console *con)
+{
+	struct task_struct *thread;
+
+	if (!con->write)
+		return;
+
+	thread = kthread_run(printk_kthread_func, con, "pr/%s%d",
+			     con->name, con->index);
+	if (IS_ERR(thread)) {
+		con_printk(KERN_ERR, con, "unable to start printing thread\n");
+		printk_fallback_direct();
+		return;
+	}
+
+	con->thread = thread;
+}
+
+static int __init printk_activate_kthreads(void)
+{
+	struct console *con;
+
+	if (!console_kthreads)
+		return 0;
+
+	console_lock();
+	printk_kthreads_running = true;
+	WRITE_ONCE(printk_kthreads_available, true);
+	for_each_console(con)
+		printk_start_kthread(con);
+	console_unlock();
+
+	return 0;
+}
+early_initcall(printk_activate_kthreads);
+
+#ifdef CONFIG_DEBUG_FS
+/* How far each console is behind, and how much it never got to print. */
+static int printk_consoles_show(struct seq_file *m, void *v)
+{
+	u64 next_seq = prb_next_seq(prb);
+	struct console *con;
+
+	seq_printf(m, "%-16s %12s %10s %10s %8s\n",
+		   "console", "seq", "lag", "dropped", "thread");
+
+	console_lock();
+	for_each_console(con) {
+		char name[sizeof(con->name) + 4];
+
+		snprintf(name, sizeof(name), "%s%d", con->name, con->index);
+		seq_printf(m, "%-16s %12llu %10llu %10lu %8d\n", name, con->seq,
+			   next_seq > con->seq ? next_seq - con->seq : 0,
+			   con->dropped_total,
+			   con->thread ? task_pid_nr(con->thread) : 0);
+	}
+	console_unlock();
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(printk_consoles);
+
+static int __init printk_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("printk", NULL);
+
+	debugfs_create_file("consoles", 0400, dir, NULL, &printk_consoles_fops);
+	return 0;
+}
+late_initcall(printk_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 /*
  * Delayed printk version, for scheduler-internal messages:
  */
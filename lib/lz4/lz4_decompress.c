@@ -39,6 +39,10 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <asm/unaligned.h>
+#if !defined(STATIC) && !defined(LZ4_DECOMPRESS_GENERIC_ONLY)
+#include <linux/jump_label.h>
+#include <asm/simd.h>
+#endif
 
 /*-*****************************
  *	Decompression functions
@@ -457,9 +461,39 @@ static FORCE_INLINE int LZ4_decompress_generic(
 	return (int) (-(((const char *)ip) - src)) - 1;
 }
 
+/*
+ * Architecture code may instantiate LZ4_decompress_generic() on its own
+ * (e.g. with SIMD copy helpers) by defining LZ4_DECOMPRESS_GENERIC_ONLY
+ * and including this file; everything below is only built once, here.
+ */
+#ifndef LZ4_DECOMPRESS_GENERIC_ONLY
+
+#ifndef STATIC
+static DEFINE_STATIC_KEY_FALSE(LZ4_arch_decompress_key);
+static int (*LZ4_arch_decompress_safe)(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize) __read_mostly;
+
+void LZ4_set_arch_decompress_safe(int (*fn)(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize))
+{
+	if (!fn) {
+		static_branch_disable(&LZ4_arch_decompress_key);
+		return;
+	}
+	WRITE_ONCE(LZ4_arch_decompress_safe, fn);
+	static_branch_enable(&LZ4_arch_decompress_key);
+}
+#endif
+
 int LZ4_decompress_safe(const char *source, char *dest,
 	int compressedSize, int maxDecompressedSize)
 {
+#ifndef STATIC
+	if (static_branch_unlikely(&LZ4_arch_decompress_key) &&
+	    may_use_simd())
+		return READ_ONCE(LZ4_arch_decompress_safe)(source, dest,
+			compressedSize, maxDecompressedSize);
+#endif
 	return LZ4_decompress_generic(source, dest,
 				      compressedSize, maxDecompressedSize,
 				      endOnInputSize, decode_full_block,
@@ -707,6 +741,7 @@ int LZ4_decompress_fast_usingDict(const char *source, char *dest,
 
 #ifndef STATIC
 EXPORT_SYMBOL(LZ4_decompress_safe);
+EXPORT_SYMBOL_GPL(LZ4_set_arch_decompress_safe);
 EXPORT_SYMBOL(LZ4_decompress_safe_partial);
 EXPORT_SYMBOL(LZ4_decompress_fast);
 EXPORT_SYMBOL(LZ4_setStreamDecode);
@@ -718,3 +753,5 @@ EXPORT_SYMBOL(LZ4_decompress_fast_usingDict);
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("LZ4 decompressor");
 #endif
+
+#endif /* LZ4_DECOMPRESS_GENERIC_ONLY */
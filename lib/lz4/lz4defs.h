@@ -168,7 +168,12 @@ static FORCE_INLINE void LZ4_copy8(void *dst, const void *src)
 /*
  * customized variant of memcpy,
  * which can overwrite up to 7 bytes beyond dstEnd
+ *
+ * Architecture specific instantiations of the decoder may provide their
+ * own implementation with the same contract by defining LZ4_wildCopy
+ * before including this file.
  */
+#ifndef LZ4_wildCopy
 static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
 	const void *srcPtr, void *dstEnd)
 {
@@ -182,6 +187,7 @@ static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
 		s += 8;
 	} while (d < e);
 }
+#endif
 
 static FORCE_INLINE unsigned int LZ4_NbCommonBytes(register size_t val)
 {
@@ -18,6 +18,9 @@
 #else
 #include <linux/module.h>
 #include <linux/gfp.h>
+#include <linux/cpu.h>
+#include <linux/sched/topology.h>
+#include <linux/workqueue.h>
 #if !RAID6_USE_EMPTY_ZERO_PAGE
 /* In .bss so it's zeroed */
 const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
@@ -142,45 +145,158 @@ static inline const struct raid6_recov_calls *raid6_choose_recov(void)
 	return best;
 }
 
-static inline const struct raid6_calls *raid6_choose_gen(
-	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks)
+static unsigned long raid6_time_gen(const struct raid6_calls *algo,
+	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks, int xor)
 {
-	unsigned long perf, bestgenperf, j0, j1;
 	int start = (disks>>1)-1, stop = disks-3;	/* work on the second half of the disks */
-	const struct raid6_calls *const *algo;
+	unsigned long perf = 0, j0, j1;
+
+	preempt_disable();
+	j0 = jiffies;
+	while ((j1 = jiffies) == j0)
+		cpu_relax();
+	while (time_before(jiffies, j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+		if (xor)
+			algo->xor_syndrome(disks, start, stop, PAGE_SIZE, *dptrs);
+		else
+			algo->gen_syndrome(disks, PAGE_SIZE, *dptrs);
+		perf++;
+	}
+	preempt_enable();
+
+	return perf;
+}
+
+#define RAID6_PERF_MBS(perf, disks)					\
+	(((perf) * HZ * ((disks) - 2)) >>				\
+	 (20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2))
+
+struct raid6_gen_bench {
+	void *(*dptrs)[RAID6_TEST_DISKS];
+	int disks;
 	const struct raid6_calls *best;
+	unsigned long genperf;
+	unsigned long xorperf;
+};
 
-	for (bestgenperf = 0, best = NULL, algo = raid6_algos; *algo; algo++) {
-		if (!best || (*algo)->priority >= best->priority) {
-			if ((*algo)->valid && !(*algo)->valid())
-				continue;
+/* Benchmark every usable algorithm on the calling CPU. */
+static long raid6_bench_gen(void *data)
+{
+	struct raid6_gen_bench *b = data;
+	const struct raid6_calls *const *algo;
+	unsigned long perf;
+
+	b->best = NULL;
+	b->genperf = 0;
+	b->xorperf = 0;
+
+	for (algo = raid6_algos; *algo; algo++) {
+		if (b->best && (*algo)->priority < b->best->priority)
+			continue;
+		if ((*algo)->valid && !(*algo)->valid())
+			continue;
+
+		perf = raid6_time_gen(*algo, b->dptrs, b->disks, 0);
+		if (perf > b->genperf) {
+			b->genperf = perf;
+			b->best = *algo;
+		}
+		pr_info("raid6: %-8s gen() %5ld MB/s\n", (*algo)->name,
+			RAID6_PERF_MBS(perf, b->disks));
+	}
 
-			if (!IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK)) {
-				best = *algo;
-				break;
-			}
+	if (b->best && b->best->xor_syndrome)
+		b->xorperf = raid6_time_gen(b->best, b->dptrs, b->disks, 1);
 
-			perf = 0;
+	return 0;
+}
 
-			preempt_disable();
-			j0 = jiffies;
-			while ((j1 = jiffies) == j0)
-				cpu_relax();
-			while (time_before(jiffies,
-					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
-				(*algo)->gen_syndrome(disks, PAGE_SIZE, *dptrs);
-				perf++;
-			}
-			preempt_enable();
+#ifdef __KERNEL__
+/* Is @cpu the first online CPU of its capacity? */
+static bool raid6_capacity_first(int cpu)
+{
+	int other;
+
+	for_each_online_cpu(other) {
+		if (other >= cpu)
+			return true;
+		if (arch_scale_cpu_capacity(other) ==
+		    arch_scale_cpu_capacity(cpu))
+			return false;
+	}
+	return true;
+}
 
-			if (perf > bestgenperf) {
-				bestgenperf = perf;
+/*
+ * The ranking of the algorithms depends on the core type, so on systems
+ * with asymmetric CPU capacities (big.LITTLE) the result from the boot CPU,
+ * which is often a little core, is not what the big cores should use.
+ * Benchmark once on a CPU of each capacity and keep the pick made on the
+ * most capable ones, as those are where the scheduler places the md
+ * threads doing the bulk of the RAID6 work.
+ */
+static void raid6_bench_gen_capacities(struct raid6_gen_bench *b)
+{
+	struct raid6_gen_bench res = *b;
+	unsigned long cap, bestcap = 0;
+	int cpu, nr_caps = 0;
+
+	cpus_read_lock();
+
+	for_each_online_cpu(cpu)
+		nr_caps += raid6_capacity_first(cpu);
+
+	if (nr_caps <= 1) {
+		cpus_read_unlock();
+		raid6_bench_gen(b);
+		return;
+	}
+
+	for_each_online_cpu(cpu) {
+		if (!raid6_capacity_first(cpu))
+			continue;
+
+		cap = arch_scale_cpu_capacity(cpu);
+		pr_info("raid6: benchmarking on CPU%d (capacity %lu)\n",
+			cpu, cap);
+		work_on_cpu(cpu, raid6_bench_gen, &res);
+		if (!res.best)
+			continue;
+
+		pr_info("raid6: CPU%d (capacity %lu) prefers %s\n",
+			cpu, cap, res.best->name);
+		if (cap > bestcap) {
+			bestcap = cap;
+			*b = res;
+		}
+	}
+
+	cpus_read_unlock();
+}
+#else
+static void raid6_bench_gen_capacities(struct raid6_gen_bench *b)
+{
+	raid6_bench_gen(b);
+}
+#endif
+
+static inline const struct raid6_calls *raid6_choose_gen(
+	void *(*const dptrs)[RAID6_TEST_DISKS], const int disks)
+{
+	struct raid6_gen_bench b = { .dptrs = dptrs, .disks = disks };
+	const struct raid6_calls *const *algo;
+	const struct raid6_calls *best = NULL;
+
+	if (!IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK)) {
+		for (algo = raid6_algos; *algo; algo++) {
+			if (!(*algo)->valid || (*algo)->valid()) {
 				best = *algo;
+				break;
 			}
-			pr_info("raid6: %-8s gen() %5ld MB/s\n", (*algo)->name,
-				(perf * HZ * (disks-2)) >>
-				(20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2));
 		}
+	} else {
+		raid6_bench_gen_capacities(&b);
+		best = b.best;
 	}
 
 	if (!best) {
@@ -197,35 +313,17 @@ static inline const struct raid6_calls *raid6_choose_gen(
 	}
 
 	pr_info("raid6: using algorithm %s gen() %ld MB/s\n",
-		best->name,
-		(bestgenperf * HZ * (disks - 2)) >>
-		(20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2));
-
-	if (best->xor_syndrome) {
-		perf = 0;
-
-		preempt_disable();
-		j0 = jiffies;
-		while ((j1 = jiffies) == j0)
-			cpu_relax();
-		while (time_before(jiffies,
-				   j1 + (1 << RAID6_TIME_JIFFIES_LG2))) {
-			best->xor_syndrome(disks, start, stop,
-					   PAGE_SIZE, *dptrs);
-			perf++;
-		}
-		preempt_enable();
+		best->name, RAID6_PERF_MBS(b.genperf, disks));
 
+	/* xor() is only timed on the CPU whose pick was kept. */
+	if (best->xor_syndrome && b.xorperf)
 		pr_info("raid6: .... xor() %ld MB/s, rmw enabled\n",
-			(perf * HZ * (disks - 2)) >>
-			(20 - PAGE_SHIFT + RAID6_TIME_JIFFIES_LG2 + 1));
-	}
+			RAID6_PERF_MBS(b.xorperf, disks) >> 1);
 
 out:
 	return best;
 }
 
-
 /* Try to pick the best algorithm */
 /* This code uses the gfmul table as convenient data set to abuse */
 
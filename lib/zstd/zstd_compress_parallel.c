@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0+ OR BSD-3-Clause
+/*
+ * Parallel compression of large buffers.
+ *
+ * The input is cut into chunks of a fixed size and every chunk becomes an
+ * independent zstd frame. Up to nr_workers chunks are compressed at the
+ * same time on the unbound workqueue, each into a private buffer, and the
+ * frames are appended to the output in input order as they complete. The
+ * result is an ordinary sequence of concatenated frames, so any zstd
+ * decoder can read it; zstd_parallel_decompress() decodes it in parallel.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <linux/zstd.h>
+
+#include "common/zstd_deps.h"
+#include "common/error_private.h"
+
+struct zstd_parallel_cworker {
+	struct work_struct work;
+	const zstd_parameters *params;
+	zstd_cctx *cctx;
+	void *workspace;
+	void *buf;			/* compressed frame */
+	size_t buf_size;
+	const void *src;		/* chunk being compressed */
+	size_t src_size;
+	size_t ret;			/* frame size or zstd error */
+};
+
+struct zstd_parallel_cctx_s {
+	zstd_parameters params;
+	size_t chunk_size;
+	unsigned int nr_workers;
+	struct zstd_parallel_cworker workers[];
+};
+
+static void zstd_parallel_compress_work(struct work_struct *work)
+{
+	struct zstd_parallel_cworker *w =
+		container_of(work, struct zstd_parallel_cworker, work);
+
+	w->ret = zstd_compress_cctx(w->cctx, w->buf, w->buf_size,
+				    w->src, w->src_size, w->params);
+}
+
+zstd_parallel_cctx *zstd_alloc_parallel_cctx(int level, size_t chunk_size,
+	unsigned int nr_workers)
+{
+	zstd_parallel_cctx *pctx;
+	size_t workspace_size;
+	unsigned int i;
+
+	if (!chunk_size)
+		return NULL;
+	if (!nr_workers)
+		nr_workers = num_online_cpus();
+
+	pctx = kzalloc(struct_size(pctx, workers, nr_workers), GFP_KERNEL);
+	if (!pctx)
+		return NULL;
+
+	pctx->params = zstd_get_params(level, chunk_size);
+	/* Decoders rely on the content size to place frames in the output. */
+	pctx->params.fParams.contentSizeFlag = 1;
+	pctx->chunk_size = chunk_size;
+	pctx->nr_workers = nr_workers;
+
+	workspace_size = zstd_cctx_workspace_bound(&pctx->params.cParams);
+	for (i = 0; i < nr_workers; i++) {
+		struct zstd_parallel_cworker *w = &pctx->workers[i];
+
+		INIT_WORK(&w->work, zstd_parallel_compress_work);
+		w->params = &pctx->params;
+		w->workspace = kvmalloc(workspace_size, GFP_KERNEL);
+		w->cctx = zstd_init_cctx(w->workspace, workspace_size);
+		w->buf_size = zstd_compress_bound(chunk_size);
+		w->buf = kvmalloc(w->buf_size, GFP_KERNEL);
+		if (!w->cctx || !w->buf) {
+			zstd_free_parallel_cctx(pctx);
+			return NULL;
+		}
+	}
+
+	return pctx;
+}
+EXPORT_SYMBOL(zstd_alloc_parallel_cctx);
+
+void zstd_free_parallel_cctx(zstd_parallel_cctx *pctx)
+{
+	unsigned int i;
+
+	if (!pctx)
+		return;
+
+	for (i = 0; i < pctx->nr_workers; i++) {
+		kvfree(pctx->workers[i].buf);
+		kvfree(pctx->workers[i].workspace);
+	}
+	kfree(pctx);
+}
+EXPORT_SYMBOL(zstd_free_parallel_cctx);
+
+size_t zstd_parallel_compress_bound(const zstd_parallel_cctx *pctx,
+	size_t src_size)
+{
+	size_t full = src_size / pctx->chunk_size;
+	size_t rem = src_size % pctx->chunk_size;
+
+	return full * zstd_compress_bound(pctx->chunk_size) +
+	       (rem ? zstd_compress_bound(rem) : 0);
+}
+EXPORT_SYMBOL(zstd_parallel_compress_bound);
+
+size_t zstd_parallel_compress(zstd_parallel_cctx *pctx, void *dst,
+	size_t dst_capacity, const void *src, size_t src_size)
+{
+	size_t nr_chunks = DIV_ROUND_UP(src_size, pctx->chunk_size);
+	size_t next = 0, i, pos = 0;
+	size_t err = 0;
+
+	/* Nothing to overlap with: compress straight into dst. */
+	if (nr_chunks <= 1 || pctx->nr_workers == 1) {
+		for (i = 0; i < nr_chunks; i++) {
+			size_t off = i * pctx->chunk_size;
+			size_t ret;
+
+			ret = zstd_compress_cctx(pctx->workers[0].cctx,
+				(u8 *)dst + pos, dst_capacity - pos,
+				(const u8 *)src + off,
+				min(pctx->chunk_size, src_size - off),
+				&pctx->params);
+			if (zstd_is_error(ret))
+				return ret;
+			pos += ret;
+		}
+		return pos;
+	}
+
+	/*
+	 * Chunk i always goes to worker i % nr_workers, so completions are
+	 * collected in input order and a worker is handed its next chunk as
+	 * soon as its previous frame has been copied out.
+	 */
+	for (; next < nr_chunks && next < pctx->nr_workers; next++) {
+		struct zstd_parallel_cworker *w = &pctx->workers[next];
+
+		w->src = (const u8 *)src + next * pctx->chunk_size;
+		w->src_size = min(pctx->chunk_size,
+				  src_size - next * pctx->chunk_size);
+		queue_work(system_unbound_wq, &w->work);
+	}
+
+	for (i = 0; i < next; i++) {
+		struct zstd_parallel_cworker *w =
+			&pctx->workers[i % pctx->nr_workers];
+
+		flush_work(&w->work);
+
+		if (err)
+			continue;
+		if (zstd_is_error(w->ret)) {
+			err = w->ret;
+			continue;
+		}
+		if (w->ret > dst_capacity - pos) {
+			err = ERROR(dstSize_tooSmall);
+			continue;
+		}
+		memcpy((u8 *)dst + pos, w->buf, w->ret);
+		pos += w->ret;
+
+		if (next < nr_chunks) {
+			w->src = (const u8 *)src + next * pctx->chunk_size;
+			w->src_size = min(pctx->chunk_size,
+					  src_size - next * pctx->chunk_size);
+			queue_work(system_unbound_wq, &w->work);
+			next++;
+		}
+	}
+
+	return err ? err : pos;
+}
+EXPORT_SYMBOL(zstd_parallel_compress);
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0+ OR BSD-3-Clause
+/*
+ * Parallel decompression of concatenated frames.
+ *
+ * Frames that record their content size can be decoded independently
+ * straight into their final place in the output, so they are spread over
+ * up to nr_workers work items on the unbound workqueue. This matches the
+ * output of zstd_parallel_compress(). Input without content sizes is still
+ * accepted, it is just decoded serially from the first such frame on.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <linux/zstd.h>
+
+#include "common/zstd_deps.h"
+#include "common/error_private.h"
+
+struct zstd_parallel_dworker {
+	struct work_struct work;
+	zstd_dctx *dctx;
+	void *workspace;
+	const void *src;		/* one frame */
+	size_t src_size;
+	void *dst;
+	size_t dst_size;		/* frame content size */
+	size_t ret;			/* decoded size or zstd error */
+};
+
+struct zstd_parallel_dctx_s {
+	unsigned int nr_workers;
+	struct zstd_parallel_dworker workers[];
+};
+
+static void zstd_parallel_decompress_work(struct work_struct *work)
+{
+	struct zstd_parallel_dworker *w =
+		container_of(work, struct zstd_parallel_dworker, work);
+
+	w->ret = zstd_decompress_dctx(w->dctx, w->dst, w->dst_size,
+				      w->src, w->src_size);
+	if (!zstd_is_error(w->ret) && w->ret != w->dst_size)
+		w->ret = ERROR(corruption_detected);
+}
+
+zstd_parallel_dctx *zstd_alloc_parallel_dctx(unsigned int nr_workers)
+{
+	zstd_parallel_dctx *pdctx;
+	size_t workspace_size = zstd_dctx_workspace_bound();
+	unsigned int i;
+
+	if (!nr_workers)
+		nr_workers = num_online_cpus();
+
+	pdctx = kzalloc(struct_size(pdctx, workers, nr_workers), GFP_KERNEL);
+	if (!pdctx)
+		return NULL;
+
+	pdctx->nr_workers = nr_workers;
+	for (i = 0; i < nr_workers; i++) {
+		struct zstd_parallel_dworker *w = &pdctx->workers[i];
+
+		INIT_WORK(&w->work, zstd_parallel_decompress_work);
+		w->workspace = kvmalloc(workspace_size, GFP_KERNEL);
+		w->dctx = zstd_init_dctx(w->workspace, workspace_size);
+		if (!w->dctx) {
+			zstd_free_parallel_dctx(pdctx);
+			return NULL;
+		}
+	}
+
+	return pdctx;
+}
+EXPORT_SYMBOL(zstd_alloc_parallel_dctx);
+
+void zstd_free_parallel_dctx(zstd_parallel_dctx *pdctx)
+{
+	unsigned int i;
+
+	if (!pdctx)
+		return;
+
+	for (i = 0; i < pdctx->nr_workers; i++)
+		kvfree(pdctx->workers[i].workspace);
+	kfree(pdctx);
+}
+EXPORT_SYMBOL(zstd_free_parallel_dctx);
+
+size_t zstd_parallel_decompress(zstd_parallel_dctx *pdctx, void *dst,
+	size_t dst_capacity, const void *src, size_t src_size)
+{
+	const u8 *ip = src;
+	const u8 *const iend = ip + src_size;
+	u8 *op = dst;
+	u8 *const oend = op + dst_capacity;
+	unsigned int busy = 0, slot = 0, i;
+	size_t err = 0, ret;
+
+	while (ip < iend) {
+		struct zstd_parallel_dworker *w;
+		zstd_frame_header fh;
+		size_t frame_size;
+
+		ret = zstd_get_frame_header(&fh, ip, iend - ip);
+		if (zstd_is_error(ret)) {
+			err = ret;
+			break;
+		}
+		if (ret) {
+			err = ERROR(srcSize_wrong);
+			break;
+		}
+
+		frame_size = zstd_find_frame_compressed_size(ip, iend - ip);
+		if (zstd_is_error(frame_size)) {
+			err = frame_size;
+			break;
+		}
+
+		if (fh.frameType == ZSTD_skippableFrame) {
+			ip += frame_size;
+			continue;
+		}
+
+		/*
+		 * Without a content size the output offset of the next frame
+		 * is unknown, so decode the rest after the in-flight frames.
+		 */
+		if (fh.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+			break;
+
+		if (fh.frameContentSize > (size_t)(oend - op)) {
+			err = ERROR(dstSize_tooSmall);
+			break;
+		}
+
+		w = &pdctx->workers[slot];
+		if (busy == pdctx->nr_workers) {
+			flush_work(&w->work);
+			if (zstd_is_error(w->ret)) {
+				err = w->ret;
+				break;
+			}
+		} else {
+			busy++;
+		}
+
+		w->src = ip;
+		w->src_size = frame_size;
+		w->dst = op;
+		w->dst_size = fh.frameContentSize;
+		queue_work(system_unbound_wq, &w->work);
+
+		ip += frame_size;
+		op += fh.frameContentSize;
+		slot = (slot + 1) % pdctx->nr_workers;
+	}
+
+	for (i = 0; i < busy; i++) {
+		struct zstd_parallel_dworker *w = &pdctx->workers[i];
+
+		flush_work(&w->work);
+		if (!err && zstd_is_error(w->ret))
+			err = w->ret;
+	}
+	if (err)
+		return err;
+
+	if (ip < iend) {
+		ret = zstd_decompress_dctx(pdctx->workers[0].dctx, op,
+					   oend - op, ip, iend - ip);
+		if (zstd_is_error(ret))
+			return ret;
+		op += ret;
+	}
+
+	return op - (u8 *)dst;
+}
+EXPORT_SYMBOL(zstd_parallel_decompress);
@@ -7,12 +7,15 @@
 
 #define pr_fmt(fmt) "damon: " fmt
 
+#include <linux/cpu.h>
 #include <linux/damon.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/sched/cputime.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/workqueue.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/damon.h>
@@ -287,6 +290,7 @@ struct damos *damon_new_scheme(struct damos_access_pattern *pattern,
 		return NULL;
 	scheme->pattern = *pattern;
 	scheme->action = action;
+	scheme->target_nid = NUMA_NO_NODE;
 	scheme->stat = (struct damos_stat){};
 	INIT_LIST_HEAD(&scheme->list);
 
@@ -383,6 +387,11 @@ struct damon_ctx *damon_new_ctx(void)
 	if (!ctx)
 		return NULL;
 
+	if (!zalloc_cpumask_var(&ctx->worker_cpus, GFP_KERNEL)) {
+		kfree(ctx);
+		return NULL;
+	}
+
 	ctx->attrs.sample_interval = 5 * 1000;
 	ctx->attrs.aggr_interval = 100 * 1000;
 	ctx->attrs.ops_update_interval = 60 * 1000 * 1000;
@@ -423,6 +432,7 @@ void damon_destroy_ctx(struct damon_ctx *ctx)
 	damon_for_each_scheme_safe(s, next_s, ctx)
 		damon_destroy_scheme(s);
 
+	free_cpumask_var(ctx->worker_cpus);
 	kfree(ctx);
 }
 
@@ -1134,6 +1144,162 @@ static int kdamond_wait_activation(struct damon_ctx *ctx)
 	return -EBUSY;
 }
 
+/*
+ * A work item checking the accesses of every nr_workers-th target of a
+ * context, starting from the idx-th, on one of &damon_ctx.worker_cpus.
+ */
+struct damon_worker {
+	struct work_struct work;
+	struct damon_ctx *ctx;
+	int cpu;
+	unsigned int idx;
+	bool check;		/* check accesses, or prepare the checks */
+	unsigned int max_nr_accesses;
+	u64 cpu_ns;
+};
+
+static void kdamond_worker_fn(struct work_struct *work)
+{
+	struct damon_worker *w = container_of(work, struct damon_worker, work);
+	struct damon_ctx *ctx = w->ctx;
+	u64 start = task_sched_runtime(current);
+	struct damon_target *t;
+	unsigned int ti = 0;
+
+	w->max_nr_accesses = 0;
+	damon_for_each_target(t, ctx) {
+		if (ti++ % ctx->nr_workers != w->idx)
+			continue;
+		if (w->check)
+			w->max_nr_accesses = max(w->max_nr_accesses,
+					ctx->ops.check_target_accesses(ctx, t));
+		else
+			ctx->ops.prepare_target_access_checks(ctx, t);
+	}
+	w->cpu_ns += task_sched_runtime(current) - start;
+}
+
+static void kdamond_stop_workers(struct damon_ctx *ctx)
+{
+	if (ctx->workers_wq)
+		destroy_workqueue(ctx->workers_wq);
+	ctx->workers_wq = NULL;
+	kfree(ctx->workers);
+	ctx->workers = NULL;
+	ctx->nr_workers = 0;
+}
+
+/*
+ * Set up a worker for each of &damon_ctx.worker_cpus, if the operations
+ * allow.  Failing that, kdamond keeps doing the checks on its own.
+ */
+static void kdamond_start_workers(struct damon_ctx *ctx)
+{
+	unsigned int nr;
+	int cpu;
+
+	if (!ctx->ops.prepare_target_access_checks ||
+			!ctx->ops.check_target_accesses)
+		return;
+
+	/*
+	 * CPUs may have gone offline since they were picked. Workers are only
+	 * placed on CPUs that have been online, whose pools keep running work
+	 * items even after the CPU goes down again.
+	 */
+	cpus_read_lock();
+	cpumask_and(ctx->worker_cpus, ctx->worker_cpus, cpu_online_mask);
+	cpus_read_unlock();
+	nr = cpumask_weight(ctx->worker_cpus);
+	if (!nr)
+		return;
+
+	ctx->workers = kcalloc(nr, sizeof(*ctx->workers), GFP_KERNEL);
+	ctx->workers_wq = alloc_workqueue("%s", 0, nr, current->comm);
+	if (!ctx->workers || !ctx->workers_wq) {
+		pr_warn("kdamond (%d) checks its targets on its own\n",
+				current->pid);
+		kdamond_stop_workers(ctx);
+		return;
+	}
+
+	for_each_cpu(cpu, ctx->worker_cpus) {
+		struct damon_worker *w = &ctx->workers[ctx->nr_workers];
+
+		INIT_WORK(&w->work, kdamond_worker_fn);
+		w->ctx = ctx;
+		w->cpu = cpu;
+		w->idx = ctx->nr_workers++;
+	}
+}
+
+/*
+ * The operations can be switched while running, keep using the workers only
+ * while they support per-target checks.
+ */
+static bool kdamond_use_workers(struct damon_ctx *ctx)
+{
+	return ctx->nr_workers && ctx->ops.prepare_target_access_checks &&
+		ctx->ops.check_target_accesses;
+}
+
+static void kdamond_run_workers(struct damon_ctx *ctx, bool check)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_workers; i++) {
+		struct damon_worker *w = &ctx->workers[i];
+
+		w->check = check;
+		queue_work_on(w->cpu, ctx->workers_wq, &w->work);
+	}
+	for (i = 0; i < ctx->nr_workers; i++)
+		flush_work(&ctx->workers[i].work);
+}
+
+static void kdamond_prepare_access_checks(struct damon_ctx *ctx)
+{
+	if (kdamond_use_workers(ctx))
+		kdamond_run_workers(ctx, false);
+	else if (ctx->ops.prepare_access_checks)
+		ctx->ops.prepare_access_checks(ctx);
+}
+
+static unsigned int kdamond_check_accesses(struct damon_ctx *ctx)
+{
+	unsigned int i, max_nr_accesses = 0;
+
+	if (!kdamond_use_workers(ctx))
+		return ctx->ops.check_accesses ? ctx->ops.check_accesses(ctx) : 0;
+
+	kdamond_run_workers(ctx, true);
+	for (i = 0; i < ctx->nr_workers; i++)
+		max_nr_accesses = max(max_nr_accesses,
+				ctx->workers[i].max_nr_accesses);
+	return max_nr_accesses;
+}
+
+/* CPU time used by kdamond and its workers so far */
+static u64 kdamond_cpu_ns(struct damon_ctx *ctx)
+{
+	u64 ns = task_sched_runtime(current);
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_workers; i++)
+		ns += ctx->workers[i].cpu_ns;
+	return ns;
+}
+
+static void kdamond_account_cpu(struct damon_ctx *ctx)
+{
+	u64 now = kdamond_cpu_ns(ctx);
+	u64 delta = now - ctx->last_cpu_ns;
+
+	WRITE_ONCE(ctx->aggr_cpu_ns, delta);
+	WRITE_ONCE(ctx->total_cpu_ns, ctx->total_cpu_ns + delta);
+	ctx->last_cpu_ns = now;
+}
+
 /*
  * The monitoring daemon that runs as a kernel thread
  */
@@ -1152,24 +1318,28 @@ static int kdamond_fn(void *data)
 	if (ctx->callback.before_start && ctx->callback.before_start(ctx))
 		goto done;
 
+	kdamond_start_workers(ctx);
+	ctx->aggr_cpu_ns = 0;
+	ctx->total_cpu_ns = 0;
+	ctx->last_cpu_ns = kdamond_cpu_ns(ctx);
+
 	sz_limit = damon_region_sz_limit(ctx);
 
 	while (!kdamond_need_stop(ctx)) {
 		if (kdamond_wait_activation(ctx))
 			break;
 
-		if (ctx->ops.prepare_access_checks)
-			ctx->ops.prepare_access_checks(ctx);
+		kdamond_prepare_access_checks(ctx);
 		if (ctx->callback.after_sampling &&
 				ctx->callback.after_sampling(ctx))
 			break;
 
 		kdamond_usleep(ctx->attrs.sample_interval);
 
-		if (ctx->ops.check_accesses)
-			max_nr_accesses = ctx->ops.check_accesses(ctx);
+		max_nr_accesses = kdamond_check_accesses(ctx);
 
 		if (kdamond_aggregate_interval_passed(ctx)) {
+			kdamond_account_cpu(ctx);
 			kdamond_merge_regions(ctx,
 					max_nr_accesses / 10,
 					sz_limit);
@@ -1190,6 +1360,7 @@ static int kdamond_fn(void *data)
 		}
 	}
 done:
+	kdamond_stop_workers(ctx);
 	damon_for_each_target(t, ctx) {
 		damon_for_each_region_safe(r, next, t)
 			damon_destroy_region(r, t);
@@ -7,6 +7,7 @@
 
 #define pr_fmt(fmt) "damon-pa: " fmt
 
+#include <linux/migrate.h>
 #include <linux/mmu_notifier.h>
 #include <linux/page_idle.h>
 #include <linux/pagemap.h>
@@ -261,6 +262,53 @@ static unsigned long damon_pa_deactivate_pages(struct damon_region *r)
 	return damon_pa_mark_accessed_or_deactivate(r, false);
 }
 
+static unsigned long damon_pa_migrate(struct damon_region *r,
+		struct damos *s)
+{
+	int nid = s->target_nid;
+	struct migration_target_control mtc = {
+		.nid = nid,
+		.gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+			__GFP_THISNODE | __GFP_NOWARN | __GFP_NOMEMALLOC |
+			GFP_NOWAIT,
+	};
+	unsigned int nr_succeeded = 0;
+	unsigned long addr;
+	LIST_HEAD(page_list);
+
+	if (nid < 0 || nid >= MAX_NUMNODES || !node_state(nid, N_MEMORY))
+		return 0;
+
+	for (addr = r->ar.start; addr < r->ar.end; addr += PAGE_SIZE) {
+		struct page *page = damon_get_page(PHYS_PFN(addr));
+
+		if (!page)
+			continue;
+
+		if (page_to_nid(page) == nid || isolate_lru_page(page)) {
+			put_page(page);
+			continue;
+		}
+		/* migrate_pages() and the putback undo this for us */
+		mod_node_page_state(page_pgdat(page),
+				NR_ISOLATED_ANON + page_is_file_lru(page),
+				thp_nr_pages(page));
+		list_add(&page->lru, &page_list);
+		put_page(page);
+	}
+
+	if (!list_empty(&page_list)) {
+		migrate_pages(&page_list, alloc_migration_target, NULL,
+				(unsigned long)&mtc, MIGRATE_ASYNC,
+				s->action == DAMOS_MIGRATE_COLD ?
+				MR_DEMOTION : MR_NUMA_MISPLACED,
+				&nr_succeeded);
+		putback_movable_pages(&page_list);
+	}
+	cond_resched();
+	return (unsigned long)nr_succeeded * PAGE_SIZE;
+}
+
 static unsigned long damon_pa_apply_scheme(struct damon_ctx *ctx,
 		struct damon_target *t, struct damon_region *r,
 		struct damos *scheme)
@@ -272,6 +320,9 @@ static unsigned long damon_pa_apply_scheme(struct damon_ctx *ctx,
 		return damon_pa_mark_accessed(r);
 	case DAMOS_LRU_DEPRIO:
 		return damon_pa_deactivate_pages(r);
+	case DAMOS_MIGRATE_HOT:
+	case DAMOS_MIGRATE_COLD:
+		return damon_pa_migrate(r, scheme);
 	case DAMOS_STAT:
 		break;
 	default:
@@ -292,6 +343,10 @@ static int damon_pa_scheme_score(struct damon_ctx *context,
 		return damon_hot_score(context, r, scheme);
 	case DAMOS_LRU_DEPRIO:
 		return damon_cold_score(context, r, scheme);
+	case DAMOS_MIGRATE_HOT:
+		return damon_hot_score(context, r, scheme);
+	case DAMOS_MIGRATE_COLD:
+		return damon_cold_score(context, r, scheme);
 	default:
 		break;
 	}
@@ -735,6 +735,7 @@ static struct kobj_type damon_sysfs_access_pattern_ktype = {
 struct damon_sysfs_scheme {
 	struct kobject kobj;
 	enum damos_action action;
+	int target_nid;
 	struct damon_sysfs_access_pattern *access_pattern;
 	struct damon_sysfs_quotas *quotas;
 	struct damon_sysfs_watermarks *watermarks;
@@ -750,6 +751,8 @@ static const char * const damon_sysfs_damos_action_strs[] = {
 	"nohugepage",
 	"lru_prio",
 	"lru_deprio",
+	"migrate_hot",
+	"migrate_cold",
 	"stat",
 };
 
@@ -763,6 +766,7 @@ static struct damon_sysfs_scheme *damon_sysfs_scheme_alloc(
 		return NULL;
 	scheme->kobj = (struct kobject){};
 	scheme->action = action;
+	scheme->target_nid = NUMA_NO_NODE;
 	return scheme;
 }
 
@@ -913,6 +917,31 @@ static ssize_t action_store(struct kobject *kobj, struct kobj_attribute *attr,
 	return -EINVAL;
 }
 
+static ssize_t target_nid_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct damon_sysfs_scheme *scheme = container_of(kobj,
+			struct damon_sysfs_scheme, kobj);
+
+	return sysfs_emit(buf, "%d\n", scheme->target_nid);
+}
+
+static ssize_t target_nid_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct damon_sysfs_scheme *scheme = container_of(kobj,
+			struct damon_sysfs_scheme, kobj);
+	int nid;
+	int err = kstrtoint(buf, 0, &nid);
+
+	if (err)
+		return err;
+	if (nid != NUMA_NO_NODE && (nid < 0 || nid >= MAX_NUMNODES))
+		return -EINVAL;
+	scheme->target_nid = nid;
+	return count;
+}
+
 static void damon_sysfs_scheme_release(struct kobject *kobj)
 {
 	kfree(container_of(kobj, struct damon_sysfs_scheme, kobj));
@@ -921,8 +950,12 @@ static void damon_sysfs_scheme_release(struct kobject *kobj)
 static struct kobj_attribute damon_sysfs_scheme_action_attr =
 		__ATTR_RW_MODE(action, 0600);
 
+static struct kobj_attribute damon_sysfs_scheme_target_nid_attr =
+		__ATTR_RW_MODE(target_nid, 0600);
+
 static struct attribute *damon_sysfs_scheme_attrs[] = {
 	&damon_sysfs_scheme_action_attr.attr,
+	&damon_sysfs_scheme_target_nid_attr.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(damon_sysfs_scheme);
@@ -1691,6 +1724,7 @@ struct damon_sysfs_context {
 	struct damon_sysfs_attrs *attrs;
 	struct damon_sysfs_targets *targets;
 	struct damon_sysfs_schemes *schemes;
+	cpumask_var_t worker_cpus;
 };
 
 static struct damon_sysfs_context *damon_sysfs_context_alloc(
@@ -1701,6 +1735,10 @@ static struct damon_sysfs_context *damon_sysfs_context_alloc(
 
 	if (!context)
 		return NULL;
+	if (!zalloc_cpumask_var(&context->worker_cpus, GFP_KERNEL)) {
+		kfree(context);
+		return NULL;
+	}
 	context->kobj = (struct kobject){};
 	context->ops_id = ops_id;
 	return context;
@@ -1838,9 +1876,43 @@ static ssize_t operations_store(struct kobject *kobj,
 	return -EINVAL;
 }
 
+static ssize_t worker_cpus_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct damon_sysfs_context *context = container_of(kobj,
+			struct damon_sysfs_context, kobj);
+
+	return sysfs_emit(buf, "%*pbl\n",
+			cpumask_pr_args(context->worker_cpus));
+}
+
+static ssize_t worker_cpus_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct damon_sysfs_context *context = container_of(kobj,
+			struct damon_sysfs_context, kobj);
+	cpumask_var_t cpus;
+	int err;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+	err = cpulist_parse(buf, cpus);
+	/* A work queued on a CPU that never came up would never run. */
+	if (!err && !cpumask_subset(cpus, cpu_online_mask))
+		err = -EINVAL;
+	if (!err)
+		cpumask_copy(context->worker_cpus, cpus);
+	free_cpumask_var(cpus);
+	return err ? err : count;
+}
+
 static void damon_sysfs_context_release(struct kobject *kobj)
 {
-	kfree(container_of(kobj, struct damon_sysfs_context, kobj));
+	struct damon_sysfs_context *context = container_of(kobj,
+			struct damon_sysfs_context, kobj);
+
+	free_cpumask_var(context->worker_cpus);
+	kfree(context);
 }
 
 static struct kobj_attribute damon_sysfs_context_avail_operations_attr =
@@ -1849,9 +1921,13 @@ static struct kobj_attribute damon_sysfs_context_avail_operations_attr =
 static struct kobj_attribute damon_sysfs_context_operations_attr =
 		__ATTR_RW_MODE(operations, 0600);
 
+static struct kobj_attribute damon_sysfs_context_worker_cpus_attr =
+		__ATTR_RW_MODE(worker_cpus, 0600);
+
 static struct attribute *damon_sysfs_context_attrs[] = {
 	&damon_sysfs_context_avail_operations_attr.attr,
 	&damon_sysfs_context_operations_attr.attr,
+	&damon_sysfs_context_worker_cpus_attr.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(damon_sysfs_context);
@@ -2278,9 +2354,13 @@ static struct damos *damon_sysfs_mk_scheme(
 		.mid = sysfs_wmarks->mid,
 		.low = sysfs_wmarks->low,
 	};
+	struct damos *scheme;
 
-	return damon_new_scheme(&pattern, sysfs_scheme->action, &quota,
+	scheme = damon_new_scheme(&pattern, sysfs_scheme->action, &quota,
 			&wmarks);
+	if (scheme)
+		scheme->target_nid = sysfs_scheme->target_nid;
+	return scheme;
 }
 
 static void damon_sysfs_update_scheme(struct damos *scheme,
@@ -2300,6 +2380,7 @@ static void damon_sysfs_update_scheme(struct damos *scheme,
 	scheme->pattern.max_age_region = access_pattern->age->max;
 
 	scheme->action = sysfs_scheme->action;
+	scheme->target_nid = sysfs_scheme->target_nid;
 
 	scheme->quota.ms = sysfs_quotas->ms;
 	scheme->quota.sz = sysfs_quotas->sz;
@@ -2486,6 +2567,8 @@ static struct damon_ctx *damon_sysfs_build_ctx(
 		damon_destroy_ctx(ctx);
 		return ERR_PTR(err);
 	}
+	/* Workers are set up once, when the monitoring starts */
+	cpumask_copy(ctx->worker_cpus, sys_ctx->worker_cpus);
 
 	ctx->callback.after_wmarks_check = damon_sysfs_cmd_request_callback;
 	ctx->callback.after_aggregation = damon_sysfs_cmd_request_callback;
@@ -2638,6 +2721,40 @@ static ssize_t pid_show(struct kobject *kobj,
 	return sysfs_emit(buf, "%d\n", pid);
 }
 
+static ssize_t damon_sysfs_kdamond_cpu_ns(struct damon_sysfs_kdamond *kdamond,
+		char *buf, bool total)
+{
+	struct damon_ctx *ctx;
+	u64 ns = 0;
+
+	if (!mutex_trylock(&damon_sysfs_lock))
+		return -EBUSY;
+	ctx = kdamond->damon_ctx;
+	if (ctx)
+		ns = total ? READ_ONCE(ctx->total_cpu_ns) :
+			READ_ONCE(ctx->aggr_cpu_ns);
+	mutex_unlock(&damon_sysfs_lock);
+	return sysfs_emit(buf, "%llu\n", ns);
+}
+
+static ssize_t aggr_cpu_ns_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct damon_sysfs_kdamond *kdamond = container_of(kobj,
+			struct damon_sysfs_kdamond, kobj);
+
+	return damon_sysfs_kdamond_cpu_ns(kdamond, buf, false);
+}
+
+static ssize_t total_cpu_ns_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct damon_sysfs_kdamond *kdamond = container_of(kobj,
+			struct damon_sysfs_kdamond, kobj);
+
+	return damon_sysfs_kdamond_cpu_ns(kdamond, buf, true);
+}
+
 static void damon_sysfs_kdamond_release(struct kobject *kobj)
 {
 	struct damon_sysfs_kdamond *kdamond = container_of(kobj,
@@ -2654,9 +2771,17 @@ static struct kobj_attribute damon_sysfs_kdamond_state_attr =
 static struct kobj_attribute damon_sysfs_kdamond_pid_attr =
 		__ATTR_RO_MODE(pid, 0400);
 
+static struct kobj_attribute damon_sysfs_kdamond_aggr_cpu_ns_attr =
+		__ATTR_RO_MODE(aggr_cpu_ns, 0400);
+
+static struct kobj_attribute damon_sysfs_kdamond_total_cpu_ns_attr =
+		__ATTR_RO_MODE(total_cpu_ns, 0400);
+
 static struct attribute *damon_sysfs_kdamond_attrs[] = {
 	&damon_sysfs_kdamond_state_attr.attr,
 	&damon_sysfs_kdamond_pid_attr.attr,
+	&damon_sysfs_kdamond_aggr_cpu_ns_attr.attr,
+	&damon_sysfs_kdamond_total_cpu_ns_attr.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(damon_sysfs_kdamond);
@@ -405,20 +405,26 @@ static void __damon_va_prepare_access_check(struct mm_struct *mm,
 	damon_va_mkold(mm, r->sampling_addr);
 }
 
-static void damon_va_prepare_access_checks(struct damon_ctx *ctx)
+static void damon_va_prepare_target_access_checks(struct damon_ctx *ctx,
+		struct damon_target *t)
 {
-	struct damon_target *t;
 	struct mm_struct *mm;
 	struct damon_region *r;
 
-	damon_for_each_target(t, ctx) {
-		mm = damon_get_mm(t);
-		if (!mm)
-			continue;
-		damon_for_each_region(r, t)
-			__damon_va_prepare_access_check(mm, r);
-		mmput(mm);
-	}
+	mm = damon_get_mm(t);
+	if (!mm)
+		return;
+	damon_for_each_region(r, t)
+		__damon_va_prepare_access_check(mm, r);
+	mmput(mm);
+}
+
+static void damon_va_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx)
+		damon_va_prepare_target_access_checks(ctx, t);
 }
 
 struct damon_young_walk_private {
@@ -537,54 +543,71 @@ static bool damon_va_young(struct mm_struct *mm, unsigned long addr,
 	return arg.young;
 }
 
+/*
+ * The page checked last in a target.  Kept by the caller rather than in static
+ * variables, as the targets of a context can be checked by several threads.
+ */
+struct damon_va_last_check {
+	unsigned long addr;
+	unsigned long page_sz;
+	bool accessed;
+	bool valid;
+};
+
 /*
  * Check whether the region was accessed after the last preparation
  *
  * mm	'mm_struct' for the given virtual address space
  * r	the region to be checked
+ * last	the page checked last in the same target
  */
 static void __damon_va_check_access(struct mm_struct *mm,
-				struct damon_region *r, bool same_target)
+		struct damon_region *r, struct damon_va_last_check *last)
 {
-	static unsigned long last_addr;
-	static unsigned long last_page_sz = PAGE_SIZE;
-	static bool last_accessed;
-
 	/* If the region is in the last checked page, reuse the result */
-	if (same_target && (ALIGN_DOWN(last_addr, last_page_sz) ==
-				ALIGN_DOWN(r->sampling_addr, last_page_sz))) {
-		if (last_accessed)
+	if (last->valid && (ALIGN_DOWN(last->addr, last->page_sz) ==
+				ALIGN_DOWN(r->sampling_addr, last->page_sz))) {
+		if (last->accessed)
 			r->nr_accesses++;
 		return;
 	}
 
-	last_accessed = damon_va_young(mm, r->sampling_addr, &last_page_sz);
-	if (last_accessed)
+	last->accessed = damon_va_young(mm, r->sampling_addr, &last->page_sz);
+	if (last->accessed)
 		r->nr_accesses++;
 
-	last_addr = r->sampling_addr;
+	last->addr = r->sampling_addr;
+	last->valid = true;
 }
 
-static unsigned int damon_va_check_accesses(struct damon_ctx *ctx)
+static unsigned int damon_va_check_target_accesses(struct damon_ctx *ctx,
+		struct damon_target *t)
 {
-	struct damon_target *t;
+	struct damon_va_last_check last = { .page_sz = PAGE_SIZE };
 	struct mm_struct *mm;
 	struct damon_region *r;
 	unsigned int max_nr_accesses = 0;
-	bool same_target;
 
-	damon_for_each_target(t, ctx) {
-		mm = damon_get_mm(t);
-		if (!mm)
-			continue;
-		same_target = false;
-		damon_for_each_region(r, t) {
-			__damon_va_check_access(mm, r, same_target);
-			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
-			same_target = true;
-		}
-		mmput(mm);
+	mm = damon_get_mm(t);
+	if (!mm)
+		return 0;
+	damon_for_each_region(r, t) {
+		__damon_va_check_access(mm, r, &last);
+		max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
 	}
+	mmput(mm);
+
+	return max_nr_accesses;
+}
+
+static unsigned int damon_va_check_accesses(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	unsigned int max_nr_accesses = 0;
+
+	damon_for_each_target(t, ctx)
+		max_nr_accesses = max(max_nr_accesses,
+				damon_va_check_target_accesses(ctx, t));
 
 	return max_nr_accesses;
 }
@@ -689,6 +712,9 @@ static int __init damon_va_initcall(void)
 		.update = damon_va_update,
 		.prepare_access_checks = damon_va_prepare_access_checks,
 		.check_accesses = damon_va_check_accesses,
+		.prepare_target_access_checks =
+			damon_va_prepare_target_access_checks,
+		.check_target_accesses = damon_va_check_target_accesses,
 		.reset_aggregated = NULL,
 		.target_valid = damon_va_target_valid,
 		.cleanup = NULL,
@@ -9,6 +9,7 @@
 
 #include <linux/atomic.h>
 #include <linux/bug.h>
+#include <linux/cpuhotplug.h>
 #include <linux/debugfs.h>
 #include <linux/hash.h>
 #include <linux/irq_work.h>
@@ -21,8 +22,10 @@
 #include <linux/log2.h>
 #include <linux/memblock.h>
 #include <linux/moduleparam.h>
+#include <linux/mutex.h>
 #include <linux/notifier.h>
 #include <linux/panic_notifier.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 #include <linux/rcupdate.h>
 #include <linux/sched/clock.h>
@@ -31,6 +34,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
+#include <linux/timer.h>
 
 #include <asm/kfence.h>
 
@@ -108,6 +112,160 @@ module_param_named(deferrable, kfence_deferrable, bool, 0444);
 static bool kfence_check_on_panic __read_mostly;
 module_param_named(check_on_panic, kfence_check_on_panic, bool, 0444);
 
+/*
+ * If true, every CPU has its own allocation gate, opened once per sample
+ * interval by a timer on that CPU; see kfence_cpu_timer_fn().
+ */
+static bool kfence_percpu __read_mostly;
+module_param_named(percpu, kfence_percpu, bool, 0444);
+
+/*
+ * Cap on the number of pool objects that can be in use at once. This does
+ * not size the pool: it always spans CONFIG_KFENCE_NUM_OBJECTS objects and
+ * their memory is always reserved, as is_kfence_address() needs a constant
+ * size. Only the first kfence_max_objects of them are put on the freelist.
+ * The cap can be raised at runtime, up to CONFIG_KFENCE_NUM_OBJECTS, but not
+ * lowered.
+ */
+static unsigned long kfence_max_objects __read_mostly = CONFIG_KFENCE_NUM_OBJECTS;
+static void kfence_raise_max_objects(unsigned long num);
+
+static int param_set_max_objects(const char *val, const struct kernel_param *kp)
+{
+	unsigned long num;
+	int ret = kstrtoul(val, 0, &num);
+
+	if (ret < 0)
+		return ret;
+
+	if (!num || num > CONFIG_KFENCE_NUM_OBJECTS)
+		return -EINVAL;
+
+	/* Before the pool is set up, any size goes. */
+	if (!__kfence_pool) {
+		WRITE_ONCE(kfence_max_objects, num);
+		return 0;
+	}
+
+	if (num < kfence_max_objects)
+		return -EINVAL;
+
+	kfence_raise_max_objects(num);
+	return 0;
+}
+
+static const struct kernel_param_ops max_objects_param_ops = {
+	.set = param_set_max_objects,
+	.get = param_get_ulong,
+};
+module_param_cb(max_objects, &max_objects_param_ops, &kfence_max_objects, 0600);
+
+/*
+ * Per-cache sampling weights, as a list of "<cache name>:<weight>". Caches
+ * not listed have a weight of 100. The allocation that claims the gate is
+ * sampled with probability weight / max(weights) of its cache, otherwise
+ * the sample is dropped for this interval; a weight of 0 never samples the
+ * cache. The lookup thus happens at most once per interval (and CPU).
+ */
+#define KFENCE_CACHE_WEIGHTS_MAX	16
+#define KFENCE_CACHE_NAME_LEN		32
+#define KFENCE_DEFAULT_WEIGHT		100
+#define KFENCE_MAX_WEIGHT		10000
+
+struct kfence_cache_weight {
+	char name[KFENCE_CACHE_NAME_LEN];
+	unsigned int weight;
+};
+
+struct kfence_cache_weights {
+	unsigned int nr;
+	unsigned int max_weight;
+	struct kfence_cache_weight w[KFENCE_CACHE_WEIGHTS_MAX];
+};
+
+/*
+ * The table in use is read under RCU from __kfence_alloc(), NULL if no
+ * weights are set. The parameter can be set on the command line before the
+ * slab allocator is up, so two static tables take turns instead of
+ * allocating a new one; the mutex serialises writers.
+ */
+static struct kfence_cache_weights kfence_cache_weights_buf[2];
+static struct kfence_cache_weights __rcu *kfence_cache_weights;
+static DEFINE_MUTEX(kfence_cache_weights_mutex);
+
+static int param_set_cache_weights(const char *val, const struct kernel_param *kp)
+{
+	struct kfence_cache_weight weights[KFENCE_CACHE_WEIGHTS_MAX];
+	unsigned int nr = 0, max_weight = KFENCE_DEFAULT_WEIGHT;
+	const char *p = skip_spaces(val);
+	struct kfence_cache_weights *cur, *next;
+
+	while (*p && *p != '\n') {
+		const char *colon = strchr(p, ':');
+		unsigned long weight;
+		char *end;
+
+		if (!colon || nr == KFENCE_CACHE_WEIGHTS_MAX)
+			return -EINVAL;
+		if (colon == p || colon - p >= KFENCE_CACHE_NAME_LEN)
+			return -EINVAL;
+
+		weight = simple_strtoul(colon + 1, &end, 0);
+		if (end == colon + 1 || weight > KFENCE_MAX_WEIGHT)
+			return -EINVAL;
+
+		strscpy(weights[nr].name, p, colon - p + 1);
+		weights[nr].weight = weight;
+		max_weight = max_t(unsigned int, max_weight, weight);
+		nr++;
+
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p && *p != '\n')
+			return -EINVAL;
+	}
+
+	mutex_lock(&kfence_cache_weights_mutex);
+	cur = rcu_dereference_protected(kfence_cache_weights,
+			lockdep_is_held(&kfence_cache_weights_mutex));
+	next = cur == &kfence_cache_weights_buf[0] ?
+		&kfence_cache_weights_buf[1] : &kfence_cache_weights_buf[0];
+	memcpy(next->w, weights, nr * sizeof(weights[0]));
+	next->nr = nr;
+	next->max_weight = max_weight;
+	rcu_assign_pointer(kfence_cache_weights, nr ? next : NULL);
+	/* The next update reuses @cur. */
+	synchronize_rcu();
+	mutex_unlock(&kfence_cache_weights_mutex);
+
+	return 0;
+}
+
+static int param_get_cache_weights(char *buffer, const struct kernel_param *kp)
+{
+	struct kfence_cache_weights *cur;
+	unsigned int i;
+	int len = 0;
+
+	mutex_lock(&kfence_cache_weights_mutex);
+	cur = rcu_dereference_protected(kfence_cache_weights,
+			lockdep_is_held(&kfence_cache_weights_mutex));
+	for (i = 0; cur && i < cur->nr; i++)
+		len += scnprintf(buffer + len, PAGE_SIZE - len, "%s%s:%u",
+				 i ? "," : "", cur->w[i].name, cur->w[i].weight);
+	mutex_unlock(&kfence_cache_weights_mutex);
+	len += scnprintf(buffer + len, PAGE_SIZE - len, "\n");
+
+	return len;
+}
+
+static const struct kernel_param_ops cache_weights_param_ops = {
+	.set = param_set_cache_weights,
+	.get = param_get_cache_weights,
+};
+module_param_cb(cache_weights, &cache_weights_param_ops, NULL, 0600);
+
 /* The pool of pages used for guard pages and objects. */
 char *__kfence_pool __read_mostly;
 EXPORT_SYMBOL(__kfence_pool); /* Export for test modules. */
@@ -132,6 +290,13 @@ DEFINE_STATIC_KEY_FALSE(kfence_allocation_key);
 /* Gates the allocation, ensuring only one succeeds in a given period. */
 atomic_t kfence_allocation_gate = ATOMIC_INIT(1);
 
+/* Selects the per-CPU allocation gates below over kfence_allocation_gate. */
+DEFINE_STATIC_KEY_FALSE(kfence_percpu_key);
+
+/* Per-CPU allocation gates, and the timers opening them. */
+DEFINE_PER_CPU(int, kfence_cpu_gate) = 1;
+static DEFINE_PER_CPU(struct timer_list, kfence_cpu_timer);
+
 /*
  * A Counting Bloom filter of allocation coverage: limits currently covered
  * allocations of the same source filling up the pool.
@@ -168,6 +333,7 @@ enum kfence_counter_id {
 	KFENCE_COUNTER_SKIP_INCOMPAT,
 	KFENCE_COUNTER_SKIP_CAPACITY,
 	KFENCE_COUNTER_SKIP_COVERED,
+	KFENCE_COUNTER_SKIP_WEIGHT,
 	KFENCE_COUNTER_COUNT,
 };
 static atomic_long_t counters[KFENCE_COUNTER_COUNT];
@@ -180,6 +346,7 @@ static const char *const counter_names[] = {
 	[KFENCE_COUNTER_SKIP_INCOMPAT]	= "skipped allocations (incompatible)",
 	[KFENCE_COUNTER_SKIP_CAPACITY]	= "skipped allocations (capacity)",
 	[KFENCE_COUNTER_SKIP_COVERED]	= "skipped allocations (covered)",
+	[KFENCE_COUNTER_SKIP_WEIGHT]	= "skipped allocations (cache weight)",
 };
 static_assert(ARRAY_SIZE(counter_names) == KFENCE_COUNTER_COUNT);
 
@@ -187,7 +354,7 @@ static_assert(ARRAY_SIZE(counter_names) == KFENCE_COUNTER_COUNT);
 
 static inline bool should_skip_covered(void)
 {
-	unsigned long thresh = (CONFIG_KFENCE_NUM_OBJECTS * kfence_skip_covered_thresh) / 100;
+	unsigned long thresh = (READ_ONCE(kfence_max_objects) * kfence_skip_covered_thresh) / 100;
 
 	return atomic_long_read(&counters[KFENCE_COUNTER_ALLOCATED]) > thresh;
 }
@@ -230,6 +397,36 @@ static bool alloc_covered_contains(u32 alloc_stack_hash)
 	return true;
 }
 
+/*
+ * Returns true if an allocation from @s should take the sample, according to
+ * the cache's weight. See kfence.cache_weights.
+ */
+static bool kfence_cache_sampled(struct kmem_cache *s)
+{
+	unsigned int weight = KFENCE_DEFAULT_WEIGHT, max_weight, i;
+	struct kfence_cache_weights *cw;
+
+	if (likely(!rcu_access_pointer(kfence_cache_weights)))
+		return true;
+
+	rcu_read_lock();
+	cw = rcu_dereference(kfence_cache_weights);
+	if (!cw) {
+		rcu_read_unlock();
+		return true;
+	}
+	for (i = 0; i < cw->nr; i++) {
+		if (!strcmp(s->name, cw->w[i].name)) {
+			weight = cw->w[i].weight;
+			break;
+		}
+	}
+	max_weight = cw->max_weight;
+	rcu_read_unlock();
+
+	return weight >= max_weight || prandom_u32_max(max_weight) < weight;
+}
+
 static bool kfence_protect(unsigned long addr)
 {
 	return !KFENCE_WARN_ON(!kfence_protect_page(ALIGN_DOWN(addr, PAGE_SIZE), true));
@@ -594,7 +791,8 @@ static unsigned long kfence_init_pool(void)
 		raw_spin_lock_init(&meta->lock);
 		meta->state = KFENCE_OBJECT_UNUSED;
 		meta->addr = addr; /* Initialize for validation in metadata_to_pageaddr(). */
-		list_add_tail(&meta->list, &kfence_freelist);
+		if (i < kfence_max_objects)
+			list_add_tail(&meta->list, &kfence_freelist);
 
 		/* Protect the right redzone. */
 		if (unlikely(!kfence_protect(addr + PAGE_SIZE)))
@@ -606,6 +804,20 @@ static unsigned long kfence_init_pool(void)
 	return 0;
 }
 
+/* Puts objects up to @num of the initialized pool onto the freelist. */
+static void kfence_raise_max_objects(unsigned long num)
+{
+	unsigned long flags, i;
+
+	raw_spin_lock_irqsave(&kfence_freelist_lock, flags);
+	for (i = kfence_max_objects; i < num; i++)
+		list_add_tail(&kfence_metadata[i].list, &kfence_freelist);
+	WRITE_ONCE(kfence_max_objects, num);
+	raw_spin_unlock_irqrestore(&kfence_freelist_lock, flags);
+
+	pr_info("up to %lu objects in use\n", num);
+}
+
 static bool __init kfence_init_pool_early(void)
 {
 	unsigned long addr;
@@ -675,6 +887,8 @@ static int stats_show(struct seq_file *seq, void *v)
 	int i;
 
 	seq_printf(seq, "enabled: %i\n", READ_ONCE(kfence_enabled));
+	seq_printf(seq, "max objects: %lu/%d\n", READ_ONCE(kfence_max_objects),
+		   CONFIG_KFENCE_NUM_OBJECTS);
 	for (i = 0; i < KFENCE_COUNTER_COUNT; i++)
 		seq_printf(seq, "%s: %ld\n", counter_names[i], atomic_long_read(&counters[i]));
 
@@ -817,6 +1031,68 @@ static void toggle_allocation_gate(struct work_struct *work)
 			   msecs_to_jiffies(kfence_sample_interval));
 }
 
+/*
+ * With kfence.percpu, each CPU opens its own gate from a pinned timer instead,
+ * so the fast path in kfence_alloc() only reads a per-CPU variable, and up to
+ * one allocation per CPU is sampled each interval. The timers are deferrable,
+ * an idle CPU does not allocate anything to sample. The allocation static key
+ * stays enabled, toggling it once per interval and CPU would be far too many
+ * IPIs.
+ */
+static void kfence_cpu_timer_fn(struct timer_list *t)
+{
+	unsigned long interval = READ_ONCE(kfence_sample_interval);
+
+	/* Keep ticking while disabled, so re-enabling needs no restart. */
+	if (interval && READ_ONCE(kfence_enabled))
+		__this_cpu_write(kfence_cpu_gate, 0);
+	mod_timer(t, jiffies + msecs_to_jiffies(interval ?: MSEC_PER_SEC));
+}
+
+static int kfence_cpu_online(unsigned int cpu)
+{
+	struct timer_list *t = per_cpu_ptr(&kfence_cpu_timer, cpu);
+
+	t->expires = jiffies + msecs_to_jiffies(READ_ONCE(kfence_sample_interval));
+	add_timer_on(t, cpu);
+	return 0;
+}
+
+static int kfence_cpu_offline(unsigned int cpu)
+{
+	del_timer_sync(per_cpu_ptr(&kfence_cpu_timer, cpu));
+	per_cpu(kfence_cpu_gate, cpu) = 1;
+	return 0;
+}
+
+static bool kfence_percpu_init(void)
+{
+	int cpu, ret;
+
+	for_each_possible_cpu(cpu)
+		timer_setup(per_cpu_ptr(&kfence_cpu_timer, cpu), kfence_cpu_timer_fn,
+			    TIMER_PINNED | TIMER_DEFERRABLE);
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "mm/kfence:online",
+				kfence_cpu_online, kfence_cpu_offline);
+	if (ret < 0) {
+		pr_warn("per-CPU sampling unavailable: %d\n", ret);
+		return false;
+	}
+
+	static_branch_enable(&kfence_percpu_key);
+	static_branch_enable(&kfence_allocation_key);
+	pr_info("per-CPU sampling enabled\n");
+	return true;
+}
+
+static void kfence_start_sampling(void)
+{
+	/* The per-CPU timers never stop. */
+	if (!static_branch_unlikely(&kfence_percpu_key))
+		queue_delayed_work(system_unbound_wq, &kfence_timer, 0);
+}
+
 /* === Public interface ===================================================== */
 
 void __init kfence_alloc_pool(void)
@@ -830,7 +1106,7 @@ void __init kfence_alloc_pool(void)
 		pr_err("failed to allocate pool\n");
 }
 
-static void kfence_init_enable(void)
+static void kfence_init_enable(bool early)
 {
 	if (!IS_ENABLED(CONFIG_KFENCE_STATIC_KEYS))
 		static_branch_enable(&kfence_allocation_key);
@@ -843,12 +1119,18 @@ static void kfence_init_enable(void)
 	if (kfence_check_on_panic)
 		atomic_notifier_chain_register(&panic_notifier_list, &kfence_check_canary_notifier);
 
+	/* CPU hotplug callbacks can't be set up from kfence_init() yet. */
+	if (kfence_percpu && !early)
+		kfence_percpu_init();
+
 	WRITE_ONCE(kfence_enabled, true);
-	queue_delayed_work(system_unbound_wq, &kfence_timer, 0);
+	/* Otherwise kfence_percpu_late_init() starts sampling. */
+	if (!(kfence_percpu && early))
+		kfence_start_sampling();
 
-	pr_info("initialized - using %lu bytes for %d objects at 0x%p-0x%p\n", KFENCE_POOL_SIZE,
-		CONFIG_KFENCE_NUM_OBJECTS, (void *)__kfence_pool,
-		(void *)(__kfence_pool + KFENCE_POOL_SIZE));
+	pr_info("initialized - using %lu bytes for %lu/%d objects at 0x%p-0x%p\n",
+		KFENCE_POOL_SIZE, kfence_max_objects, CONFIG_KFENCE_NUM_OBJECTS,
+		(void *)__kfence_pool, (void *)(__kfence_pool + KFENCE_POOL_SIZE));
 }
 
 void __init kfence_init(void)
@@ -864,8 +1146,24 @@ void __init kfence_init(void)
 		return;
 	}
 
-	kfence_init_enable();
+	kfence_init_enable(true);
+}
+
+/*
+ * With kfence.percpu, an early kfence_init() leaves sampling to here, once
+ * the CPU hotplug state machine can take the timer callbacks.
+ */
+static int __init kfence_percpu_late_init(void)
+{
+	if (!kfence_percpu || !__kfence_pool ||
+	    static_branch_unlikely(&kfence_percpu_key))
+		return 0;
+
+	if (!kfence_percpu_init())
+		kfence_start_sampling();
+	return 0;
 }
+late_initcall(kfence_percpu_late_init);
 
 static int kfence_init_late(void)
 {
@@ -892,7 +1190,7 @@ static int kfence_init_late(void)
 		return -EBUSY;
 	}
 
-	kfence_init_enable();
+	kfence_init_enable(false);
 	return 0;
 }
 
@@ -902,7 +1200,7 @@ static int kfence_enable_late(void)
 		return kfence_init_late();
 
 	WRITE_ONCE(kfence_enabled, true);
-	queue_delayed_work(system_unbound_wq, &kfence_timer, 0);
+	kfence_start_sampling();
 	pr_info("re-enabled\n");
 	return 0;
 }
@@ -999,21 +1297,38 @@ void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 	if (s->flags & SLAB_SKIP_KFENCE)
 		return NULL;
 
-	if (atomic_inc_return(&kfence_allocation_gate) > 1)
-		return NULL;
+	if (static_branch_unlikely(&kfence_percpu_key)) {
+		/* We may have migrated since kfence_alloc(); fine either way. */
+		if (this_cpu_inc_return(kfence_cpu_gate) > 1)
+			return NULL;
+	} else {
+		if (atomic_inc_return(&kfence_allocation_gate) > 1)
+			return NULL;
 #ifdef CONFIG_KFENCE_STATIC_KEYS
-	/*
-	 * waitqueue_active() is fully ordered after the update of
-	 * kfence_allocation_gate per atomic_inc_return().
-	 */
-	if (waitqueue_active(&allocation_wait)) {
 		/*
-		 * Calling wake_up() here may deadlock when allocations happen
-		 * from within timer code. Use an irq_work to defer it.
+		 * waitqueue_active() is fully ordered after the update of
+		 * kfence_allocation_gate per atomic_inc_return().
 		 */
-		irq_work_queue(&wake_up_kfence_timer_work);
-	}
+		if (waitqueue_active(&allocation_wait)) {
+			/*
+			 * Calling wake_up() here may deadlock when allocations
+			 * happen from within timer code. Use an irq_work to
+			 * defer it.
+			 */
+			irq_work_queue(&wake_up_kfence_timer_work);
+		}
 #endif
+	}
+
+	/*
+	 * Roll the cache's weight only after the gate is claimed: leaving the
+	 * gate open on a miss would make every following allocation do the
+	 * lookup until one passes.
+	 */
+	if (!kfence_cache_sampled(s)) {
+		atomic_long_inc(&counters[KFENCE_COUNTER_SKIP_WEIGHT]);
+		return NULL;
+	}
 
 	if (!READ_ONCE(kfence_enabled))
 		return NULL;
@@ -2201,6 +2201,11 @@ static bool sock_use_custom_sol_socket(const struct socket *sock)
 {
 	const struct sock *sk = sock->sk;
 
+	/* Connectible vsock sockets handle SO_ZEROCOPY themselves */
+	if (sk->sk_family == AF_VSOCK)
+		return sk->sk_type == SOCK_STREAM ||
+		       sk->sk_type == SOCK_SEQPACKET;
+
 	/* Use sock->ops->setsockopt() for MPTCP */
 	return IS_ENABLED(CONFIG_MPTCP) &&
 	       sk->sk_protocol == IPPROTO_MPTCP &&
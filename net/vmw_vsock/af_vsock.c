@@ -106,6 +106,7 @@
 #include <linux/socket.h>
 #include <linux/stddef.h>
 #include <linux/unistd.h>
+#include <linux/virtio_vsock.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
 #include <net/sock.h>
@@ -131,6 +132,11 @@ static struct proto vsock_proto = {
 #define VSOCK_DEFAULT_BUFFER_MAX_SIZE (1024 * 256)
 #define VSOCK_DEFAULT_BUFFER_MIN_SIZE 128
 
+/* cmsg type of MSG_ZEROCOPY completions read with MSG_ERRQUEUE at SOL_VSOCK */
+#ifndef VSOCK_RECVERR
+#define VSOCK_RECVERR 1
+#endif
+
 /* Transport used for host->guest communication */
 static const struct vsock_transport *transport_h2g;
 /* Transport used for guest->host communication */
@@ -840,6 +846,9 @@ static void vsock_sk_destruct(struct sock *sk)
 	vsock_addr_init(&vsk->remote_addr, VMADDR_CID_ANY, VMADDR_PORT_ANY);
 
 	put_cred(vsk->owner);
+
+	/* Pending MSG_ZEROCOPY completions nobody read */
+	skb_queue_purge(&sk->sk_error_queue);
 }
 
 static int vsock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
@@ -1027,7 +1036,7 @@ static __poll_t vsock_poll(struct file *file, struct socket *sock,
 	poll_wait(file, sk_sleep(sk), wait);
 	mask = 0;
 
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
 		/* Signify that there has been an error on this socket. */
 		mask |= EPOLLERR;
 
@@ -1589,6 +1598,27 @@ static void vsock_update_buffer_size(struct vsock_sock *vsk,
 	vsk->buffer_size = val;
 }
 
+/* Only the virtio based transports report MSG_ZEROCOPY completions. Their
+ * common code is a module depending on this one, so look it up instead of
+ * linking against it. If it is not loaded, no such transport is either.
+ */
+static bool vsock_msgzerocopy_allow(const struct vsock_transport *t)
+{
+	bool (*allow)(const struct vsock_transport *t);
+	bool ret;
+
+	if (!t)
+		return false;
+
+	allow = symbol_get(virtio_transport_msgzerocopy_allow);
+	if (!allow)
+		return false;
+
+	ret = allow(t);
+	symbol_put(virtio_transport_msgzerocopy_allow);
+	return ret;
+}
+
 static int vsock_connectible_setsockopt(struct socket *sock,
 					int level,
 					int optname,
@@ -1601,7 +1631,10 @@ static int vsock_connectible_setsockopt(struct socket *sock,
 	const struct vsock_transport *transport;
 	u64 val;
 
-	if (level != AF_VSOCK)
+	if (level == SOL_SOCKET && optname != SO_ZEROCOPY)
+		return sock_setsockopt(sock, level, optname, optval, optlen);
+
+	if (level != AF_VSOCK && level != SOL_SOCKET)
 		return -ENOPROTOOPT;
 
 #define COPY_IN(_v)                                       \
@@ -1624,6 +1657,24 @@ static int vsock_connectible_setsockopt(struct socket *sock,
 
 	transport = vsk->transport;
 
+	if (level == SOL_SOCKET) {
+		int zerocopy;
+
+		/* Only stream sockets can send without copying, and only on
+		 * transports that report MSG_ZEROCOPY completions. Until the
+		 * socket is bound to a transport, we can't tell.
+		 */
+		COPY_IN(zerocopy);
+		if (zerocopy < 0 || zerocopy > 1)
+			err = -EINVAL;
+		else if (sk->sk_type != SOCK_STREAM ||
+			 !vsock_msgzerocopy_allow(transport))
+			err = -EOPNOTSUPP;
+		else
+			sock_valbool_flag(sk, SOCK_ZEROCOPY, zerocopy);
+		goto exit;
+	}
+
 	switch (optname) {
 	case SO_VM_SOCKETS_BUFFER_SIZE:
 		COPY_IN(val);
@@ -1788,6 +1839,15 @@ static int vsock_connectible_sendmsg(struct socket *sock, struct msghdr *msg,
 		goto out;
 	}
 
+	/* The socket may have been reassigned to another transport since
+	 * SO_ZEROCOPY was set.
+	 */
+	if ((msg->msg_flags & MSG_ZEROCOPY) && sock_flag(sk, SOCK_ZEROCOPY) &&
+	    !vsock_msgzerocopy_allow(transport)) {
+		err = -EOPNOTSUPP;
+		goto out;
+	}
+
 	/* Wait for room in the produce queue to enqueue our user's data. */
 	timeout = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
 
@@ -2099,6 +2159,10 @@ vsock_connectible_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	vsk = vsock_sk(sk);
 	err = 0;
 
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sk, msg, len, SOL_VSOCK,
+					  VSOCK_RECVERR);
+
 	lock_sock(sk);
 
 	transport = vsk->transport;
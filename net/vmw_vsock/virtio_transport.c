@@ -45,6 +45,10 @@ struct virtio_vsock {
 	spinlock_t send_pkt_list_lock;
 	struct list_head send_pkt_list;
 
+	/* Header and payload buffers of the packet being queued */
+	struct scatterlist *out_sgs[VIRTIO_VSOCK_MAX_PKT_PAGES + 1];
+	struct scatterlist out_bufs[VIRTIO_VSOCK_MAX_PKT_PAGES + 1];
+
 	atomic_t queued_replies;
 
 	/* The following fields are protected by rx_lock.  vqs[VSOCK_VQ_RX]
@@ -101,10 +105,11 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 	vq = vsock->vqs[VSOCK_VQ_TX];
 
 	for (;;) {
+		struct scatterlist **sgs = vsock->out_sgs;
 		struct virtio_vsock_pkt *pkt;
-		struct scatterlist hdr, buf, *sgs[2];
 		int ret, in_sg = 0, out_sg = 0;
 		bool reply;
+		u32 i;
 
 		spin_lock_bh(&vsock->send_pkt_list_lock);
 		if (list_empty(&vsock->send_pkt_list)) {
@@ -121,11 +126,24 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 
 		reply = pkt->reply;
 
-		sg_init_one(&hdr, &pkt->hdr, sizeof(pkt->hdr));
-		sgs[out_sg++] = &hdr;
+		sg_init_one(&vsock->out_bufs[out_sg], &pkt->hdr,
+			    sizeof(pkt->hdr));
+		sgs[out_sg] = &vsock->out_bufs[out_sg];
+		out_sg++;
 		if (pkt->buf) {
-			sg_init_one(&buf, pkt->buf, pkt->len);
-			sgs[out_sg++] = &buf;
+			sg_init_one(&vsock->out_bufs[out_sg], pkt->buf,
+				    pkt->len);
+			sgs[out_sg] = &vsock->out_bufs[out_sg];
+			out_sg++;
+		}
+		/* MSG_ZEROCOPY: one buffer per user page */
+		for (i = 0; i < pkt->nr_bvec; i++) {
+			sg_init_table(&vsock->out_bufs[out_sg], 1);
+			sg_set_page(&vsock->out_bufs[out_sg],
+				    pkt->bvec[i].bv_page, pkt->bvec[i].bv_len,
+				    pkt->bvec[i].bv_offset);
+			sgs[out_sg] = &vsock->out_bufs[out_sg];
+			out_sg++;
 		}
 
 		ret = virtqueue_add_sgs(vq, sgs, out_sg, in_sg, pkt, GFP_KERNEL);
@@ -197,6 +215,23 @@ virtio_transport_send_pkt(struct virtio_vsock_pkt *pkt)
 	return len;
 }
 
+static bool virtio_transport_can_msgzerocopy(int bufs_num)
+{
+	struct virtio_vsock *vsock;
+	bool ret = false;
+
+	rcu_read_lock();
+	vsock = rcu_dereference(the_virtio_vsock);
+	/* A packet must fit in the tx queue even without indirect
+	 * descriptors, or it would be requeued forever.
+	 */
+	if (vsock)
+		ret = bufs_num <= virtqueue_get_vring_size(vsock->vqs[VSOCK_VQ_TX]);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 static int
 virtio_transport_cancel_pkt(struct vsock_sock *vsk)
 {
@@ -496,6 +531,7 @@ static struct virtio_transport virtio_transport = {
 	},
 
 	.send_pkt = virtio_transport_send_pkt,
+	.can_msgzerocopy = virtio_transport_can_msgzerocopy,
 };
 
 static bool virtio_transport_seqpacket_allow(u32 remote_cid)
@@ -518,6 +554,7 @@ static void virtio_transport_rx_work(struct work_struct *work)
 	struct virtio_vsock *vsock =
 		container_of(work, struct virtio_vsock, rx_work);
 	struct virtqueue *vq;
+	LIST_HEAD(pkts);
 
 	vq = vsock->vqs[VSOCK_VQ_RX];
 
@@ -526,6 +563,9 @@ static void virtio_transport_rx_work(struct work_struct *work)
 	if (!vsock->rx_run)
 		goto out;
 
+	/* Packets are collected and delivered together, so the replies they
+	 * trigger may exceed the limit checked below by up to one batch.
+	 */
 	do {
 		virtqueue_disable_cb(vq);
 		for (;;) {
@@ -556,11 +596,13 @@ static void virtio_transport_rx_work(struct work_struct *work)
 
 			pkt->len = len - sizeof(pkt->hdr);
 			virtio_transport_deliver_tap_pkt(pkt);
-			virtio_transport_recv_pkt(&virtio_transport, pkt);
+			list_add_tail(&pkt->list, &pkts);
 		}
+		virtio_transport_recv_pkts(&virtio_transport, &pkts);
 	} while (!virtqueue_enable_cb(vq));
 
 out:
+	virtio_transport_recv_pkts(&virtio_transport, &pkts);
 	if (vsock->rx_buf_nr < vsock->rx_buf_max_nr / 2)
 		virtio_vsock_rx_fill(vsock);
 	mutex_unlock(&vsock->rx_lock);
@@ -37,6 +37,56 @@ virtio_transport_get_ops(struct vsock_sock *vsk)
 	return container_of(t, struct virtio_transport, transport);
 }
 
+static bool virtio_transport_can_msgzerocopy(struct vsock_sock *vsk)
+{
+	const struct virtio_transport *t_ops = virtio_transport_get_ops(vsk);
+
+	/* One extra buffer for the header */
+	return t_ops && t_ops->can_msgzerocopy &&
+	       t_ops->can_msgzerocopy(VIRTIO_VSOCK_MAX_PKT_PAGES + 1);
+}
+
+/* Take references on the user pages backing the next @len bytes of @msg,
+ * for a MSG_ZEROCOPY packet. Returns the number of bytes covered, which is
+ * less than @len if the buffer spans more than VIRTIO_VSOCK_MAX_PKT_PAGES.
+ */
+static ssize_t virtio_transport_pkt_get_pages(struct virtio_vsock_pkt *pkt,
+					      struct msghdr *msg, size_t len)
+{
+	struct page *pages[VIRTIO_VSOCK_MAX_PKT_PAGES];
+	size_t pinned = 0;
+
+	pkt->bvec = kcalloc(VIRTIO_VSOCK_MAX_PKT_PAGES, sizeof(*pkt->bvec),
+			    GFP_KERNEL);
+	if (!pkt->bvec)
+		return -ENOMEM;
+
+	while (pinned < len && pkt->nr_bvec < VIRTIO_VSOCK_MAX_PKT_PAGES) {
+		size_t start;
+		ssize_t n;
+		int i;
+
+		n = iov_iter_get_pages2(&msg->msg_iter, pages, len - pinned,
+					VIRTIO_VSOCK_MAX_PKT_PAGES - pkt->nr_bvec,
+					&start);
+		if (n <= 0)
+			break;
+
+		pinned += n;
+		for (i = 0; n; i++) {
+			struct bio_vec *bv = &pkt->bvec[pkt->nr_bvec++];
+
+			bv->bv_page = pages[i];
+			bv->bv_offset = start;
+			bv->bv_len = min_t(size_t, n, PAGE_SIZE - start);
+			n -= bv->bv_len;
+			start = 0;
+		}
+	}
+
+	return pinned ? pinned : -EFAULT;
+}
+
 static struct virtio_vsock_pkt *
 virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 			   size_t len,
@@ -64,10 +114,24 @@ virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 	pkt->reply		= info->reply;
 	pkt->vsk		= info->vsk;
 
-	if (info->msg && len > 0) {
+	if (info->msg && len > 0 && info->uarg &&
+	    uarg_to_msgzc(info->uarg)->zerocopy) {
+		ssize_t pinned;
+
+		pinned = virtio_transport_pkt_get_pages(pkt, info->msg, len);
+		if (pinned < 0)
+			goto out;
+
+		len = pinned;
+		pkt->len = len;
+		pkt->hdr.len = cpu_to_le32(len);
+		/* Released once the device is done with the pages */
+		pkt->uarg = info->uarg;
+		net_zcopy_get(pkt->uarg);
+	} else if (info->msg && len > 0) {
 		pkt->buf = kmalloc(len, GFP_KERNEL);
 		if (!pkt->buf)
-			goto out_pkt;
+			goto out;
 
 		pkt->buf_len = len;
 
@@ -94,9 +158,7 @@ virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 	return pkt;
 
 out:
-	kfree(pkt->buf);
-out_pkt:
-	kfree(pkt);
+	virtio_transport_free_pkt(pkt);
 	return NULL;
 }
 
@@ -156,7 +218,13 @@ static struct sk_buff *virtio_transport_build_skb(void *opaque)
 
 	skb_put_data(skb, &pkt->hdr, sizeof(pkt->hdr));
 
-	if (payload_len) {
+	if (payload_len && pkt->bvec) {
+		u32 i;
+
+		for (i = 0; i < pkt->nr_bvec; i++)
+			memcpy_from_bvec(skb_put(skb, pkt->bvec[i].bv_len),
+					 &pkt->bvec[i]);
+	} else if (payload_len) {
 		skb_put_data(skb, payload_buf, payload_len);
 	}
 
@@ -232,6 +300,10 @@ static int virtio_transport_send_pkt_info(struct vsock_sock *vsk,
 		return -ENOMEM;
 	}
 
+	/* A MSG_ZEROCOPY packet may cover less than what we asked for */
+	if (pkt->len < pkt_len)
+		virtio_transport_put_credit(vvs, pkt_len - pkt->len);
+
 	virtio_transport_inc_tx_pkt(vvs, pkt);
 
 	return t_ops->send_pkt(pkt);
@@ -732,6 +804,15 @@ bool virtio_transport_stream_allow(u32 cid, u32 port)
 }
 EXPORT_SYMBOL_GPL(virtio_transport_stream_allow);
 
+/* Completions come from virtio_transport_stream_enqueue(). If the device
+ * cannot take a packet's pages as separate buffers, they report a copy.
+ */
+bool virtio_transport_msgzerocopy_allow(const struct vsock_transport *t)
+{
+	return t->stream_enqueue == virtio_transport_stream_enqueue;
+}
+EXPORT_SYMBOL_GPL(virtio_transport_msgzerocopy_allow);
+
 int virtio_transport_dgram_bind(struct vsock_sock *vsk,
 				struct sockaddr_vm *addr)
 {
@@ -792,8 +873,29 @@ virtio_transport_stream_enqueue(struct vsock_sock *vsk,
 		.pkt_len = len,
 		.vsk = vsk,
 	};
+	struct sock *sk = sk_vsock(vsk);
+	ssize_t ret;
 
-	return virtio_transport_send_pkt_info(vsk, &info);
+	if (!(msg->msg_flags & MSG_ZEROCOPY) || !sock_flag(sk, SOCK_ZEROCOPY))
+		return virtio_transport_send_pkt_info(vsk, &info);
+
+	/* We send at most one packet per call */
+	info.uarg = msg_zerocopy_realloc(sk, min_t(size_t, len,
+					 VIRTIO_VSOCK_MAX_PKT_BUF_SIZE), NULL);
+	if (!info.uarg)
+		return -ENOBUFS;
+
+	/* The completion will report that the data was copied */
+	if (!virtio_transport_can_msgzerocopy(vsk))
+		uarg_to_msgzc(info.uarg)->zerocopy = 0;
+
+	ret = virtio_transport_send_pkt_info(vsk, &info);
+	if (ret > 0)
+		net_zcopy_put(info.uarg);
+	else
+		net_zcopy_put_abort(info.uarg, true);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(virtio_transport_stream_enqueue);
 
@@ -1337,8 +1439,121 @@ void virtio_transport_recv_pkt(struct virtio_transport *t,
 }
 EXPORT_SYMBOL_GPL(virtio_transport_recv_pkt);
 
+/* Look up and lock the connected stream socket @pkt carries data for, if any */
+static struct sock *virtio_transport_recv_batch_start(struct virtio_vsock_pkt *pkt)
+{
+	struct sockaddr_vm src, dst;
+	struct vsock_sock *vsk;
+	struct sock *sk;
+
+	if (le16_to_cpu(pkt->hdr.op) != VIRTIO_VSOCK_OP_RW ||
+	    le16_to_cpu(pkt->hdr.type) != VIRTIO_VSOCK_TYPE_STREAM)
+		return NULL;
+
+	vsock_addr_init(&src, le64_to_cpu(pkt->hdr.src_cid),
+			le32_to_cpu(pkt->hdr.src_port));
+	vsock_addr_init(&dst, le64_to_cpu(pkt->hdr.dst_cid),
+			le32_to_cpu(pkt->hdr.dst_port));
+
+	sk = vsock_find_connected_socket(&src, &dst);
+	if (!sk)
+		return NULL;
+
+	lock_sock(sk);
+
+	if (sk->sk_type != SOCK_STREAM || sk->sk_state != TCP_ESTABLISHED ||
+	    sock_flag(sk, SOCK_DONE)) {
+		release_sock(sk);
+		sock_put(sk);
+		return NULL;
+	}
+
+	/* Update CID in case it has changed after a transport reset event */
+	vsk = vsock_sk(sk);
+	if (vsk->local_addr.svm_cid != VMADDR_CID_ANY)
+		vsk->local_addr.svm_cid = dst.svm_cid;
+
+	return sk;
+}
+
+static bool virtio_transport_recv_batch_match(struct sock *sk,
+					      struct virtio_vsock_pkt *pkt)
+{
+	struct vsock_sock *vsk = vsock_sk(sk);
+
+	return le16_to_cpu(pkt->hdr.op) == VIRTIO_VSOCK_OP_RW &&
+	       le16_to_cpu(pkt->hdr.type) == VIRTIO_VSOCK_TYPE_STREAM &&
+	       le64_to_cpu(pkt->hdr.src_cid) == vsk->remote_addr.svm_cid &&
+	       le32_to_cpu(pkt->hdr.src_port) == vsk->remote_addr.svm_port &&
+	       le32_to_cpu(pkt->hdr.dst_port) == vsk->local_addr.svm_port;
+}
+
+static void virtio_transport_recv_batch_end(struct sock *sk)
+{
+	vsock_data_ready(sk);
+	release_sock(sk);
+	sock_put(sk);
+}
+
+/* Deliver a list of received packets, in order. Runs of data packets for the
+ * same connected stream socket are queued under a single socket lock and wake
+ * up the reader once. Everything else goes through virtio_transport_recv_pkt().
+ *
+ * Same locking rules as virtio_transport_recv_pkt().
+ */
+void virtio_transport_recv_pkts(struct virtio_transport *t,
+				struct list_head *pkts)
+{
+	struct virtio_vsock_pkt *pkt, *n;
+	struct sock *sk = NULL;
+
+	list_for_each_entry_safe(pkt, n, pkts, list) {
+		list_del(&pkt->list);
+
+		if (sk && !virtio_transport_recv_batch_match(sk, pkt)) {
+			virtio_transport_recv_batch_end(sk);
+			sk = NULL;
+		}
+
+		if (!sk)
+			sk = virtio_transport_recv_batch_start(pkt);
+
+		if (!sk) {
+			virtio_transport_recv_pkt(t, pkt);
+			continue;
+		}
+
+		trace_virtio_transport_recv_pkt(le64_to_cpu(pkt->hdr.src_cid),
+						le32_to_cpu(pkt->hdr.src_port),
+						le64_to_cpu(pkt->hdr.dst_cid),
+						le32_to_cpu(pkt->hdr.dst_port),
+						le32_to_cpu(pkt->hdr.len),
+						le16_to_cpu(pkt->hdr.type),
+						le16_to_cpu(pkt->hdr.op),
+						le32_to_cpu(pkt->hdr.flags),
+						le32_to_cpu(pkt->hdr.buf_alloc),
+						le32_to_cpu(pkt->hdr.fwd_cnt));
+
+		if (virtio_transport_space_update(sk, pkt))
+			sk->sk_write_space(sk);
+
+		virtio_transport_recv_enqueue(vsock_sk(sk), pkt);
+	}
+
+	if (sk)
+		virtio_transport_recv_batch_end(sk);
+}
+EXPORT_SYMBOL_GPL(virtio_transport_recv_pkts);
+
 void virtio_transport_free_pkt(struct virtio_vsock_pkt *pkt)
 {
+	u32 i;
+
+	for (i = 0; i < pkt->nr_bvec; i++)
+		put_page(pkt->bvec[i].bv_page);
+	kfree(pkt->bvec);
+	/* Last reference completes the MSG_ZEROCOPY send */
+	net_zcopy_put(pkt->uarg);
 	kvfree(pkt->buf);
 	kfree(pkt);
 }
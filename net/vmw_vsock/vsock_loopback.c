@@ -121,21 +121,17 @@ static void vsock_loopback_work(struct work_struct *work)
 {
 	struct vsock_loopback *vsock =
 		container_of(work, struct vsock_loopback, pkt_work);
+	struct virtio_vsock_pkt *pkt;
 	LIST_HEAD(pkts);
 
 	spin_lock_bh(&vsock->pkt_list_lock);
 	list_splice_init(&vsock->pkt_list, &pkts);
 	spin_unlock_bh(&vsock->pkt_list_lock);
 
-	while (!list_empty(&pkts)) {
-		struct virtio_vsock_pkt *pkt;
-
-		pkt = list_first_entry(&pkts, struct virtio_vsock_pkt, list);
-		list_del_init(&pkt->list);
-
+	list_for_each_entry(pkt, &pkts, list)
 		virtio_transport_deliver_tap_pkt(pkt);
-		virtio_transport_recv_pkt(&loopback_transport, pkt);
-	}
+
+	virtio_transport_recv_pkts(&loopback_transport, &pkts);
 }
 
 static int __init vsock_loopback_init(void)
@@ -14,6 +14,7 @@
 #include <pthread.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <linux/compiler.h>
@@ -22,6 +23,7 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <perf/cpumap.h>
+#include <api/fs/fs.h>
 
 #include "../util/mutex.h"
 #include "../util/stat.h"
@@ -110,6 +112,34 @@ static void toggle_done(int sig __maybe_unused,
 	timersub(&bench__end, &bench__start, &bench__runtime);
 }
 
+/*
+ * Sum the per-bucket counts in debugfs of lookups that had to wait for a
+ * hash bucket lock. Returns false if they cannot be read, e.g. when not
+ * running as root or without CONFIG_DEBUG_FS.
+ */
+static bool read_hash_contention(unsigned long long *total)
+{
+	unsigned long long bucket, contended;
+	const char *debugfs = debugfs__mountpoint();
+	char path[PATH_MAX];
+	FILE *fp;
+
+	if (!debugfs)
+		return false;
+
+	snprintf(path, sizeof(path), "%s/futex/hash_contention", debugfs);
+	fp = fopen(path, "r");
+	if (!fp)
+		return false;
+
+	*total = 0;
+	while (fscanf(fp, "%llu %llu", &bucket, &contended) == 2)
+		*total += contended;
+
+	fclose(fp);
+	return true;
+}
+
 static void print_summary(void)
 {
 	unsigned long avg = avg_stats(&throughput_stats);
@@ -123,6 +153,8 @@ static void print_summary(void)
 int bench_futex_hash(int argc, const char **argv)
 {
 	int ret = 0;
+	unsigned long long contended_start, contended_end;
+	bool contention;
 	cpu_set_t *cpuset;
 	struct sigaction act;
 	unsigned int i;
@@ -172,6 +204,7 @@ int bench_futex_hash(int argc, const char **argv)
 
 	threads_starting = params.nthreads;
 	pthread_attr_init(&thread_attr);
+	contention = read_hash_contention(&contended_start);
 	gettimeofday(&bench__start, NULL);
 
 	nrcpus = perf_cpu_map__nr(cpu);
@@ -243,6 +276,11 @@ int bench_futex_hash(int argc, const char **argv)
 
 	print_summary();
 
+	/* The counts are system wide, other futex users add to them too. */
+	if (contention && read_hash_contention(&contended_end))
+		printf("Contended futex hash bucket lock acquisitions: %llu\n",
+		       contended_end - contended_start);
+
 	free(worker);
 	free(cpu);
 	return ret;
@@ -21,6 +21,13 @@ static char *directions[] = {
 	"FROM_DEVICE",
 };
 
+static char *modes[] = {
+	"SINGLE",
+	"SG",
+	"ALLOC",
+	"SYNC",
+};
+
 int main(int argc, char **argv)
 {
 	struct map_benchmark map;
@@ -31,11 +38,13 @@ int main(int argc, char **argv)
 	int bits = 32, xdelay = 0, dir = DMA_MAP_BIDIRECTIONAL;
 	/* default granule 1 PAGESIZE */
 	int granule = 1;
+	/* default dma_map_single, one sg entry, unmap right away */
+	int mode = DMA_MAP_MODE_SINGLE, nents = 1, defer = 0;
 
 	int cmd = DMA_MAP_BENCHMARK;
 	char *p;
 
-	while ((opt = getopt(argc, argv, "t:s:n:b:d:x:g:")) != -1) {
+	while ((opt = getopt(argc, argv, "t:s:n:b:d:x:g:m:e:D:")) != -1) {
 		switch (opt) {
 		case 't':
 			threads = atoi(optarg);
@@ -58,6 +67,15 @@ int main(int argc, char **argv)
 		case 'g':
 			granule = atoi(optarg);
 			break;
+		case 'm':
+			mode = atoi(optarg);
+			break;
+		case 'e':
+			nents = atoi(optarg);
+			break;
+		case 'D':
+			defer = atoi(optarg);
+			break;
 		default:
 			return -1;
 		}
@@ -98,6 +116,24 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (mode < DMA_MAP_MODE_SINGLE || mode > DMA_MAP_MODE_SYNC) {
+		fprintf(stderr, "invalid mode, must be in 0-%d\n",
+			DMA_MAP_MODE_SYNC);
+		exit(1);
+	}
+
+	if (nents < 1 || nents > DMA_MAP_MAX_NENTS) {
+		fprintf(stderr, "invalid number of sg entries, must be in 1-%d\n",
+			DMA_MAP_MAX_NENTS);
+		exit(1);
+	}
+
+	if (defer < 0 || defer > DMA_MAP_MAX_DEFER) {
+		fprintf(stderr, "invalid number of deferred unmaps, must be in 0-%d\n",
+			DMA_MAP_MAX_DEFER);
+		exit(1);
+	}
+
 	fd = open("/sys/kernel/debug/dma_map_benchmark", O_RDWR);
 	if (fd == -1) {
 		perror("open");
@@ -112,6 +148,9 @@ int main(int argc, char **argv)
 	map.dma_dir = dir;
 	map.dma_trans_ns = xdelay;
 	map.granule = granule;
+	map.mode = mode;
+	map.nents = nents;
+	map.defer_unmap = defer;
 
 	if (ioctl(fd, cmd, &map)) {
 		perror("ioctl");
@@ -120,10 +159,18 @@ int main(int argc, char **argv)
 
 	printf("dma mapping benchmark: threads:%d seconds:%d node:%d dir:%s granule: %d\n",
 			threads, seconds, node, dir[directions], granule);
+	printf("mode:%s nents:%d deferred unmaps:%d operations:%llu\n",
+			modes[mode], nents, defer, (unsigned long long)map.loops);
 	printf("average map latency(us):%.1f standard deviation:%.1f\n",
 			map.avg_map_100ns/10.0, map.map_stddev/10.0);
 	printf("average unmap latency(us):%.1f standard deviation:%.1f\n",
 			map.avg_unmap_100ns/10.0, map.unmap_stddev/10.0);
+	printf("map latency(us) p50:%.3f p99:%.3f p99.9:%.3f\n",
+			map.map_p50_ns/1000.0, map.map_p99_ns/1000.0,
+			map.map_p999_ns/1000.0);
+	printf("unmap latency(us) p50:%.3f p99:%.3f p99.9:%.3f\n",
+			map.unmap_p50_ns/1000.0, map.unmap_p99_ns/1000.0,
+			map.unmap_p999_ns/1000.0);
 
 	return 0;
 }
@@ -52,7 +52,7 @@ static int coalesced_mmio_has_room(struct kvm_coalesced_mmio_dev *dev, u32 last)
 	 * there is always one unused entry in the buffer
 	 */
 	ring = dev->kvm->coalesced_mmio_ring;
-	avail = (ring->first - last - 1) % KVM_COALESCED_MMIO_MAX;
+	avail = (READ_ONCE(ring->first) - last - 1) % KVM_COALESCED_MMIO_MAX;
 	if (avail == 0) {
 		/* full */
 		return 0;
@@ -61,35 +61,57 @@ static int coalesced_mmio_has_room(struct kvm_coalesced_mmio_dev *dev, u32 last)
 	return 1;
 }
 
+/*
+ * Any number of vCPUs can write to the ring at once. Each one claims a slot
+ * by advancing kvm->coalesced_mmio_reserved, fills it, and then publishes it
+ * by moving ring->last past it, in claim order so that userspace never sees
+ * a slot before the ones ahead of it are complete. Preemption stays off from
+ * claim to publish, so a vCPU waits at most for a few stores on another CPU.
+ *
+ * The indexes are kept in struct kvm rather than taken from the shared page:
+ * userspace only moves ring->first, and nothing it writes can leave a vCPU
+ * waiting on a slot that is never published.
+ */
 static int coalesced_mmio_write(struct kvm_vcpu *vcpu,
 				struct kvm_io_device *this, gpa_t addr,
 				int len, const void *val)
 {
 	struct kvm_coalesced_mmio_dev *dev = to_mmio(this);
-	struct kvm_coalesced_mmio_ring *ring = dev->kvm->coalesced_mmio_ring;
-	__u32 insert;
+	struct kvm *kvm = dev->kvm;
+	struct kvm_coalesced_mmio_ring *ring = kvm->coalesced_mmio_ring;
+	__u32 insert, next;
 
 	if (!coalesced_mmio_in_range(dev, addr, len))
 		return -EOPNOTSUPP;
 
-	spin_lock(&dev->kvm->ring_lock);
+	preempt_disable();
 
-	insert = READ_ONCE(ring->last);
-	if (!coalesced_mmio_has_room(dev, insert) ||
-	    insert >= KVM_COALESCED_MMIO_MAX) {
-		spin_unlock(&dev->kvm->ring_lock);
-		return -EOPNOTSUPP;
-	}
+	insert = atomic_read(&kvm->coalesced_mmio_reserved);
+	do {
+		if (!coalesced_mmio_has_room(dev, insert)) {
+			preempt_enable();
+			return -EOPNOTSUPP;
+		}
+		next = (insert + 1) % KVM_COALESCED_MMIO_MAX;
+	} while (!atomic_try_cmpxchg(&kvm->coalesced_mmio_reserved,
+				     &insert, next));
 
-	/* copy data in first free entry of the ring */
+	/* copy data in the entry we claimed */
 
 	ring->coalesced_mmio[insert].phys_addr = addr;
 	ring->coalesced_mmio[insert].len = len;
 	memcpy(ring->coalesced_mmio[insert].data, val, len);
 	ring->coalesced_mmio[insert].pio = dev->zone.pio;
+
+	/* wait for the entries claimed before ours to be published */
+	while (atomic_read_acquire(&kvm->coalesced_mmio_published) != insert)
+		cpu_relax();
+
 	smp_wmb();
-	ring->last = (insert + 1) % KVM_COALESCED_MMIO_MAX;
-	spin_unlock(&dev->kvm->ring_lock);
+	WRITE_ONCE(ring->last, next);
+	atomic_set_release(&kvm->coalesced_mmio_published, next);
+
+	preempt_enable();
 	return 0;
 }
 
@@ -118,11 +140,12 @@ int kvm_coalesced_mmio_init(struct kvm *kvm)
 	kvm->coalesced_mmio_ring = page_address(page);
 
 	/*
-	 * We're using this spinlock to sync access to the coalesced ring.
+	 * Writers synchronize on the ring indexes, see coalesced_mmio_write().
 	 * The list doesn't need its own lock since device registration and
 	 * unregistration should only happen when kvm->slots_lock is held.
 	 */
-	spin_lock_init(&kvm->ring_lock);
+	atomic_set(&kvm->coalesced_mmio_reserved, 0);
+	atomic_set(&kvm->coalesced_mmio_published, 0);
 	INIT_LIST_HEAD(&kvm->coalesced_zones);
 
 	return 0;